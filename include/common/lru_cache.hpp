@@ -87,6 +87,7 @@ int Cache<ItemKey, ItemType>::del(const ItemKey& key) {
         node = _lru_map[key];
         node->RemoveFromList();
         _lru_map.erase(node->key);
+        delete node;
     }
     return 0;
 }
@@ -244,6 +244,8 @@ public:
 
     pb::Engine get_table_engine(int64_t tableid);
     TableInfo get_table_info(int64_t tableid);
+    // 表不存在返回-1
+    int64_t get_table_version(int64_t tableid);
 
     IndexInfo get_index_info(int64_t indexid);
 
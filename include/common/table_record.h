@@ -103,6 +103,16 @@ public:
         return -1;
     }
 
+    // 紧凑行格式, 按tag定位字段, 解析时不需要顺序扫描, 格式见encode_compact实现
+    // 第一个字节COMPACT_ROW_MAGIC在protobuf中是非法的tag, 可以和旧格式共存
+    static const uint8_t COMPACT_ROW_MAGIC = 0x07;
+    static const uint8_t COMPACT_ROW_VERSION = 1;
+    static const size_t COMPACT_ROW_HEADER_SIZE = 4;
+    static bool is_var_field(const FieldDescriptor* field) {
+        return field->cpp_type() == FieldDescriptor::CPPTYPE_STRING;
+    }
+    int encode_compact(std::string& out);
+
     int decode(const std::string& in) {
         if (_message->ParseFromString(in)) {
             return 0;
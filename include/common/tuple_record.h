@@ -72,9 +72,16 @@ public:
         return val;
     }
 
+    bool is_compact() const {
+        return _size > 0 && (uint8_t)_data[0] == TableRecord::COMPACT_ROW_MAGIC;
+    }
+
     // decode 'required' (rather than 'all') fields from serialized protobuf bytes
     // and fill to SmartRecord
     int decode_fields(const std::vector<int32_t>& fields, SmartRecord record) {
+        if (is_compact()) {
+            return decode_compact_fields(fields, record);
+        }
         uint64_t field_key  = 0;
         uint64_t field_num  = 0;
         int32_t  wired_type = 0;
@@ -175,6 +182,116 @@ public:
         }
         return 0;
     }
+    // 紧凑格式直接按tag计算字段位置, 只解析需要的字段
+    int decode_compact_fields(const std::vector<int32_t>& fields, SmartRecord record) {
+        if (_size < TableRecord::COMPACT_ROW_HEADER_SIZE ||
+                (uint8_t)_data[1] != TableRecord::COMPACT_ROW_VERSION) {
+            DB_WARNING("invalid compact row, size: %lu", _size);
+            return -1;
+        }
+        uint16_t max_tag = 0;
+        memcpy(&max_tag, _data + 2, sizeof(max_tag));
+        size_t bitmap_size = max_tag / 8 + 1;
+        const uint8_t* schema_bits = (const uint8_t*)_data + TableRecord::COMPACT_ROW_HEADER_SIZE;
+        const uint8_t* var_bits = schema_bits + bitmap_size;
+        const uint8_t* null_bits = var_bits + bitmap_size;
+        size_t fixed_pos = TableRecord::COMPACT_ROW_HEADER_SIZE + bitmap_size * 3;
+        if (fixed_pos > _size) {
+            DB_WARNING("compact row truncated, size: %lu", _size);
+            return -1;
+        }
+        size_t fixed_cnt = count_bits(schema_bits, var_bits, bitmap_size * 8);
+        size_t var_cnt = count_bits(var_bits, nullptr, bitmap_size * 8);
+        size_t offset_pos = fixed_pos + fixed_cnt * sizeof(uint64_t);
+        size_t var_pos = offset_pos + var_cnt * sizeof(uint32_t);
+        if (var_pos > _size) {
+            DB_WARNING("compact row truncated, size: %lu", _size);
+            return -1;
+        }
+        for (int32_t tag : fields) {
+            // 写入之后新加的字段当作null
+            if (tag < 0 || tag > max_tag || !test_bit(schema_bits, tag) || test_bit(null_bits, tag)) {
+                continue;
+            }
+            auto field = record->get_field_by_tag(tag);
+            if (field == nullptr) {
+                DB_WARNING("invalid field: %d", tag);
+                return -1;
+            }
+            if (test_bit(var_bits, tag) != TableRecord::is_var_field(field)) {
+                DB_WARNING("field type not match, field: %d", tag);
+                return -1;
+            }
+            if (test_bit(var_bits, tag)) {
+                size_t idx = count_bits(var_bits, nullptr, tag);
+                uint32_t start = 0;
+                uint32_t end = 0;
+                if (idx > 0) {
+                    memcpy(&start, _data + offset_pos + (idx - 1) * sizeof(uint32_t), sizeof(start));
+                }
+                memcpy(&end, _data + offset_pos + idx * sizeof(uint32_t), sizeof(end));
+                if (start > end || var_pos + end > _size) {
+                    DB_WARNING("compact row truncated, field: %d", tag);
+                    return -1;
+                }
+                record->set_string(field, std::string(_data + var_pos + start, end - start));
+                continue;
+            }
+            const char* slot = _data + fixed_pos +
+                count_bits(schema_bits, var_bits, tag) * sizeof(uint64_t);
+            int64_t int_val = 0;
+            memcpy(&int_val, slot, sizeof(int_val));
+            switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_INT32:
+                record->set_int32(field, int_val);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                record->set_uint32(field, int_val);
+                break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                record->set_int64(field, int_val);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                record->set_uint64(field, int_val);
+                break;
+            case FieldDescriptor::CPPTYPE_FLOAT: {
+                float val = 0;
+                memcpy(&val, slot, sizeof(val));
+                record->set_float(field, val);
+            } break;
+            case FieldDescriptor::CPPTYPE_DOUBLE: {
+                double val = 0;
+                memcpy(&val, slot, sizeof(val));
+                record->set_double(field, val);
+            } break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                record->set_boolean(field, int_val != 0);
+                break;
+            default:
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+private:
+    static bool test_bit(const uint8_t* bits, int32_t tag) {
+        return (bits[tag / 8] >> (tag % 8)) & 1;
+    }
+    // bits中小于tag的位数, exclude不为空时不计exclude中的位
+    static size_t count_bits(const uint8_t* bits, const uint8_t* exclude, int32_t tag) {
+        size_t cnt = 0;
+        for (int32_t i = 0; i < tag / 8; i++) {
+            uint8_t byte = exclude == nullptr ? bits[i] : (bits[i] & ~exclude[i]);
+            cnt += __builtin_popcount(byte);
+        }
+        if (tag % 8 != 0) {
+            uint8_t byte = exclude == nullptr ? bits[tag / 8] : (bits[tag / 8] & ~exclude[tag / 8]);
+            cnt += __builtin_popcount(byte & ((1 << (tag % 8)) - 1));
+        }
+        return cnt;
+    }
+
 private:
     const char*   _data;
     size_t  _size;
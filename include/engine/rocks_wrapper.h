@@ -15,6 +15,7 @@
 #pragma once
  
 #include <string>
+#include <unordered_set>
 #include "rocksdb/db.h"
 #include "rocksdb/slice.h"
 #include "rocksdb/cache.h"
@@ -22,6 +23,8 @@
 #include "rocksdb/slice_transform.h"
 #include "rocksdb/utilities/transaction.h"
 #include "rocksdb/utilities/transaction_db.h"
+#include "rocksdb/table.h"
+#include <bvar/bvar.h>
 #include "common.h"
 //#include "proto/store.interface.pb.h"
 
@@ -146,6 +149,18 @@ public:
         return _cache;
     }
 
+    // 各column family的block cache, raft_log可能和data共用一个
+    rocksdb::Cache* get_block_cache(const std::string& cf_name) {
+        if (_block_caches.count(cf_name) == 0) {
+            return nullptr;
+        }
+        return _block_caches[cf_name].get();
+    }
+    // 各column family的block cache使用量, 单位字节, 共用cache时数值相同
+    void get_block_cache_usage(std::map<std::string, size_t>* usage);
+    // 所有column family用到的block cache, 已去重
+    void get_block_caches(std::unordered_set<const rocksdb::Cache*>* caches);
+
     void close() {
         delete _txn_db;
     }
@@ -153,12 +168,20 @@ private:
 
     RocksWrapper();
 
+    // 新建一个block cache并导出使用量bvar
+    std::shared_ptr<rocksdb::Cache> new_block_cache(const std::string& cf_name, int64_t cache_mb);
+    rocksdb::BlockBasedTableOptions make_table_options(const std::string& cf_name,
+            const std::shared_ptr<rocksdb::Cache>& cache, bool partition_index);
+
     std::string _db_path;
 
     bool _is_init;
 
     rocksdb::TransactionDB* _txn_db;
+    // data column family的block cache
     rocksdb::Cache*         _cache;
+    std::map<std::string, std::shared_ptr<rocksdb::Cache>> _block_caches;
+    std::map<std::string, std::unique_ptr<bvar::PassiveStatus<int64_t>>> _cache_usage_vars;
 
     std::map<std::string, rocksdb::ColumnFamilyHandle*> _column_families;
 
@@ -14,22 +14,43 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <rocksdb/compaction_filter.h>
-#include <bthread/mutex.h>
+#ifdef BAIDU_INTERNAL
+#include <base/containers/doubly_buffered_data.h>
+#else
+#include <butil/containers/doubly_buffered_data.h>
+#endif
 #include "key_encoder.h"
+#include "lru_cache.h"
 #include "type_utils.h"
 #include "schema_factory.h"
 #include "transaction.h"
 
 namespace baikaldb {
+DECLARE_int32(split_filter_index_cache_size);
+
 class SplitCompactionFilter : public rocksdb::CompactionFilter {
+    struct RangeKey {
+        std::string start_key;
+        std::string end_key;
+    };
+    // region_id => range
+    typedef std::unordered_map<int64_t, RangeKey> RangeKeyMap;
+    struct IndexEntry {
+        IndexInfo index_info;
+        IndexInfo pk_info;
+    };
+    typedef std::shared_ptr<IndexEntry> SmartIndexEntry;
 public:
     static SplitCompactionFilter* get_instance() {
         static SplitCompactionFilter _instance;
         return &_instance;
     }
     ~SplitCompactionFilter() {
-        bthread_mutex_destroy(&_mutex);
     }
     const char* Name() const override {
         return "SplitCompactionFilter";
@@ -38,6 +59,7 @@ public:
     // A return value of false indicates that the kv should be preserved 
     // a return value of true indicates that this key-value should be removed from the
     // output of the compaction. 
+    // 每个key都会调用, region范围和索引信息都从双buffer里读, 不加全局锁也不拷贝
     bool Filter(int /*level*/,
                 const rocksdb::Slice& key,
                 const rocksdb::Slice& value,
@@ -49,19 +71,25 @@ public:
         }
         TableKey table_key(key);
         int64_t region_id = table_key.extract_i64(0);
-        //std::string start_key;
-        std::string end_key;
-        {
-            BAIDU_SCOPED_LOCK(_mutex);
-            //start_key = _range_key_map[region_id].first;
-            end_key = _range_key_map[region_id].second;
+        butil::DoublyBufferedData<RangeKeyMap>::ScopedPtr range_map;
+        if (_range_key_map.Read(&range_map) != 0) {
+            return false;
+        }
+        auto iter = range_map->find(region_id);
+        if (iter == range_map->end()) {
+            return false;
         }
+        const std::string& end_key = iter->second.end_key;
         if (/*start_key.empty() &&*/end_key.empty()) {
             return false;
         }
         int64_t index_id = table_key.extract_i64(sizeof(int64_t));
-        IndexInfo index_info = _factory->get_index_info(index_id);
-        IndexInfo pk_info = _factory->get_index_info(index_info.pk);
+        SmartIndexEntry index_entry = get_index_entry(index_id);
+        if (index_entry == nullptr) {
+            return false;
+        }
+        IndexInfo& index_info = index_entry->index_info;
+        IndexInfo& pk_info = index_entry->pk_info;
 
         //int ret1 = 0;
         int ret2 = 0;
@@ -86,20 +114,86 @@ public:
     }
 
     void set_range_key(int64_t region_id, const std::string& start_key, const std::string& end_key) {
-        BAIDU_SCOPED_LOCK(_mutex);
-        _range_key_map[region_id].first = start_key;
-        _range_key_map[region_id].second = end_key;
+        auto update_fn = [region_id, &start_key, &end_key](RangeKeyMap& range_map) {
+            range_map[region_id].start_key = start_key;
+            range_map[region_id].end_key = end_key;
+            return 1;
+        };
+        _range_key_map.Modify(update_fn);
+    }
+
+    // schema更新后清掉该表所有索引的缓存, 下次遇到时重新从SchemaFactory加载
+    // SchemaFactory异步生效, 生效前加载到的旧schema不缓存
+    void remove_table(const pb::SchemaInfo& table) {
+        {
+            std::lock_guard<std::mutex> lock(_pending_mutex);
+            _pending_versions[table.table_id()] = table.version();
+        }
+        _index_cache.del(table.table_id());
+        for (auto& index : table.indexs()) {
+            _index_cache.del(index.index_id());
+        }
+        ++_cache_version;
     }
 
 private:
     SplitCompactionFilter() {
-        bthread_mutex_init(&_mutex, NULL);
         _factory = SchemaFactory::get_instance();
+        _index_cache.init(FLAGS_split_filter_index_cache_size);
+    }
+
+    // 第一次遇到某个索引时从SchemaFactory加载, 之后从lru缓存中读
+    // 同一个索引的key是连续的, 每个线程先看上一次用的索引, 相同时不用加锁
+    SmartIndexEntry get_index_entry(int64_t index_id) const {
+        static thread_local int64_t last_index_id = -1;
+        static thread_local int64_t last_version = -1;
+        static thread_local SmartIndexEntry last_entry;
+        int64_t version = _cache_version.load();
+        if (index_id == last_index_id && version == last_version) {
+            return last_entry;
+        }
+        SmartIndexEntry index_entry;
+        if (_index_cache.find(index_id, &index_entry) != 0) {
+            index_entry = std::make_shared<IndexEntry>();
+            index_entry->index_info = _factory->get_index_info(index_id);
+            if (index_entry->index_info.id == -1) {
+                // schema还没有同步到, 不缓存, 保留数据
+                return nullptr;
+            }
+            index_entry->pk_info = _factory->get_index_info(index_entry->index_info.pk);
+            if (!schema_applied(index_entry->index_info.pk)) {
+                return index_entry;
+            }
+            _index_cache.add(index_id, index_entry);
+        }
+        last_index_id = index_id;
+        last_version = version;
+        last_entry = index_entry;
+        return index_entry;
+    }
+
+    // 表的schema更新是否已经在SchemaFactory里生效, 只在缓存未命中时调用
+    bool schema_applied(int64_t table_id) const {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        auto iter = _pending_versions.find(table_id);
+        if (iter == _pending_versions.end()) {
+            return true;
+        }
+        if (_factory->get_table_version(table_id) < iter->second) {
+            return false;
+        }
+        _pending_versions.erase(iter);
+        return true;
     }
 
-    // region_id => end_key
-    mutable std::unordered_map<int64_t, std::pair<std::string, std::string> > _range_key_map;
-    mutable bthread_mutex_t _mutex;
+    mutable butil::DoublyBufferedData<RangeKeyMap> _range_key_map;
+    // index_id => 索引及其主键的信息, 超过split_filter_index_cache_size时淘汰最久没用的
+    mutable Cache<int64_t, SmartIndexEntry> _index_cache;
+    // 每次schema更新加1, 线程里记住的上一个索引随之失效
+    std::atomic<int64_t> _cache_version = {0};
+    // table_id => 收到但还没在SchemaFactory生效的schema版本
+    mutable std::unordered_map<int64_t, int64_t> _pending_versions;
+    mutable std::mutex _pending_mutex;
     SchemaFactory* _factory;
 };
 }//namespace
@@ -108,12 +108,27 @@ public:
         return _valid;
     }
 
+    // 并行扫描时每个iterator只扫[begin, end)这段key, 空表示不限制
+    // 需要在open之前设置, 只支持正向扫描
+    void set_sub_range(const std::string& begin, const std::string& end,
+            const rocksdb::Snapshot* snapshot) {
+        _sub_begin = begin;
+        _sub_end = end;
+        _snapshot = snapshot;
+    }
+
+    // 全region扫描等大范围读, 开启预读并且不填充block cache, 需要在open之前设置
+    void set_bulk_scan(bool bulk_scan) {
+        _bulk_scan = bulk_scan;
+    }
+
     static TableIterator* scan_primary(
         SmartTransaction        txn,
         const IndexRange&       range, 
         std::vector<int32_t>&   fields, 
         bool                    check_region, 
-        bool                    forward);
+        bool                    forward,
+        bool                    bulk_scan = false);
 
     static IndexIterator* scan_secondary(
         SmartTransaction    txn,
@@ -152,6 +167,13 @@ protected:
     bool                    _forward;
     rocksdb::ColumnFamilyHandle* _data_cf;
     std::vector<int32_t>    _fields;
+    std::string             _sub_begin;
+    std::string             _sub_end;
+    const rocksdb::Snapshot* _snapshot = nullptr;
+    bool                    _bulk_scan = false;
+    // iterate_upper_bound引用的key, 生命周期需要和_iter一致
+    std::string             _iterate_upper_key;
+    rocksdb::Slice          _iterate_upper_slice;
 
     int _prefix_len = sizeof(int64_t) * 2;
 
@@ -160,6 +182,8 @@ protected:
     bool _fits_right_bound();
 
     bool _fits_region();
+
+    void _set_iterate_upper_bound(rocksdb::ReadOptions& read_options);
 };
 
 class TableIterator : public Iterator {
@@ -91,6 +91,15 @@ public:
             std::vector<int32_t>& fields,
             bool            check_region);
 
+    // 二级索引回表时批量读主表, 只读不加锁, keys中需要有完整的主键字段
+    // rets[i]为0时values[i]是主表的value, 为-2表示不存在, 由调用方用TupleRecord解析
+    int multi_get_primary(
+            int64_t         region,
+            IndexInfo&      pk_index,
+            const std::vector<SmartRecord>& keys,
+            std::vector<std::string>* values,
+            std::vector<int>* rets);
+
     // TODO: update return status
     // Return -2 if key not found
     int get_update_secondary(
@@ -26,6 +26,8 @@
 #include "exec_node.h"
 #include "agg_fn_call.h"
 #include "mut_table_key.h"
+#include "fixed_key_hash_map.h"
+#include "mem_tracker.h"
 
 namespace baikaldb {
 class AggNode : public ExecNode {
@@ -47,7 +49,23 @@ public:
     virtual void close(RuntimeState* state);
     virtual void transfer_pb(pb::PlanNode* pb_node);
     void encode_agg_key(MemRow* row, MutTableKey& key);
-    void process_row_batch(RowBatch& batch);
+    int process_row_batch(RuntimeState* state, RowBatch& batch);
+    // 下推到store的部分聚合, 分组数达到上限就先输出一批, 由上层merge
+    void set_partial_flush() {
+        _partial_flush = true;
+        _pb_node.mutable_derive_node()->mutable_agg_node()->set_partial_flush(true);
+    }
+private:
+    // 从孩子拉数据做聚合, max_groups>0时分组数达到max_groups就返回
+    int agg_child_rows(RuntimeState* state, size_t max_groups);
+    size_t group_count();
+    void reset_group_iter();
+    bool group_iter_end();
+    // 取出当前分组的行并后移, 所有权转给调用方
+    MemRow* release_group_row();
+    bool can_use_fixed_key();
+    // key[0]为null标记, 后面每个分组列占一个uint64
+    void encode_fixed_key(MemRow* row, uint64_t* key);
 private:
     //需要推导_group_tuple_id _agg_tuple_id内部slot的类型
     std::vector<ExprNode*> _group_exprs;
@@ -58,10 +76,20 @@ private:
     //std::vector<int32_t> _intermediate_slot_ids;
     //std::vector<int32_t> _final_slot_ids;
     bool _is_merger = false;
+    bool _partial_flush = false;
+    size_t _child_idx = 0;
+    // 分组行占用的字节数, 记在query的内存预算上
+    int64_t _mem_used = 0;
+    SmartMemTracker _mem_tracker;
     MemRowDescriptor* _mem_row_desc;
     //用于分组和get_next的定位,用map可与mysql保持一致
     butil::FlatMap<std::string, MemRow*> _hash_map;
     butil::FlatMap<std::string, MemRow*>::iterator _iter;
+    //分组列都是定长数值类型时, 用定长key的开放寻址表代替_hash_map
+    bool _use_fixed_key = false;
+    FixedKeyHashMap<MemRow*> _fixed_hash_map;
+    std::vector<uint64_t> _fixed_key;
+    size_t _fixed_pos = 0;
 };
 }
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
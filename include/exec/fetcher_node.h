@@ -14,16 +14,21 @@
 
 #pragma once
 
+#include <deque>
+#include <functional>
 #include "exec_node.h"
 #include "table_record.h"
 #include "proto/store.interface.pb.h"
 #include "sorter.h"
+#include "column_codec.h"
 #include "mem_row_compare.h"
+#include "select_stream.h"
 
 namespace baikaldb {
 class FetcherNode : public ExecNode {
 public:
     virtual ~FetcherNode() {
+        _store_cond.wait();
         for (auto expr : _slot_order_exprs) {
             ExprNode::destory_tree(expr);
         }
@@ -34,11 +39,16 @@ public:
         std::vector<SmartRecord>* records, int64_t region_id, 
         uint64_t log_id, int retry_times, int start_seq_id);
 
+
     virtual int init(const pb::PlanNode& node); 
     virtual int open(RuntimeState* state);
     virtual int get_next(RuntimeState* state, RowBatch* batch, bool* eos);
     virtual void close(RuntimeState* state) {
         //ExecNode::close(state);
+        //流式返回时limit提前结束, 关闭还没读完的stream
+        _store_cond.wait();
+        _sorter.reset();
+        _region_streams.clear();
         for (auto expr : _slot_order_exprs) {
             expr->close();
         }
@@ -58,10 +68,50 @@ public:
 
     int push_cmd_to_cache(RuntimeState* state);
 
+    // 设置后select的结果不再缓存, 每个region返回后分批交给handler处理(调用已加锁串行)
+    void set_batch_handler(const std::function<int(RowBatch*)>& handler) {
+        _batch_handler = handler;
+    }
+
+private:
+    // region返回的一包或者stream中一个chunk的结果, 读取时每次只解析一个batch
+    // 结果在row_values或列存编码的attachment里
+    struct RegionResult {
+        int64_t region_id = 0;
+        std::shared_ptr<pb::StoreRes> res;
+        std::shared_ptr<ColumnDecoder> decoder;
+        int rows = 0;
+        int next_row = 0;
+        bool eof() const {
+            return next_row >= rows;
+        }
+    };
+    // 流式返回时一个region的结果, 当前chunk读完后再从stream取下一个chunk
+    struct RegionStream {
+        int64_t region_id = 0;
+        std::shared_ptr<RegionResult> result;
+        // 为空表示没有后续chunk(整包返回或已读到最后一个chunk)
+        std::unique_ptr<SelectStreamReader> reader;
+    };
+    int create_region_result(pb::StoreRes& res, butil::IOBuf& attachment,
+            int64_t region_id, std::shared_ptr<RegionResult>* result);
+    // 处理region返回的一包或者一个chunk的结果
+    int add_select_result(RuntimeState* state, const pb::RegionInfo& info,
+            pb::StoreRes& res, butil::IOBuf& attachment, int64_t region_id, uint64_t log_id);
+    // 从result解析下一批行到batch, 最多填满batch
+    int decode_region_rows(RuntimeState* state, RegionResult* result, RowBatch* batch);
+    // 从region的结果解析下一批行到batch, 需要时等待下一个chunk, batch为空表示读完
+    int read_region_stream(RuntimeState* state, RegionStream* stream, RowBatch* batch);
+    // 把region返回的行分批交给_batch_handler
+    int handle_region_rows(RuntimeState* state, RegionResult* result,
+            int64_t region_id, uint64_t log_id);
+    int get_next_streaming(RuntimeState* state, RowBatch* batch, bool* eos);
+
 private:
     //insert数据按region拆分，select中主键不拆分，靠store自己过滤
     std::map<int64_t, std::vector<SmartRecord>> _insert_region_ids;
-    std::map<int64_t, std::shared_ptr<RowBatch>> _region_batch;
+    // stream返回时一个region有多个chunk, 每个chunk一个batch
+    std::map<int64_t, std::vector<std::shared_ptr<RowBatch>>> _region_batch;
     std::map<int64_t, pb::RegionInfo> _region_infos;
     std::map<std::string, int64_t> _start_key_sort;
     pb::OpType _op_type;
@@ -73,10 +123,21 @@ private:
     std::vector<bool> _is_null_first;
     std::shared_ptr<MemRowCompare> _mem_row_compare;
     std::shared_ptr<Sorter> _sorter;
+    // 有序且limit不大时, 各region的结果边收边放进_sorter的有界堆
+    bool _topn = false;
     bool _error = false;
     std::atomic<int> _affected_rows;
     // 因为split会导致多region出来,加锁保护公共资源
     std::mutex _region_lock;
+    std::function<int(RowBatch*)> _batch_handler;
+    BthreadCond _store_cond;
+    // select的结果在open后边收边输出, open只等各region回包(含重试), 不等数据
+    bool _streaming = false;
+    // 按region的start_key有序, 无序时也按这个顺序输出
+    std::map<std::string, std::shared_ptr<RegionStream>> _region_streams;
+    // 无序时正在输出的region
+    std::map<std::string, std::shared_ptr<RegionStream>>::iterator _stream_iter;
+    bool _stream_started = false;
 };
 }
 
@@ -42,8 +42,17 @@ public:
     virtual int get_next(RuntimeState* state, RowBatch* batch, bool* eos);
     virtual void close(RuntimeState* state);
     virtual void transfer_pb(pb::PlanNode* pb_node);
+    const std::vector<ExprNode*>& pruned_conjuncts() const {
+        return _pruned_conjuncts;
+    }
+    // 子节点(如并行扫描)已经在各自线程里算过_pruned_conjuncts, 返回的batch不用再过滤
+    void set_child_filtered() {
+        _child_pre_filtered = true;
+    }
 private:
     bool need_copy(MemRow* row);
+    // 在列存batch上计算过滤条件, 结果写回selection
+    void filter_columns(RowBatch* batch);
 
 private:
     std::vector<ExprNode*> _conjuncts;
@@ -51,6 +60,9 @@ private:
     RowBatch _child_row_batch;
     size_t  _child_row_idx;
     bool    _child_eos;
+    // 列存batch已经过滤过, 物化后的行不需要再算一遍
+    bool    _child_filtered = false;
+    bool    _child_pre_filtered = false;
 };
 }
 
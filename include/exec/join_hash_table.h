@@ -0,0 +1,79 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#ifdef BAIDU_INTERNAL
+#include <base/containers/flat_map.h>
+#else
+#include <butil/containers/flat_map.h>
+#endif
+#include "expr_node.h"
+#include "mem_row.h"
+#include "fixed_key_hash_map.h"
+
+namespace baikaldb {
+// 等值join的hash表, build侧的行按等值列建表, probe侧的行按等值列查找
+// 两侧等值列都是数值类型时用定长key, 否则把值转成string拼成key
+// 等值列有null的行不会和任何行匹配
+class JoinHashTable {
+public:
+    JoinHashTable() {
+        _str_map.init(12301);
+    }
+    // build_slots和probe_slots是一一对应的slot_ref
+    void init(const std::vector<ExprNode*>& build_slots,
+            const std::vector<ExprNode*>& probe_slots);
+    // 计算row的key和hash, 结果供insert/seek使用, key中有null时返回false
+    // 整数和double比较时, 不能精确转成double的整数也返回false
+    bool encode_key(MemRow* row, bool is_build);
+    uint64_t key_hash() const {
+        return _key_hash;
+    }
+    // 以下两个接口都使用最近一次encode_key的结果
+    void insert(MemRow* row);
+    std::vector<MemRow*>* seek();
+
+    void clear();
+    size_t size() const {
+        return _use_fixed_key ? _fixed_map.size() : _str_map.size();
+    }
+    bool use_fixed_key() const {
+        return _use_fixed_key;
+    }
+
+private:
+    enum KeyType {
+        KEY_INT,
+        KEY_DOUBLE,
+        KEY_STRING
+    };
+    static KeyType key_type(pb::PrimitiveType build_type, pb::PrimitiveType probe_type);
+
+private:
+    std::vector<ExprNode*> _build_slots;
+    std::vector<ExprNode*> _probe_slots;
+    std::vector<KeyType> _key_types;
+    bool _use_fixed_key = false;
+    std::vector<uint64_t> _fixed_key;
+    std::string _str_key;
+    uint64_t _key_hash = 0;
+    FixedKeyHashMap<std::vector<MemRow*>> _fixed_map;
+    butil::FlatMap<std::string, std::vector<MemRow*>> _str_map;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
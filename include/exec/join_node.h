@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #pragma once
+#include <deque>
 #include "exec_node.h"
 #include "mut_table_key.h"
 #ifdef BAIDU_INTERNAL 
@@ -21,6 +22,9 @@
 #include <butil/containers/flat_map.h>
 #endif
 #include "slot_ref.h"
+#include "join_hash_table.h"
+#include "spill_file.h"
+#include "runtime_state.h"
 
 namespace baikaldb {
 class JoinNode : public ExecNode {
@@ -28,6 +32,7 @@ public:
     JoinNode() : _child_eos(false) {
     }
     virtual  ~JoinNode() {
+        _wait_chunk_fetches();
         for (auto& condition : _conditions) {
             ExprNode::destory_tree(condition);
         }
@@ -96,15 +101,39 @@ private:
     int _construct_in_condition(std::vector<ExprNode*>& slot_refs,
                                   std::vector<std::vector<ExprValue>>& in_values,
                                   std::vector<ExprNode*>& in_exprs);
-    int _fetcher_join_table(RuntimeState* state, ExecNode* child_node,
-                            std::vector<MemRow*>& tuple_data);
-    void _construct_hash_map(const std::vector<MemRow*>& tuple_data,
-                             const std::vector<ExprNode*>& slot_refs);
-    void _encode_hash_key(MemRow* row,
-                          const std::vector<ExprNode*>& slot_ref_exprs,
-                          MutTableKey& key);
-    void _save_join_value(const std::vector<MemRow*>& tuple_data,
-                          const std::vector<ExprNode*>& slot_ref_exprs);
+    //拉取outer表的全部数据并收集join值, 超过内存上限时转为分区落盘
+    int _fetcher_outer_table(RuntimeState* state, bool is_build, int64_t* rows);
+    void _construct_hash_map(const std::vector<MemRow*>& tuple_data);
+    //拉取inner表作为build表的数据, 超过内存上限时转为分区落盘
+    int _fetcher_build_table(RuntimeState* state, std::vector<MemRow*>& tuple_data);
+    //下推产生的filter节点插在node上面, 返回join下面真正的子树根
+    ExecNode* _subtree_root(ExecNode* node);
+    //outer表的join值按批下推到inner表, 重新做索引选择和路由后open inner_node所在的子树
+    int _open_inner_chunk(RuntimeState* state, ExecNode* inner_node, size_t chunk_idx);
+    int _clone_inner_tree(ExecNode** root);
+    //在克隆的inner子树上拉取一批的全部数据到batches, 在后台bthread中执行
+    int _fetch_inner_chunk(RuntimeState* state, size_t chunk_idx,
+                           std::vector<std::shared_ptr<RowBatch>>* batches);
+    void _start_chunk_fetches(RuntimeState* state);
+    void _wait_chunk_fetches();
+    //读取inner表的下一个batch, 当前批读完后切换到拉取好的下一批
+    int _next_inner_batch(RuntimeState* state, RowBatch* batch, bool* eos);
+    // 内存中的outer/inner行记在query的内存预算上, 落盘或close时归还
+    void _consume_memory(RuntimeState* state, int64_t bytes);
+    void _release_memory();
+    //grace hash join: build和probe两边按等值列的hash分到相同编号的分区文件里, 再逐个分区做join
+    int _start_spill(RuntimeState* state, std::vector<MemRow*>& rows, bool is_build);
+    //在最后追加count个第level层的分区
+    int _open_partitions(int level, size_t count);
+    int _spill_row(MemRow* row, bool is_build);
+    //按第level层的hash写到[begin, begin + count)中的一个分区
+    int _spill_row(MemRow* row, bool is_build, int level, size_t begin, size_t count);
+    int _spill_probe_rows(RuntimeState* state);
+    //加载的build分区超过内存上限时, 把这个分区的build和probe行重新分到追加的子分区
+    int _repartition(RuntimeState* state, size_t partition);
+    int _load_partition(RuntimeState* state, size_t partition);
+    void _save_join_value(MemRow* mem_row, const std::vector<ExprNode*>& slot_ref_exprs);
+    void _make_join_value_chunks();
 
     int _construct_result_batch(RowBatch* batch, 
                                MemRow* outer_mem_row, 
@@ -125,16 +154,49 @@ private:
     std::vector<ExprNode*> _outer_equal_slot;
     std::vector<ExprNode*> _inner_equal_slot;
 
-    //从左边取到的等值条件的value
-    std::vector<std::vector<ExprValue>> _outer_join_values;
+    //从左边取到的等值条件的value, 去重后按第一个等值列的不同值个数分批
+    std::vector<std::vector<std::vector<ExprValue>>> _join_value_chunks;
+    //拉取outer表时按第一个等值列分组的join值, 分批后清空
+    std::unordered_set<std::string> _join_keys;
+    std::unordered_map<std::string, size_t> _first_value_groups;
+    std::vector<std::vector<std::vector<ExprValue>>> _join_value_groups;
+    //多批时每批一份克隆的计划树和独立的RuntimeState, 和其他批及主线程不共享
+    struct InnerChunkFetch {
+        size_t chunk_idx = 0;
+        RuntimeState state;
+        std::vector<std::shared_ptr<RowBatch>> batches;
+        int ret = 0;
+        BthreadCond cond;
+    };
+    //inner子树的pb, 每批据此克隆
+    pb::Plan _inner_plan;
+    //已发起拉取的批, 按批次顺序消费
+    std::deque<std::shared_ptr<InnerChunkFetch>> _chunk_fetches;
+    size_t _next_fetch_chunk = 0;
+    size_t _max_fetching_chunks = 1;
+    std::vector<std::shared_ptr<RowBatch>> _chunk_batches;
+    size_t _chunk_batch_idx = 0;
     
     std::vector<MemRow*> _outer_tuple_data;
     std::vector<MemRow*> _inner_tuple_data;
 
     //目前只支持等值join（a.id = b.id and a.name = b.name）
-    butil::FlatMap<std::string, std::vector<MemRow*>> _hash_map;
+    JoinHashTable _hash_table;
     size_t _hash_mapped_index = 0;
 
+    //build表超过内存上限后落盘, inner join时outer表为build表, 否则inner表为build表
+    bool _spilled = false;
+    //落盘前outer表和inner表留在内存中的行, 落盘后是当前加载的分区的行
+    int64_t _mem_used = 0;
+    SmartMemTracker _mem_tracker;
+    std::vector<std::shared_ptr<SpillFile>> _build_files;
+    std::vector<std::shared_ptr<SpillFile>> _probe_files;
+    //每个分区是第几次分区产生的
+    std::vector<int> _partition_levels;
+    size_t _partition_idx = 0;
+    //当前分区加载到内存的build行
+    std::vector<MemRow*> _partition_rows;
+
     std::vector<MemRow*>::iterator _outer_iter;
     
     MemRowDescriptor* _mem_row_desc;
@@ -45,13 +45,19 @@ private:
     int pack_head();
     int pack_fields();
     int pack_row(MemRow* row);
+    // COM_STMT_EXECUTE的结果行, mysql binary protocol
+    int pack_binary_row(MemRow* row);
+    int append_binary_value(const ExprValue& value, int32_t mysql_type);
     int pack_eof();
+    // 已打包的行超过阈值时先发给客户端, 客户端接收慢时阻塞执行
+    int flush(RuntimeState* state);
 
 private:
     pb::OpType _op_type;
     std::vector<ExprNode*> _projections;
     std::vector<ResultField> _fields;
     int _packet_id = 1;
+    bool _binary_protocol = false;
     MysqlWrapper* _wrapper = nullptr;
     DataBuffer* _send_buf = nullptr;
 };
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <deque>
 #include "scan_node.h"
 #include "fetcher_node.h"
 #include "table_record.h"
@@ -27,8 +28,14 @@ class ReverseIndexBase;
 class RocksdbScanNode : public ScanNode {
 public:
     RocksdbScanNode() {
+        bthread_mutex_init(&_scan_mutex, NULL);
+        bthread_cond_init(&_scan_cond, NULL);
     }
     virtual ~RocksdbScanNode() {
+        stop_parallel_scan();
+        _lookup_cond.wait();
+        bthread_cond_destroy(&_scan_cond);
+        bthread_mutex_destroy(&_scan_mutex);
         for (auto expr : _index_conjuncts) {
             ExprNode::destory_tree(expr);
         }
@@ -66,16 +73,69 @@ public:
         return _related_fetcher_node;
     }
 private:
+    // 按batch的模式把record写成MemRow或追加到列
+    void append_record(RowBatch* batch, SmartRecord& record);
     int get_next_by_table_get(RuntimeState* state, RowBatch* batch, bool* eos);
     int get_next_by_table_seek(RuntimeState* state, RowBatch* batch, bool* eos);
     int get_next_by_index_get(RuntimeState* state, RowBatch* batch, bool* eos);
     int get_next_by_index_seek(RuntimeState* state, RowBatch* batch, bool* eos);
+    // 大range的主表或索引扫描按数据量切成多段, 每段一个bthread扫描和过滤
+    struct SubRangeScan {
+        ~SubRangeScan() {
+            for (auto expr : conjuncts) {
+                expr->close();
+                ExprNode::destory_tree(expr);
+            }
+            for (auto expr : index_conjuncts) {
+                expr->close();
+                ExprNode::destory_tree(expr);
+            }
+        }
+        std::string begin;
+        std::string end;
+        // 上层filter和索引下推条件的副本, 每个worker独占
+        std::vector<ExprNode*> conjuncts;
+        std::vector<ExprNode*> index_conjuncts;
+        std::unique_ptr<MemRow> index_row;
+        std::deque<std::shared_ptr<RowBatch>> batches;
+        bool finished = false;
+        int ret = 0;
+    };
+    bool need_parallel_scan(RuntimeState* state);
+    int start_parallel_scan(RuntimeState* state, bool columnar);
+    // 在[lower, upper)上按估算的数据量切出最多concurrency-1个切分点
+    void split_scan_range(const std::string& lower, const std::string& upper,
+            size_t concurrency, std::vector<std::string>* bounds);
+    void scan_sub_range(SubRangeScan* sub, bool columnar);
+    void filter_sub_batch(SubRangeScan* sub, RowBatch* batch);
+    // 并行扫描非覆盖索引时按快照回表
+    int get_primary_by_snapshot(SmartRecord& record);
+    bool push_sub_batch(SubRangeScan* sub, const std::shared_ptr<RowBatch>& batch);
+    int get_next_by_parallel_seek(RuntimeState* state, RowBatch* batch, bool* eos);
+    void stop_parallel_scan();
+    // 二级索引回表: 一批索引行的主键用MultiGet读主表, 解析当前批时预取下一批
+    struct LookupBlock {
+        std::vector<SmartRecord> records;
+        std::vector<std::string> values;
+        std::vector<int> rets;
+        bool index_eof = false;
+        int ret = 0;
+    };
+    bool match_index_conjuncts(SmartRecord& record);
+    bool match_index_conjuncts(SmartRecord& record, std::vector<ExprNode*>& conjuncts,
+            std::unique_ptr<MemRow>& row);
+    int fetch_lookup_block(RuntimeState* state, LookupBlock* block, int64_t max_rows);
+    // 预取和上层dml会并发使用同一事务, 只有只读时才预取
+    bool can_prefetch_lookup(RuntimeState* state);
+    int get_next_by_index_lookup(RuntimeState* state, RowBatch* batch, bool* eos);
     int select_index(RuntimeState* state, const pb::PlanNode& node, std::vector<int>& multi_reverse_index); 
     int choose_index(RuntimeState* state);
 
 private:
     std::vector<int32_t> _field_ids;
     MemRowDescriptor* _mem_row_desc;
+    // 索引条件下推时复用的行
+    std::unique_ptr<MemRow> _index_row;
     FetcherNode* _related_fetcher_node = NULL;
     SchemaFactory* _factory = nullptr;
     int64_t _index_id = -1;
@@ -114,6 +174,25 @@ private:
     MutilReverseIndex<CommonSchema> _m_index;
     std::map<int64_t, pb::RegionInfo> _region_infos;
     std::map<int32_t, int32_t> _index_slot_field_map;
+
+    std::unique_ptr<LookupBlock> _lookup_block;
+    std::unique_ptr<LookupBlock> _prefetch_block;
+    size_t _lookup_pos = 0;
+    bool _lookup_prefetching = false;
+    bool _lookup_prefetch_enabled = false;
+    BthreadCond _lookup_cond;
+
+    bool _parallel_checked = false;
+    bool _parallel_scan = false;
+    bool _scan_stopped = false;
+    std::vector<std::unique_ptr<SubRangeScan>> _sub_scans;
+    // 有序合并时当前输出的子区间
+    size_t _sub_scan_idx = 0;
+    const rocksdb::Snapshot* _snapshot = nullptr;
+    BthreadCond _scan_worker_cond;
+    // 保护_sub_scans的队列, worker和get_next共用一个cond
+    bthread_mutex_t _scan_mutex;
+    bthread_cond_t _scan_cond;
 };
 }
 
@@ -21,6 +21,7 @@
 #include "proto/expr.pb.h"
 
 namespace baikaldb {
+class ColumnBatch;
 class ExprNode {
 public:
     ExprNode() : _is_constant(true) {}
@@ -77,6 +78,9 @@ public:
     virtual ExprValue get_value(MemRow* row) { //对每行计算表达式
         return ExprValue::Null();
     } 
+    //对列存batch批量计算, selection中只保留结果为true的行
+    //默认逐行调用get_value, 子类可以针对定长列做批量实现
+    virtual void filter_batch(const ColumnBatch* batch, std::vector<uint32_t>* selection);
     //释放open创建的资源
     virtual void close() {
         for (auto e : _children) {
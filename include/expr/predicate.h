@@ -34,6 +34,13 @@ public:
 
 class AndPredicate : public ScalarFnCall {
 public:
+    // between会被改写成(>= and <=), 两个条件依次收缩selection即可
+    virtual void filter_batch(const ColumnBatch* batch, std::vector<uint32_t>* selection) {
+        _children[0]->filter_batch(batch, selection);
+        if (!selection->empty()) {
+            _children[1]->filter_batch(batch, selection);
+        }
+    }
     virtual ExprValue get_value(MemRow* row) {
         ExprValue val1 = _children[0]->get_value(row);
         if (!val1.is_null() && val1.get_numberic<bool>() == false) { // short-circuit
@@ -121,12 +128,17 @@ public:
     virtual int open();
     virtual int type_inferer();
     virtual ExprValue get_value(MemRow* row);
+    virtual void filter_batch(const ColumnBatch* batch, std::vector<uint32_t>* selection);
 
 private:
     MapType _map_type;
     std::set<int64_t> _int_set;
     std::set<double> _double_set;
     std::set<std::string> _str_set;
+    // 有序数组, 批量计算时使用
+    std::vector<int64_t> _int_values;
+    std::vector<double> _double_values;
+    std::vector<uint8_t> _mask;
     bool _has_in_null;
 };
 
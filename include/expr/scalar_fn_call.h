@@ -25,6 +25,7 @@ public:
     virtual int type_inferer();
     virtual int open();
     virtual ExprValue get_value(MemRow* row);
+    virtual void filter_batch(const ColumnBatch* batch, std::vector<uint32_t>* selection);
     pb::Function fn() {
         return _fn;
     }
@@ -33,8 +34,12 @@ public:
         pb_node->mutable_fn()->CopyFrom(_fn);
     }
 private:
+    // slot和常量比较的批量实现, 不满足条件返回-1
+    int filter_batch_compare(const ColumnBatch* batch, std::vector<uint32_t>* selection);
+
     pb::Function _fn;
     std::function<ExprValue(const std::vector<ExprValue>&)> _fn_call;
+    std::vector<uint8_t> _mask;
 };
 }
 
@@ -0,0 +1,53 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace baikaldb {
+// 列存批量过滤用的计算kernel
+// 统一对[0, rows)整段计算, 结果按行写入mask(1满足, 0不满足), 再用selection挑出有效行
+// cpu支持avx2时走simd实现, 否则走标量实现, 结果一致
+enum CompareOp {
+    CMP_EQ,
+    CMP_NE,
+    CMP_GT,
+    CMP_GE,
+    CMP_LT,
+    CMP_LE
+};
+
+// value op data[i] 转成 data[i] op' value
+CompareOp reverse_compare_op(CompareOp op);
+
+bool cpu_support_avx2();
+
+// data[i] op value, 有符号比较
+void compare_int64(const int64_t* data, size_t rows, CompareOp op, int64_t value, uint8_t* mask);
+// data[i] op value, data按uint64解释
+void compare_uint64(const int64_t* data, size_t rows, CompareOp op, uint64_t value, uint8_t* mask);
+void compare_double(const double* data, size_t rows, CompareOp op, double value, uint8_t* mask);
+// values需要有序且去重
+void in_int64(const int64_t* data, size_t rows, const std::vector<int64_t>& values, uint8_t* mask);
+void in_double(const double* data, size_t rows, const std::vector<double>& values, uint8_t* mask);
+
+// 保留selection中mask为1且不为null的行, null_flags为空则不检查null
+void select_by_mask(const uint8_t* mask, const uint8_t* null_flags,
+        std::vector<uint32_t>* selection);
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
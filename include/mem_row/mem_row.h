@@ -23,6 +23,7 @@ using google::protobuf::FieldDescriptor;
 
 namespace baikaldb {
 class MemRowDescriptor;
+class ColumnBatch;
 //internal memory row meta-data for a query
 class MemRow final {
 friend MemRowDescriptor;
@@ -37,6 +38,13 @@ public:
         }
     }
 
+    // 绑定到列存batch的某一行, 作为只读视图参与表达式计算, 不持有数据
+    // 视图行只能get_value, 不能set_value, 也不能move到其他batch
+    void bind_column_row(const ColumnBatch* batch, size_t row_idx) {
+        _column_batch = batch;
+        _column_row = row_idx;
+    }
+
     void set_tuple(int32_t tuple_id, MemRowDescriptor* desc);
     void from_string(int32_t tuple_id, const std::string& in) {
         if (_tuples[tuple_id] != nullptr && in.size() > 0) {
@@ -45,11 +53,23 @@ public:
     }
 
     void to_string(int32_t tuple_id, std::string* out);
+    // 估算占用的内存, pb对象本身的开销按每个tuple固定值算
+    size_t used_size() {
+        size_t size = sizeof(MemRow);
+        for (auto t : _tuples) {
+            if (t != nullptr) {
+                size += t->ByteSize() + TUPLE_OVERHEAD;
+            }
+        }
+        return size;
+    }
     std::string debug_string(int32_t tuple_id);
 
     void clear() {
         for (auto& t : _tuples) {
-            t->Clear();
+            if (t != nullptr) {
+                t->Clear();
+            }
         }
     }
 
@@ -75,7 +95,10 @@ public:
     //    }
     //}
 private:
+    static const size_t TUPLE_OVERHEAD = 64;
     std::vector<google::protobuf::Message*> _tuples;
+    const ColumnBatch* _column_batch = nullptr;
+    size_t _column_row = 0;
 };
 }
 
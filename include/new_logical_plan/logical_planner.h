@@ -72,6 +72,10 @@ public:
     virtual int plan() = 0;
 
     static int analyze(QueryContext* ctx);
+
+    // 按client当前事务状态设置autocommit, 2pc下的dml分配txn_id
+    // 复用缓存计划时计划生成阶段被跳过, 需要单独调用
+    static void set_txn_state(QueryContext* ctx);
    
     static std::map<parser::JoinType, pb::JoinType> join_type_mapping;
 
@@ -217,6 +221,8 @@ private:
             pb::Expr& expr,
             pb::ExprNodeType type);
 
+    static uint64_t gen_txn_id(NetworkSocket* client);
+
     static std::atomic<uint64_t> _txn_id_counter;
 
 protected:
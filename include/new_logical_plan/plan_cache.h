@@ -0,0 +1,74 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Brief:  逻辑计划模板与按归一化sql缓存的plan cache
+#pragma once
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <bvar/bvar.h>
+#include "lru_cache.h"
+#include "query_context.h"
+#include "proto/plan.pb.h"
+
+namespace baikaldb {
+// 带?占位符的sql生成的逻辑计划, 占位符为PLACE_HOLDER_LITERAL
+// prepare语句和plan cache共用
+struct PlanTemplate {
+    std::shared_ptr<QueryContext> ctx;
+    std::map<int64_t, int64_t> table_versions;  // 生成时各表的schema版本
+    int64_t user_version = 0;                   // 生成时用户权限的版本
+
+    // 用ctx的用户,db和charset分析sql, 返回-1表示sql有错, 错误信息写到ctx->stat_info
+    // 占位符没有全部出现在plan中(如被当作别名)时返回0, *tmpl为空
+    static int create(const std::string& sql, int num_params, QueryContext* ctx,
+            std::shared_ptr<PlanTemplate>* tmpl);
+    // 表结构或用户权限变更后模板失效
+    bool is_valid(const QueryContext* ctx) const;
+    // 用参数替换占位符, 生成ctx的plan和tuple_descs, 恢复stat_info.family, ctx跳过LogicalPlanner
+    void bind(const std::vector<pb::ExprNode>& params, QueryContext* ctx) const;
+
+    static void visit_place_holders(google::protobuf::Message* message,
+            const std::function<void(pb::ExprNode*)>& fn);
+};
+
+// COM_QUERY的plan cache: sql中的常量替换成?作为key, value为逻辑计划模板
+// 命中时跳过sql解析和LogicalPlanner, 只用新的常量绑定模板
+class PlanCache {
+public:
+    static PlanCache* get_instance() {
+        static PlanCache _instance;
+        return &_instance;
+    }
+    // 代替LogicalPlanner::analyze, 先查cache, 未命中时生成模板并加入cache
+    int analyze(QueryContext* ctx);
+
+    // 把select/update/delete中的数字和字符串常量替换为?, 常量按顺序转成literal ExprNode
+    // select列表和limit中的常量保留(影响列名和语法), 不能处理的sql返回false
+    static bool normalize(const std::string& sql, std::string* normalized,
+            std::vector<pb::ExprNode>* params);
+
+private:
+    PlanCache();
+
+    // 不能模板化的sql对应的value为空, 避免重复尝试
+    Cache<std::string, std::shared_ptr<PlanTemplate>> _cache;
+    bvar::Adder<int64_t> _hit_count;
+    bvar::Adder<int64_t> _miss_count;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
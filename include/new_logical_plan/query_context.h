@@ -182,6 +182,13 @@ public:
     std::map<int64_t, std::vector<SmartRecord>> insert_region_ids;
     bool                has_recommend = false;
 
+    // COM_STMT_EXECUTE/CLOSE/RESET的包体(不含command字节)
+    std::string         stmt_packet;
+    // 由逻辑计划模板绑定参数得到plan(prepare语句或plan cache命中), 跳过LogicalPlanner
+    bool                is_prepared_plan = false;
+    // 没有计划模板的prepare语句(如insert)的参数, 生成计划时按占位符id绑定
+    std::vector<pb::ExprNode> stmt_params;
+
     bool                succ_after_logical_plan = false;
     bool                succ_after_physical_plan = false;
     bool                return_empty = false;
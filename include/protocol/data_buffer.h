@@ -14,6 +14,8 @@
 
 #pragma once
 #include <memory>
+#include <deque>
+#include <vector>
 #include "common.h"
 #include "expr_value.h"
 
@@ -21,6 +23,14 @@ namespace baikaldb {
 
 const uint32_t MAX_ALLOC_BUF_SIZE = (1024 * 1024 * 1024);
 const uint32_t DFT_ALLOC_BUF_SIZE = (1024 * 1024);
+const uint32_t MAX_FREE_SEGMENT_NUM = 2;
+
+// 已经打包完成的一段数据, 发送前不再修改
+struct BufferSegment {
+    uint8_t*    data = nullptr;
+    size_t      size = 0;
+    size_t      capacity = 0;
+};
 
 class DataBuffer {
 public:
@@ -35,11 +45,29 @@ public:
     bool network_queue_send_append(const uint8_t* data, int len, 
                                     uint8_t packet_id, int append_data_later);
     void byte_array_clear();
+    // 当前段超过threshold时封存, 之后的数据写到新段, 大结果集不再realloc拷贝已打包的数据
+    // 包头长度会回填到当前段, 只能在包的边界调用
+    bool byte_array_seal(size_t threshold);
+    // 封存段和当前段中待发送的总长度
+    size_t total_size() const {
+        return _sealed_size + _size;
+    }
+    // 用writev从封存段开始发送, 最多max_len字节, 当前段从*offset开始, 已发送部分累加到*offset
+    // 发送完的封存段回收复用, 返回write的结果
+    ssize_t byte_array_writev(int fd, int* offset, size_t max_len);
 
 public:
     uint8_t*        _data = 0;
     size_t          _size = 0;
     size_t          _capacity = 0;
+
+private:
+    void recycle_segment(const BufferSegment& segment);
+
+    std::deque<BufferSegment>   _sealed;
+    size_t                      _sealed_size = 0;   // 封存段中未发送的长度
+    size_t                      _sealed_offset = 0; // 第一个封存段已发送的长度
+    std::vector<BufferSegment>  _free_segments;
 }; 
 
 typedef std::shared_ptr<DataBuffer> SmartBuffer;
@@ -124,6 +124,8 @@ public:
 
     int real_read(SmartSocket sock, int we_want, int* ret_read_len);
     int real_write(SmartSocket sock);
+    // 在执行query的bthread中写出send_buf的全部数据, fd不可写时挂起等待, 超时返回RET_ERROR
+    int flush_write(NetworkSocket* sock, int64_t timeout_ms);
 
     bool is_shutdown_command(uint8_t command);
 
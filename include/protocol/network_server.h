@@ -26,6 +26,15 @@
 #include "meta_server_interact.hpp"
 
 namespace baikaldb {
+// 每个reactor有独立的listen socket(SO_REUSEPORT)和epoll, 由内核把新连接分到各reactor
+// 连接的后续事件只在accept它的reactor中处理
+struct Reactor {
+    SmartSocket     service = nullptr;      // Server socket.
+    EpollInfo*      epoll_info = nullptr;   // Epoll info and fd mapping.
+    pthread_t       tid = 0;
+    int             ret = 0;                // event_loop的返回值
+};
+
 class NetworkServer {
 public:
     virtual ~NetworkServer();
@@ -58,6 +67,9 @@ public:
     boost::asio::io_service* get_io_service() {
         return &_ios;
     }
+
+    // reactor的事件循环, 直到shutdown
+    int event_loop(Reactor* reactor);
     
     static uint8_t transaction_prefix;
 
@@ -67,7 +79,10 @@ private:
     NetworkServer& operator=(const NetworkServer& other);
 
     bool set_fd_flags(int fd);
-    SmartSocket create_listen_socket();
+    SmartSocket create_listen_socket(bool reuse_port);
+    // reactor退出后关闭它的listen socket, 内核不再把新连接分给它
+    void close_listen_socket(Reactor* reactor);
+    void connection_timeout_check(EpollInfo* epoll_info);
     int make_worker_process();
     void construct_heart_beat_request(pb::BaikalHeartBeatRequest& request);
     void process_heart_beat_response(const pb::BaikalHeartBeatResponse& response);
@@ -85,8 +100,7 @@ private:
     bool            _is_init = false;   // Flag of initialization status.
     bool            _shutdown = false;  // Flag of graceful shutdown.
     // Socket info.
-    SmartSocket     _service = nullptr;  // Server socket.
-    EpollInfo*      _epoll_info = nullptr;      // Epoll info and fd mapping.
+    std::vector<Reactor> _reactors;
     
     RocksWrapper*   _meta_db = nullptr;
     rocksdb::ColumnFamilyHandle* _meta_handle = nullptr;
@@ -152,6 +152,15 @@ private:
     bool _handle_client_query_template(SmartSocket client,
         const std::string& field_name, int32_t data_type, const std::string& value);
 
+    // prepared statements
+    bool _handle_client_stmt_prepare(SmartSocket client);
+    bool _handle_client_stmt_execute(SmartSocket client);
+    // COM_STMT_CLOSE和COM_STMT_RESET
+    bool _handle_client_stmt_close(SmartSocket client);
+    // 解析COM_STMT_EXECUTE中的参数, 每个参数转成一个literal ExprNode
+    int _parse_stmt_params(SmartSocket client, PreparedStmt* stmt,
+        std::vector<pb::ExprNode>* params);
+
     //int _make_common_resultset_packet(SmartSocket sock, SmartTable table);
     //int _make_common_resultset_packet(SmartSocket sock, SmartResultSet result_set);
     int _make_common_resultset_packet(SmartSocket sock,
@@ -0,0 +1,56 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <vector>
+#include <bthread/execution_queue.h>
+#include "rocks_wrapper.h"
+#include "common.h"
+
+namespace baikaldb {
+// 多个region的raft log写合并成一个WriteBatch, 减少rocksdb写wal和排队的次数
+// 调用方提交后等待, 由execution_queue的消费者统一写入后逐个唤醒
+class LogGroupWriter {
+public:
+    typedef std::vector<std::pair<rocksdb::SliceParts, rocksdb::SliceParts>> KVVec;
+    static LogGroupWriter* get_instance() {
+        static LogGroupWriter _instance;
+        return &_instance;
+    }
+    int init();
+    // kv_vec中的内存在返回前必须有效, 返回写rocksdb的结果
+    rocksdb::Status write(RocksWrapper* db, rocksdb::ColumnFamilyHandle* handle,
+            const KVVec& kv_vec);
+
+private:
+    struct WriteTask {
+        RocksWrapper* db;
+        rocksdb::ColumnFamilyHandle* handle;
+        const KVVec* kv_vec;
+        rocksdb::Status* status;
+        BthreadCond* cond;
+    };
+    LogGroupWriter() {}
+    static int group_write(void* meta, bthread::TaskIterator<WriteTask>& iter);
+    static void flush(RocksWrapper* db, rocksdb::WriteBatch* batch,
+            std::vector<WriteTask>* tasks);
+
+private:
+    bool _is_init = false;
+    bthread::ExecutionQueueId<WriteTask> _queue_id = {0};
+};
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -19,6 +19,8 @@
 #include <atomic>
 #include <string>
 #include <map>
+#include <deque>
+#include <list>
 #include <key_encoder.h>
 #include <rocks_wrapper.h>
 #include <bthread/mutex.h>
@@ -73,6 +75,7 @@ public:
     ~MyRaftLogStorage();
     MyRaftLogStorage():_db(NULL), _handle(NULL) {
         bthread_mutex_init(&_mutex, NULL);
+        bthread_mutex_init(&_cache_mutex, NULL);
     }
     // init logstorage, check consistency and integrity
     int init(braft::ConfigurationManager* configuration_manager) override;
@@ -143,6 +146,18 @@ private:
                              int64_t& region_id, 
                              int64_t& index);
 
+    // 最近append的log缓存在内存, get_entry命中时直接返回, 不读rocksdb
+    void _cache_append(const std::vector<braft::LogEntry*>& entries);
+    braft::LogEntry* _cache_get(int64_t index);
+    void _cache_truncate_prefix(int64_t first_index_kept);
+    void _cache_truncate_suffix(int64_t last_index_kept);
+    void _cache_pop_front();
+    // 所有region的缓存按最近访问排成LRU, 超过全局上限时从最久没访问的region淘汰
+    // 先加全局锁再加region的_cache_mutex, 持有_cache_mutex时不能调用
+    void _lru_touch();
+    void _lru_remove();
+    static void _cache_evict_global();
+
     std::atomic<int64_t> _first_log_index;   
     std::atomic<int64_t> _last_log_index;
     int64_t _region_id; 
@@ -152,6 +167,14 @@ private:
 
     IndexTermMap _term_map;
     bthread_mutex_t _mutex; // for term_map     
+
+    // 连续的log entry, 第一条的index为_cache_first_index
+    std::deque<braft::LogEntry*> _entry_cache;
+    int64_t _cache_first_index = 0;
+    bthread_mutex_t _cache_mutex;
+    // 在全局LRU中的位置, 由全局锁保护
+    bool _in_lru = false;
+    std::list<MyRaftLogStorage*>::iterator _lru_iter;
 }; // class 
 
 } //namespace raft
@@ -0,0 +1,355 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "expr_value.h"
+#include "mem_row.h"
+#include "proto/common.pb.h"
+
+namespace baikaldb {
+// 列的物理存储方式
+// 整型、bool和时间类型统一存成int64_t(uint64/datetime按位存放)
+// 浮点统一存成double, 字符串存放在连续buffer里用offset定位
+enum ColumnStorage {
+    CS_INT,
+    CS_DOUBLE,
+    CS_STRING
+};
+
+inline ColumnStorage column_storage(pb::PrimitiveType type) {
+    switch (type) {
+        case pb::FLOAT:
+        case pb::DOUBLE:
+            return CS_DOUBLE;
+        case pb::STRING:
+        case pb::HLL:
+            return CS_STRING;
+        default:
+            return CS_INT;
+    }
+}
+
+// 单列数据, 定长列可以直接按下标随机访问, 方便批量计算
+class ColumnVector {
+public:
+    ColumnVector() {}
+    void init(int32_t tuple_id, int32_t slot_id, pb::PrimitiveType type, size_t capacity) {
+        _tuple_id = tuple_id;
+        _slot_id = slot_id;
+        _type = type;
+        _storage = column_storage(type);
+        _null_flags.reserve(capacity);
+        switch (_storage) {
+            case CS_INT:
+                _ints.reserve(capacity);
+                break;
+            case CS_DOUBLE:
+                _doubles.reserve(capacity);
+                break;
+            case CS_STRING:
+                _offsets.reserve(capacity + 1);
+                _offsets.push_back(0);
+                break;
+        }
+    }
+    int32_t tuple_id() const {
+        return _tuple_id;
+    }
+    int32_t slot_id() const {
+        return _slot_id;
+    }
+    pb::PrimitiveType type() const {
+        return _type;
+    }
+    ColumnStorage storage() const {
+        return _storage;
+    }
+    size_t size() const {
+        return _null_flags.size();
+    }
+    void clear() {
+        _null_flags.clear();
+        _ints.clear();
+        _doubles.clear();
+        _str_buf.clear();
+        _offsets.clear();
+        if (_storage == CS_STRING) {
+            _offsets.push_back(0);
+        }
+    }
+    bool is_null(size_t idx) const {
+        return _null_flags[idx] != 0;
+    }
+    // null标记每行一个字节, 便于批量计算时直接按字节mask
+    const uint8_t* null_flags() const {
+        return _null_flags.data();
+    }
+    const int64_t* int_data() const {
+        return _ints.data();
+    }
+    const double* double_data() const {
+        return _doubles.data();
+    }
+    const char* string_data(size_t idx, size_t* len) const {
+        *len = _offsets[idx + 1] - _offsets[idx];
+        return _str_buf.data() + _offsets[idx];
+    }
+    // 共size()+1个, 第i个字符串为str_buf()[offsets[i], offsets[i + 1])
+    const uint32_t* offsets() const {
+        return _offsets.data();
+    }
+    const std::string& str_buf() const {
+        return _str_buf;
+    }
+
+    // 以下批量追加n行, 返回新增部分的起始地址, 调用方直接把编码后的数据拷进来
+    uint8_t* extend_null_flags(size_t n) {
+        size_t old_size = _null_flags.size();
+        _null_flags.resize(old_size + n);
+        return _null_flags.data() + old_size;
+    }
+    // 定长列的n个值, 整型和浮点都是8字节
+    void* extend_fixed(size_t n) {
+        if (_storage == CS_DOUBLE) {
+            size_t old_size = _doubles.size();
+            _doubles.resize(old_size + n);
+            return _doubles.data() + old_size;
+        }
+        size_t old_size = _ints.size();
+        _ints.resize(old_size + n);
+        return _ints.data() + old_size;
+    }
+    // offsets共n+1个, 是编码buffer里的偏移, 返回字符串内容的写入位置
+    char* extend_strings(const uint32_t* offsets, size_t n) {
+        size_t base = _str_buf.size();
+        for (size_t i = 1; i <= n; i++) {
+            _offsets.push_back(base + offsets[i] - offsets[0]);
+        }
+        _str_buf.resize(base + offsets[n] - offsets[0]);
+        return &_str_buf[base];
+    }
+
+    void append_null() {
+        _null_flags.push_back(1);
+        switch (_storage) {
+            case CS_INT:
+                _ints.push_back(0);
+                break;
+            case CS_DOUBLE:
+                _doubles.push_back(0);
+                break;
+            case CS_STRING:
+                _offsets.push_back(_str_buf.size());
+                break;
+        }
+    }
+    void append_int(int64_t value) {
+        _null_flags.push_back(0);
+        _ints.push_back(value);
+    }
+    void append_double(double value) {
+        _null_flags.push_back(0);
+        _doubles.push_back(value);
+    }
+    void append_string(const char* data, size_t len) {
+        _null_flags.push_back(0);
+        _str_buf.append(data, len);
+        _offsets.push_back(_str_buf.size());
+    }
+    void append_value(const ExprValue& value) {
+        if (value.is_null()) {
+            append_null();
+            return;
+        }
+        if (value.type != _type) {
+            ExprValue tmp = value;
+            tmp.cast_to(_type);
+            append_not_null(tmp);
+            return;
+        }
+        append_not_null(value);
+    }
+
+    ExprValue get_value(size_t idx) const {
+        if (_null_flags[idx] != 0) {
+            return ExprValue::Null();
+        }
+        ExprValue value(_type);
+        switch (_type) {
+            case pb::BOOL:
+                value._u.bool_val = _ints[idx] != 0;
+                break;
+            case pb::INT8:
+                value._u.int8_val = _ints[idx];
+                break;
+            case pb::INT16:
+                value._u.int16_val = _ints[idx];
+                break;
+            case pb::INT32:
+            case pb::TIME:
+                value._u.int32_val = _ints[idx];
+                break;
+            case pb::INT64:
+                value._u.int64_val = _ints[idx];
+                break;
+            case pb::UINT8:
+                value._u.uint8_val = _ints[idx];
+                break;
+            case pb::UINT16:
+                value._u.uint16_val = _ints[idx];
+                break;
+            case pb::UINT32:
+            case pb::TIMESTAMP:
+            case pb::DATE:
+                value._u.uint32_val = _ints[idx];
+                break;
+            case pb::UINT64:
+            case pb::DATETIME:
+                value._u.uint64_val = _ints[idx];
+                break;
+            case pb::FLOAT:
+                value._u.float_val = _doubles[idx];
+                break;
+            case pb::DOUBLE:
+                value._u.double_val = _doubles[idx];
+                break;
+            case pb::STRING:
+            case pb::HLL:
+                value.str_val.assign(_str_buf.data() + _offsets[idx],
+                        _offsets[idx + 1] - _offsets[idx]);
+                break;
+            default:
+                return ExprValue::Null();
+        }
+        return value;
+    }
+
+private:
+    void append_not_null(const ExprValue& value) {
+        switch (_storage) {
+            case CS_INT:
+                append_int(value.get_numberic<int64_t>());
+                break;
+            case CS_DOUBLE:
+                append_double(value.get_numberic<double>());
+                break;
+            case CS_STRING:
+                append_string(value.str_val.data(), value.str_val.size());
+                break;
+        }
+    }
+
+private:
+    int32_t _tuple_id = 0;
+    int32_t _slot_id = 0;
+    pb::PrimitiveType _type = pb::NULL_TYPE;
+    ColumnStorage _storage = CS_INT;
+    std::vector<uint8_t> _null_flags;
+    std::vector<int64_t> _ints;
+    std::vector<double> _doubles;
+    std::string _str_buf;
+    std::vector<uint32_t> _offsets;
+};
+
+// 一个tuple的列存数据, 目前只由scan节点产出, 因此只包含一个tuple
+class ColumnBatch {
+public:
+    int init(const pb::TupleDescriptor& tuple_desc, size_t capacity) {
+        reset();
+        _tuple_id = tuple_desc.tuple_id();
+        _columns.resize(tuple_desc.slots_size());
+        for (int i = 0; i < tuple_desc.slots_size(); i++) {
+            const pb::SlotDescriptor& slot = tuple_desc.slots(i);
+            if (slot.slot_id() < 0) {
+                return -1;
+            }
+            if ((size_t)slot.slot_id() >= _slot_index.size()) {
+                _slot_index.resize(slot.slot_id() + 1, -1);
+            }
+            _slot_index[slot.slot_id()] = i;
+            _columns[i].init(_tuple_id, slot.slot_id(), slot.slot_type(), capacity);
+        }
+        return 0;
+    }
+    bool empty() const {
+        return _columns.empty();
+    }
+    int32_t tuple_id() const {
+        return _tuple_id;
+    }
+    size_t rows() const {
+        return _rows;
+    }
+    size_t columns_size() const {
+        return _columns.size();
+    }
+    ColumnVector& column(size_t idx) {
+        return _columns[idx];
+    }
+    const ColumnVector* get_column(int32_t tuple_id, int32_t slot_id) const {
+        if (tuple_id != _tuple_id || slot_id < 0 || (size_t)slot_id >= _slot_index.size()) {
+            return nullptr;
+        }
+        int idx = _slot_index[slot_id];
+        if (idx < 0) {
+            return nullptr;
+        }
+        return &_columns[idx];
+    }
+    ExprValue get_value(int32_t tuple_id, int32_t slot_id, size_t row_idx) const {
+        const ColumnVector* column = get_column(tuple_id, slot_id);
+        if (column == nullptr) {
+            return ExprValue::Null();
+        }
+        return column->get_value(row_idx);
+    }
+    // 每列都追加完一个值后调用
+    void add_row() {
+        ++_rows;
+    }
+    // 把某一行转成MemRow, 供还不支持列存的节点使用
+    int fill_mem_row(size_t row_idx, MemRow* row) const {
+        for (auto& column : _columns) {
+            if (column.is_null(row_idx)) {
+                continue;
+            }
+            int ret = row->set_value(_tuple_id, column.slot_id(), column.get_value(row_idx));
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+    void reset() {
+        _columns.clear();
+        _slot_index.clear();
+        _tuple_id = -1;
+        _rows = 0;
+    }
+
+private:
+    int32_t _tuple_id = -1;
+    size_t _rows = 0;
+    std::vector<ColumnVector> _columns;
+    // slot_id => _columns下标
+    std::vector<int> _slot_index;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
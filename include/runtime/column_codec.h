@@ -0,0 +1,87 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#ifdef BAIDU_INTERNAL
+#include <base/iobuf.h>
+#else
+#include <butil/iobuf.h>
+#endif
+#include "common.h"
+#include "column_batch.h"
+#include "mem_row_descriptor.h"
+#include "row_batch.h"
+
+namespace baikaldb {
+// store返回select结果的列存编码, 放在rpc attachment里, 代替StoreRes.row_values
+// 格式: [行数][列数][每列: tuple_id, slot_id, type, 每行1字节null标记, 数据]
+// 数据部分: 整型和浮点每行8字节; 字符串为行数+1个uint32偏移, 再跟所有字符串内容
+class ColumnEncoder {
+public:
+    // 每个tuple的每个slot编码成一列
+    void init(const std::vector<pb::TupleDescriptor>& tuple_descs);
+    void add_row(MemRow* row);
+    size_t rows() const {
+        return _rows;
+    }
+    void serialize(butil::IOBuf* buf) const;
+
+private:
+    size_t _rows = 0;
+    std::vector<ColumnVector> _columns;
+};
+
+// frontend解析列存编码, 引用attachment的IOBuf block, 各列只记录在buffer中的位置,
+// 按需把一段行从block直接拷贝到batch的列里
+class ColumnDecoder {
+public:
+    int init(const butil::IOBuf& buf);
+    size_t rows() const {
+        return _rows;
+    }
+    // 所有列属于同一个tuple时返回该tuple_id, 否则返回-1
+    int32_t single_tuple_id() const;
+    // 把[start, start + n)行转成MemRow追加到batch
+    int decode_rows(MemRowDescriptor* desc, size_t start, size_t n, RowBatch* batch);
+    // 把[start, start + n)行按列追加到batch, batch需要已经init_columns
+    int decode_columns(size_t start, size_t n, RowBatch* batch);
+
+private:
+    struct ColumnPos {
+        int32_t tuple_id;
+        int32_t slot_id;
+        pb::PrimitiveType type;
+        size_t null_pos;
+        size_t data_pos;
+        // 字符串内容的起始位置
+        size_t str_pos;
+    };
+    void append_column(const ColumnPos& pos, size_t start, size_t n, ColumnVector* column);
+    bool read_uint32(size_t pos, uint32_t* value) const {
+        return _buf.copy_to(value, sizeof(*value), pos) == sizeof(*value);
+    }
+
+private:
+    butil::IOBuf _buf;
+    // 字符串列的offsets拷到这里再转成列内的偏移
+    std::vector<uint32_t> _offsets;
+    size_t _rows = 0;
+    std::vector<ColumnPos> _columns;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
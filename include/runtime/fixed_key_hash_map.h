@@ -0,0 +1,183 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace baikaldb {
+// 定长key的开放寻址hash表(线性探测), 用于分组列都是数值类型的聚合
+// key由key_words个uint64组成, 连续存放在_keys里, 不需要每个key单独分配内存
+// 每个槽位保存key的hash, 探测时先比hash再比key, 扩容时不用重新计算hash
+template <typename T>
+class FixedKeyHashMap {
+public:
+    void init(size_t key_words, size_t capacity = 1024) {
+        _key_words = key_words;
+        _size = 0;
+        size_t cap = 16;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        alloc(cap);
+    }
+
+    // 清空数据, 保留已分配的容量
+    void clear() {
+        _used.assign(_capacity, 0);
+        _size = 0;
+    }
+
+    static uint64_t hash(const uint64_t* key, size_t key_words) {
+        uint64_t h = key_words;
+        for (size_t i = 0; i < key_words; i++) {
+            h ^= mix(key[i]);
+            h *= 0x9E3779B97F4A7C15ULL;
+        }
+        return mix(h);
+    }
+
+    // 找到key对应的value, 不存在时插入一个T()并置*inserted=true
+    // 返回的指针在下次插入前有效
+    T* seek_or_insert(const uint64_t* key, bool* inserted) {
+        return seek_or_insert(key, hash(key, _key_words), inserted);
+    }
+    // h必须是hash(key, key_words())的结果
+    T* seek_or_insert(const uint64_t* key, uint64_t h, bool* inserted) {
+        if ((_size + 1) * 2 > _capacity) {
+            resize(_capacity * 2);
+        }
+        size_t pos = h & (_capacity - 1);
+        while (_used[pos]) {
+            if (_hashes[pos] == h && key_equal(pos, key)) {
+                *inserted = false;
+                return &_values[pos];
+            }
+            pos = (pos + 1) & (_capacity - 1);
+        }
+        _used[pos] = 1;
+        _hashes[pos] = h;
+        memcpy(&_keys[pos * _key_words], key, _key_words * sizeof(uint64_t));
+        _values[pos] = T();
+        ++_size;
+        *inserted = true;
+        return &_values[pos];
+    }
+
+    T* seek(const uint64_t* key) {
+        return seek(key, hash(key, _key_words));
+    }
+    T* seek(const uint64_t* key, uint64_t h) {
+        size_t pos = h & (_capacity - 1);
+        while (_used[pos]) {
+            if (_hashes[pos] == h && key_equal(pos, key)) {
+                return &_values[pos];
+            }
+            pos = (pos + 1) & (_capacity - 1);
+        }
+        return nullptr;
+    }
+
+    // 按槽位遍历, 返回pos及之后第一个有数据的槽位, 没有则返回capacity()
+    size_t next_used(size_t pos) const {
+        while (pos < _capacity && !_used[pos]) {
+            ++pos;
+        }
+        return pos;
+    }
+    T& value_at(size_t pos) {
+        return _values[pos];
+    }
+    const uint64_t* key_at(size_t pos) const {
+        return &_keys[pos * _key_words];
+    }
+
+    size_t size() const {
+        return _size;
+    }
+    size_t capacity() const {
+        return _capacity;
+    }
+    size_t key_words() const {
+        return _key_words;
+    }
+
+private:
+    static uint64_t mix(uint64_t k) {
+        // murmurhash3 fmix64
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+    bool key_equal(size_t pos, const uint64_t* key) const {
+        const uint64_t* slot_key = &_keys[pos * _key_words];
+        for (size_t i = 0; i < _key_words; i++) {
+            if (slot_key[i] != key[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    void alloc(size_t capacity) {
+        _capacity = capacity;
+        _used.assign(capacity, 0);
+        _hashes.assign(capacity, 0);
+        _keys.assign(capacity * _key_words, 0);
+        _values.clear();
+        _values.resize(capacity);
+    }
+    void resize(size_t capacity) {
+        std::vector<uint8_t> used;
+        std::vector<uint64_t> hashes;
+        std::vector<uint64_t> keys;
+        std::vector<T> values;
+        used.swap(_used);
+        hashes.swap(_hashes);
+        keys.swap(_keys);
+        values.swap(_values);
+        size_t old_capacity = _capacity;
+        alloc(capacity);
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (!used[i]) {
+                continue;
+            }
+            size_t pos = hashes[i] & (_capacity - 1);
+            while (_used[pos]) {
+                pos = (pos + 1) & (_capacity - 1);
+            }
+            _used[pos] = 1;
+            _hashes[pos] = hashes[i];
+            memcpy(&_keys[pos * _key_words], &keys[i * _key_words],
+                    _key_words * sizeof(uint64_t));
+            _values[pos] = std::move(values[i]);
+        }
+    }
+
+private:
+    size_t _key_words = 1;
+    size_t _capacity = 0;
+    size_t _size = 0;
+    std::vector<uint8_t> _used;
+    std::vector<uint64_t> _hashes;
+    std::vector<uint64_t> _keys;
+    std::vector<T> _values;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
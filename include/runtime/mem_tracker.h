@@ -0,0 +1,51 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+namespace baikaldb {
+// 一个query的内存预算, 所有算子(包括子RuntimeState里的)共用一个
+// 算子按实际持有的行记账, 释放或落盘后归还
+class MemTracker {
+public:
+    // limit<=0表示不限制
+    explicit MemTracker(int64_t limit) : _limit(limit), _used(0) {}
+    void consume(int64_t bytes) {
+        _used.fetch_add(bytes);
+    }
+    void release(int64_t bytes) {
+        _used.fetch_sub(bytes);
+    }
+    int64_t used() const {
+        return _used.load();
+    }
+    int64_t limit() const {
+        return _limit;
+    }
+    bool exceeded() const {
+        return _limit > 0 && _used.load() > _limit;
+    }
+
+private:
+    int64_t _limit;
+    std::atomic<int64_t> _used;
+};
+typedef std::shared_ptr<MemTracker> SmartMemTracker;
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -18,9 +18,15 @@
 #include <vector>
 #include <memory>
 #include "mem_row_compare.h"
+#include "mem_row_descriptor.h"
+#include "column_batch.h"
 
 namespace baikaldb {
 const size_t ROW_BATCH_CAPACITY = 1024;
+// RowBatch有行存和列存两种模式
+// 行存: 数据在_rows里, 每行一个MemRow
+// 列存: 数据在_columns里, _selection记录有效行的下标, 过滤只修改_selection
+// consumer通过set_allow_columnar声明可以处理列存, producer据此决定输出格式
 class RowBatch {
 public:
     RowBatch() : _idx(0) {
@@ -33,6 +39,9 @@ public:
         return _capacity;
     }
     size_t size() {
+        if (is_columnar()) {
+            return _selection.size();
+        }
         return _rows.size();
     }
     void reset() {
@@ -40,9 +49,14 @@ public:
     }
     void clear() {
         _rows.clear();
+        _columns.reset();
+        _selection.clear();
         _idx = 0;
     }
     bool is_full() {
+        if (is_columnar()) {
+            return _columns.rows() >= _capacity;
+        }
         return size() >= _capacity;
     }
     bool is_traverse_over() {
@@ -52,6 +66,15 @@ public:
         if (num_skip_rows <= 0) {
             return;
         }
+        if (is_columnar()) {
+            if (num_skip_rows >= (int)size()) {
+                _selection.clear();
+            } else {
+                _selection.erase(_selection.begin(), _selection.begin() + num_skip_rows);
+            }
+            _idx = 0;
+            return;
+        }
         if (num_skip_rows >= (int)size()) {
             _rows.clear();
             return;
@@ -69,6 +92,11 @@ public:
         }
         if (num_keep_rows <= 0) {
             _rows.clear();
+            _selection.clear();
+            return;
+        }
+        if (is_columnar()) {
+            _selection.resize(num_keep_rows);
             return;
         }
         _rows.resize(num_keep_rows);
@@ -77,6 +105,7 @@ public:
     void move_row(std::unique_ptr<MemRow> row) {
         _rows.push_back(std::move(row));
     }
+    //列存模式下不能调用, 需要先materialize或用column_row
     std::unique_ptr<MemRow>& get_row() {
         return _rows[_idx];
     }
@@ -89,6 +118,61 @@ public:
     }
     void swap(RowBatch& batch) {
         _rows.swap(batch._rows);
+        std::swap(_columns, batch._columns);
+        _selection.swap(batch._selection);
+    }
+
+    void set_allow_columnar(bool allow_columnar) {
+        _allow_columnar = allow_columnar;
+    }
+    bool allow_columnar() {
+        return _allow_columnar;
+    }
+    bool is_columnar() {
+        return !_columns.empty();
+    }
+    // 只能在batch为空时调用, 之后producer往列里追加数据
+    int init_columns(const pb::TupleDescriptor& tuple_desc) {
+        _rows.clear();
+        _selection.clear();
+        _selection.reserve(_capacity);
+        _idx = 0;
+        return _columns.init(tuple_desc, _capacity);
+    }
+    ColumnBatch* mutable_columns() {
+        return &_columns;
+    }
+    // 所有列追加完一行后调用, 新行默认有效
+    void add_column_row() {
+        _selection.push_back(_columns.rows());
+        _columns.add_row();
+    }
+    std::vector<uint32_t>* mutable_selection() {
+        return &_selection;
+    }
+    // 当前遍历行在列中的下标
+    size_t column_row() {
+        return _selection[_idx];
+    }
+    // 把_selection里的行转成MemRow, batch切回行存模式
+    int materialize(MemRowDescriptor* desc) {
+        if (!is_columnar()) {
+            return 0;
+        }
+        std::vector<std::unique_ptr<MemRow> > rows;
+        rows.reserve(_selection.size());
+        for (auto row_idx : _selection) {
+            std::unique_ptr<MemRow> row = desc->fetch_mem_row();
+            if (_columns.fill_mem_row(row_idx, row.get()) < 0) {
+                return -1;
+            }
+            rows.push_back(std::move(row));
+        }
+        _rows.swap(rows);
+        _columns.reset();
+        _selection.clear();
+        _idx = 0;
+        return 0;
     }
 
 private:
@@ -98,6 +182,9 @@ private:
     std::vector<std::unique_ptr<MemRow> > _rows;
     size_t _idx;
     size_t _capacity = ROW_BATCH_CAPACITY;
+    bool _allow_columnar = false;
+    ColumnBatch _columns;
+    std::vector<uint32_t> _selection;
 };
 }
 
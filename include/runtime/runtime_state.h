@@ -23,6 +23,7 @@
 #include "reverse_index.h"
 #include "reverse_interface.h"
 #include "row_batch.h"
+#include "mem_tracker.h"
 #include "mysql_err_code.h"
 //#include "region_resource.h"
 
@@ -64,6 +65,9 @@ public:
     // for prepared txn recovery in BaikalDB
     int init(const pb::CachePlan& commit_plan);
 
+    // baikaldb并发执行同一query的子计划时用, 和state共用mem_row_desc, 产生的行可以互相拷贝
+    void init_sub_state(RuntimeState* state);
+
     void set_reverse_index_map(const std::map<int64_t, ReverseIndexBase*>& reverse_index_map) {
         _reverse_index_map = reverse_index_map;
     }
@@ -94,6 +98,9 @@ public:
         return _tuple_descs;
     }
     MemRowDescriptor* mem_row_desc() {
+        if (_shared_mem_row_desc != nullptr) {
+            return _shared_mem_row_desc;
+        }
         return &_mem_row_desc;
     }
     int64_t region_id() {
@@ -167,6 +174,19 @@ public:
         return _log_id;
     }
 
+    // 单个query所有算子共用的内存上限(字节), 0表示不限制, 超过后排序和join落盘, 聚合报错
+    int64_t memory_limit() const {
+        return _mem_tracker->limit();
+    }
+
+    void set_memory_limit(int64_t limit) {
+        _mem_tracker = std::make_shared<MemTracker>(limit);
+    }
+
+    const SmartMemTracker& mem_tracker() const {
+        return _mem_tracker;
+    }
+
     size_t multiple_row_batch_capacity() {
         if (_row_batch_capacity * _multiple < ROW_BATCH_CAPACITY) {
             //两倍扩散
@@ -226,6 +246,23 @@ public:
         return _optimize_1pc;
     }
 
+    void set_binary_protocol(bool binary_protocol) {
+        _binary_protocol = binary_protocol;
+    }
+
+    bool binary_protocol() {
+        return _binary_protocol;
+    }
+
+    void set_result_flushed() {
+        _result_flushed = true;
+    }
+
+    // 部分结果已经发给客户端
+    bool result_flushed() {
+        return _result_flushed;
+    }
+
 public:
     uint64_t          txn_id = 0;
     int32_t           seq_id = 0;
@@ -236,6 +273,7 @@ private:
     bool _is_cancelled = false;
     std::vector<pb::TupleDescriptor> _tuple_descs;
     MemRowDescriptor _mem_row_desc;
+    MemRowDescriptor* _shared_mem_row_desc = nullptr; // used for baikaldb sub state
     int64_t          _region_id = 0;
     // index_id => ReverseIndex
     std::map<int64_t, ReverseIndexBase*> _reverse_index_map;
@@ -247,11 +285,15 @@ private:
     int _num_affected_rows = 0; //存储baikaldb写影响的行数
     int _num_returned_rows = 0; //存储baikaldb读返回的行数
     int64_t _log_id = 0;
+    // store端不限制, baikaldb端在init时按query_memory_limit创建, 子state共享
+    SmartMemTracker _mem_tracker = std::make_shared<MemTracker>(0);
 
     bool              _autocommit = true;     // used for baikaldb and store
     bool              _optimize_1pc = false;  // 2pc de-generates to 1pc when autocommit=true and
                                               // there is only 1 region.
     NetworkSocket*    _client_conn = nullptr; // used for baikaldb
+    bool              _binary_protocol = false; // used for baikaldb, COM_STMT_EXECUTE结果按binary行返回
+    bool              _result_flushed = false;  // used for baikaldb, 结果集流式发送
     TransactionPool*  _txn_pool = nullptr;    // used for store
     SmartTransaction  _txn = nullptr;         // used for store
     std::shared_ptr<RegionResource> _resource;// used for store
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#ifdef BAIDU_INTERNAL
+#include <baidu/rpc/controller.h>
+#include <baidu/rpc/stream.h>
+#else
+#include <brpc/controller.h>
+#include <brpc/stream.h>
+#endif
+#include "common.h"
+#include "proto/store.interface.pb.h"
+
+namespace baikaldb {
+DECLARE_int32(select_stream_idle_timeout_ms);
+
+// select结果按chunk通过brpc stream返回
+// store写满stream的缓冲后等frontend取走再写, frontend每个region只缓存少量chunk,
+// 两端的内存都有上限, frontend不读时store的执行也会停下来
+// 两端的等待都不超过select_stream_idle_timeout_ms, 超时后关闭stream
+// chunk格式: [StoreRes长度(4字节)][StoreRes][列存编码的attachment]
+
+// store端, 在rpc回包前accept, 回包后再写chunk
+class SelectStreamWriter {
+public:
+    SelectStreamWriter() {}
+    ~SelectStreamWriter() {
+        close();
+    }
+    int accept(brpc::Controller* cntl);
+    // 对端缓冲满时等待, stream关闭(如frontend提前结束)或等待超时返回-1
+    int write(const pb::StoreRes& res, const butil::IOBuf& attachment);
+    void close();
+
+private:
+    brpc::StreamId _stream_id = brpc::INVALID_STREAM_ID;
+    DISALLOW_COPY_AND_ASSIGN(SelectStreamWriter);
+};
+
+// frontend端, 发请求前create, 按顺序取chunk
+class SelectStreamReader {
+public:
+    SelectStreamReader() {}
+    ~SelectStreamReader() {
+        close();
+    }
+    int create(brpc::Controller* cntl);
+    // 取下一个chunk, 没有时等待; 读完最后一个chunk后*eos=true
+    // stream在最后一个chunk之前关闭, 等待超时或chunk带错误时返回-1
+    int next_chunk(pb::StoreRes* res, butil::IOBuf* attachment, bool* eos);
+    // 是否已经取到过chunk, 没取到过时失败可以整个region重试
+    bool received() const {
+        return _received;
+    }
+    // 关闭stream, 不等待on_closed, 接收状态在on_closed后释放
+    void close();
+
+private:
+    // 接收回调和读取之间共享的状态, 由自身持有一个引用直到on_closed
+    class Handler : public brpc::StreamInputHandler {
+    public:
+        Handler();
+        virtual ~Handler();
+        virtual int on_received_messages(brpc::StreamId id,
+                butil::IOBuf* const messages[], size_t size);
+        virtual void on_idle_timeout(brpc::StreamId id) {}
+        virtual void on_closed(brpc::StreamId id);
+
+        bthread_mutex_t mutex;
+        bthread_cond_t cond;
+        std::deque<butil::IOBuf> chunks;
+        bool closed = false;
+        // close后不再等待取走chunk, 收到的chunk直接丢弃
+        bool stopped = false;
+        // 等待超时, 已收到的chunk丢弃
+        bool timeout = false;
+        std::shared_ptr<Handler> self;
+    };
+
+    brpc::StreamId _stream_id = brpc::INVALID_STREAM_ID;
+    std::shared_ptr<Handler> _handler;
+    bool _eos = false;
+    bool _received = false;
+    DISALLOW_COPY_AND_ASSIGN(SelectStreamReader);
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
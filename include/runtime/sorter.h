@@ -15,29 +15,95 @@
 #pragma once
 
 #include <algorithm> 
+#include <functional>
+#include <map>
 #include <vector>
 #include "common.h"
 #include "row_batch.h"
 #include "mem_row_compare.h"
+#include "spill_file.h"
+#include "mem_tracker.h"
 
 namespace baikaldb {
+DECLARE_int64(sort_spill_min_run_bytes);
+
 //对每个batch并行的做sort后，再用heap做归并
+//设置内存上限后, 超限时把内存中的batch排好序写成一个有序文件(run),
+//最后内存中的batch和各个run一起用heap做归并, run每次只读一个batch到内存
 class Sorter {
 public:
     Sorter(MemRowCompare* comp) : _comp(comp), _idx(0) {
     }
-    void add_batch(std::shared_ptr<RowBatch>& batch) {
+    ~Sorter() {
+        if (_mem_tracker != nullptr) {
+            _mem_tracker->release(_mem_used);
+        }
+    }
+    int add_batch(std::shared_ptr<RowBatch>& batch) {
+        if (is_topn()) {
+            add_topn(batch.get());
+            return 0;
+        }
+        batch->reset();
+        _min_heap.push_back(batch);
+        if (need_spill()) {
+            int64_t bytes = 0;
+            for (; !batch->is_traverse_over(); batch->next()) {
+                bytes += batch->get_row()->used_size();
+            }
+            batch->reset();
+            _mem_used += bytes;
+            _mem_tracker->consume(bytes);
+            // 预算可能被其他算子占着, 自己缓存的数据够一个run才落盘, 避免产生大量小文件
+            if (_mem_tracker->exceeded() && _mem_used >= FLAGS_sort_spill_min_run_bytes) {
+                return spill();
+            }
+        }
+        return 0;
+    }
+    // 设置后只保留排序后的前limit行, 用有界堆实现, 内存O(limit)
+    void set_limit(int64_t limit) {
+        _limit = limit;
+    }
+    // 内存中的行记在query的内存预算上, 预算超限且缓存够sort_spill_min_run_bytes时落盘
+    void set_mem_tracker(const SmartMemTracker& mem_tracker, MemRowDescriptor* desc) {
+        _mem_tracker = mem_tracker;
+        _mem_row_desc = desc;
+    }
+    // 添加一个已经有序的batch, 归并时遍历完后调用refill继续填充, 填充后为空表示结束
+    // 用于边解析边归并各个region返回的有序结果, 调用merge_sort前添加
+    void add_sorted_stream(const std::shared_ptr<RowBatch>& batch,
+            const std::function<int(RowBatch*)>& refill) {
         batch->reset();
+        if (batch->size() == 0) {
+            return;
+        }
         _min_heap.push_back(batch);
+        _refill_batches[batch.get()] = refill;
     }
-    void sort();
+    int sort();
     void merge_sort();
     int get_next(RowBatch* batch, bool* eos);
 
     size_t batch_size() {
         return _min_heap.size();
     }
+    size_t spill_run_size() {
+        return _runs.size();
+    }
 private:
+    bool is_topn() {
+        return _limit > 0 && !_comp->need_not_compare();
+    }
+    bool need_spill() {
+        return _mem_tracker != nullptr && _mem_tracker->limit() > 0 && _mem_row_desc != nullptr
+            && !_comp->need_not_compare();
+    }
+    int spill();
+    // 从run中读下一个batch, 读完后返回的batch为空
+    int read_run(RowBatch* batch, SpillFile* run);
+    void add_topn(RowBatch* batch);
+    void sort_topn();
     void multi_sort();
     void make_heap();
     void shiftdown(size_t index);
@@ -46,6 +112,16 @@ private:
     MemRowCompare* _comp;
     std::vector<std::shared_ptr<RowBatch> > _min_heap;
     size_t _idx;
+    int64_t _limit = -1;
+    // top-n模式下的大顶堆, 堆顶是当前保留行中最大的一行
+    std::vector<std::unique_ptr<MemRow> > _topn_rows;
+    SmartMemTracker _mem_tracker;
+    // 本sorter内存中的行占用的字节数
+    int64_t _mem_used = 0;
+    MemRowDescriptor* _mem_row_desc = nullptr;
+    std::vector<std::shared_ptr<SpillFile> > _runs;
+    // 归并时堆里来自run或stream的batch, 遍历完后调用对应的refill继续读
+    std::map<RowBatch*, std::function<int(RowBatch*)>> _refill_batches;
 };
 }
 
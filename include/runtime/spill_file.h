@@ -0,0 +1,64 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include "common.h"
+#include "mem_row_descriptor.h"
+#include "mem_row.h"
+#include "row_batch.h"
+
+namespace baikaldb {
+// 内存超限时落盘的临时文件, 先顺序写完所有行, 再顺序分批读回
+// 每行格式: [tuple数][每个tuple: 长度 + pb序列化结果]
+// 析构时删除文件
+class SpillFile {
+public:
+    SpillFile() {}
+    ~SpillFile();
+    // 在dir下新建一个临时文件, dir为空时用$TMPDIR(没有则/tmp)下的baikaldb_spill
+    int open_write(const std::string& dir);
+    int write_row(MemRow* row, int tuple_size);
+    // 写完后切换成读模式, 从头开始读
+    int finish_write();
+    // 最多读max_rows行追加到batch, 读到文件尾时*eof=true
+    int read_batch(MemRowDescriptor* desc, RowBatch* batch, size_t max_rows, bool* eof);
+
+    const std::string& path() const {
+        return _path;
+    }
+    int64_t rows() const {
+        return _rows;
+    }
+    int64_t file_size() const {
+        return _file_size;
+    }
+
+private:
+    int write_uint32(uint32_t value);
+    int read_uint32(uint32_t* value, bool* eof);
+
+private:
+    std::string _path;
+    FILE* _file = nullptr;
+    int64_t _rows = 0;
+    int64_t _file_size = 0;
+    std::string _buf;
+    DISALLOW_COPY_AND_ASSIGN(SpillFile);
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -21,6 +21,8 @@
 #include <set>
 #include <mutex>
 #include <list>
+#include <map>
+#include <vector>
 #include <unordered_map>
 //#include "data_buffer.h"
 #include "user_info.h"
@@ -37,6 +39,7 @@ const uint32_t SELF_BUF_DEFAULT_SIZE        = 4096;
 class NetworkSocket;
 class QueryContext;
 class DataBuffer;
+struct PlanTemplate;
 typedef std::shared_ptr<NetworkSocket> SmartSocket;
 
 enum SocketType {
@@ -55,6 +58,19 @@ enum SocketStatus{
     STATE_ERROR                 = 101   // STATE_ERROR
 };
 
+// COM_STMT_PREPARE生成的语句, 连接内按stmt_id缓存
+struct PreparedStmt {
+    std::string     sql;                        // 带?占位符的原始sql
+    std::vector<std::string> comments;          // sql前的注释, execute时解析json属性
+    int             type = 0;                   // Query type.
+    int             num_params = 0;
+    // 客户端最近一次绑定的参数类型, 低字节为mysql type, 高字节0x80表示unsigned
+    std::vector<uint16_t> param_types;
+    // select/update/delete的逻辑计划模板
+    // 为空时(insert等)execute把参数拼回sql走完整解析
+    std::shared_ptr<PlanTemplate> plan_template;
+};
+
 struct NetworkSocket {
     NetworkSocket();
     ~NetworkSocket();
@@ -121,6 +137,10 @@ struct NetworkSocket {
     std::mutex      region_lock;
     std::map<int, pb::CachePlan> cache_plans; // plan of queries in a transaction
     std::map<int64_t, pb::RegionInfo> region_infos;
+
+    // prepared statements of the connection
+    uint32_t        last_stmt_id = 0;
+    std::unordered_map<uint32_t, std::shared_ptr<PreparedStmt>> prepared_stmts;
 };
 
 class SocketPool {
@@ -232,6 +232,9 @@ void LiteralExpr::to_stream(std::ostream& os) const {
         case LT_NULL:
             os << "NULL";
             break;
+        case LT_PLACE_HOLDER:
+            os << "?";
+            break;
         default:
             break;
     }
@@ -134,7 +134,8 @@ enum LiteralType {
     LT_DOUBLE,
     LT_STRING,
     LT_BOOL,
-    LT_NULL
+    LT_NULL,
+    LT_PLACE_HOLDER
 };
 
 struct LiteralExpr : public ExprNode {
@@ -145,6 +146,8 @@ struct LiteralExpr : public ExprNode {
         double double_val;
         String str_val;
     } _u;
+    // prepare占位符的编号, 从0开始
+    int place_holder_id = 0;
     LiteralExpr() {
         expr_type = ET_LITETAL;
     }
@@ -166,6 +169,9 @@ struct LiteralExpr : public ExprNode {
             case LT_NULL:
                 std::cout << "NULL";
                 break;
+            case LT_PLACE_HOLDER:
+                std::cout << "?" << place_holder_id;
+                break;
         }
         std::cout << std::endl;
     }
@@ -217,6 +223,14 @@ struct LiteralExpr : public ExprNode {
         lit->literal_type = LT_NULL;
         return lit;
     }
+    static LiteralExpr* make_place_holder(int place_holder_id, butil::Arena& arena) {
+        LiteralExpr* lit = new(arena.allocate(sizeof(LiteralExpr))) LiteralExpr();
+        lit->literal_type = LT_PLACE_HOLDER;
+        lit->place_holder_id = place_holder_id;
+        // 被当作字符串使用时(如别名)为"?"
+        lit->_u.str_val.strdup("?", 1, arena);
+        return lit;
+    }
 };
 struct RowExpr : public ExprNode {
     RowExpr() {
@@ -36,6 +36,8 @@ struct SqlParser {
     butil::Arena arena;
     bool is_gbk = false;
     bool has_5c = false;
+    // prepare语句中?占位符的个数
+    int place_holder_id = 0;
     void parse(const std::string& sql);
     void change_5c_to_7f();
 };
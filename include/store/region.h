@@ -44,8 +44,10 @@
 #include "proto/store.interface.pb.h"
 #include "reverse_index.h"
 #include "transaction_pool.h"
+#include "transfer_scheduler.h"
 //#include "region_resource.h"
 #include "runtime_state.h"
+#include "select_stream.h"
 #include "rapidjson/document.h"
 
 using google::protobuf::Message;
@@ -108,7 +110,8 @@ public:
                _is_leader(false),
                _shutdown(false),
                _init_success(false),
-               _num_table_lines(0) {
+               _num_table_lines(0),
+               _data_version(0) {
         //create table and add peer请求状态初始化都为IDLE, 分裂请求状态初始化为DOING
         _status.store(_region_info.status());
     }
@@ -147,11 +150,19 @@ public:
             int64_t applied_index,
             int64_t term);
 
-    void select(const pb::StoreReq& request, pb::StoreRes& response);
+    // attachment不为空且请求要求时, 结果按列编码写到attachment里
+    void select(const pb::StoreReq& request, pb::StoreRes& response,
+            butil::IOBuf* attachment = nullptr);
     void select(const pb::StoreReq& request, 
             const pb::Plan& plan,
             const RepeatedPtrField<pb::TupleDescriptor>& tuples,
-            pb::StoreRes& response);
+            pb::StoreRes& response,
+            butil::IOBuf* attachment = nullptr,
+            SelectStreamWriter* stream = nullptr,
+            brpc::ClosureGuard* done_guard = nullptr);
+    // 结果通过stream按chunk返回: 计划open成功后先回包, 之后response和request都不能再用
+    void select_stream(const pb::StoreReq& request, pb::StoreRes& response,
+            brpc::Controller* cntl, google::protobuf::Closure* done);
 
     //leader收到从metaServer心跳包中的解析出来的add_peer请求
     void add_peer(const pb::AddPeer& add_peer, ExecutionQueue& queue);
@@ -366,6 +377,10 @@ public:
         _num_table_lines.store(table_line);
         DB_WARNING("region_id: %ld, table_line:%ld", _region_id, _num_table_lines.load());
     }
+    // 不经过raft直接写region数据后需要调用, 保证下次snapshot重新生成数据sst
+    void add_data_version() {
+        ++_data_version;
+    }
     void start_thread_to_remove_region(int64_t drop_region_id, std::string instance_address);
     void send_remove_region_to_store(int64_t drop_region_id, std::string instance_address);
     void set_removed(bool removed) {
@@ -481,7 +496,9 @@ private:
                         braft::SnapshotWriter*writer, 
                         MutTableKey region_prefix,
                         std::string extra,
-                        pb::RegionInfo snapshot_region_info);
+                        pb::RegionInfo snapshot_region_info,
+                        int64_t data_version,
+                        int64_t snapshot_index);
 
     int send_request_to_region(const pb::StoreReq& request,
                                 const std::string& instance,
@@ -509,6 +526,9 @@ private:
                             rocksdb::Iterator* iter,
                             MutTableKey& region_prefix,
                             int64_t& row_count);
+    int _link_last_snapshot_data(const std::string& sst_file,
+                                 int64_t data_version,
+                                 int64_t& row_count);
 
     void copy_region(pb::RegionInfo* region_info) {
         std::lock_guard<std::mutex> lock(_region_lock);
@@ -587,6 +607,12 @@ private:
     int64_t                             _snapshot_num_table_lines = 0;  //last snapshot number 
     TimeCost                            _snapshot_time_cost;
     int64_t                             _snapshot_index = 0; //last snapshot log index
+    // 数据版本, 有写入的事务提交、truncate、ingest、清数据等数据sst会变化时加1
+    // 上次snapshot的数据sst在版本未变时可以直接复用
+    std::atomic<int64_t>                _data_version;
+    int64_t                             _snapshot_data_version = -1;
+    int64_t                             _snapshot_data_rows = 0;
+    std::string                         _snapshot_data_file;
     bool                                _removed = false;
     bool                                _need_clear_data = true;
     TransactionPool                     _txn_pool;
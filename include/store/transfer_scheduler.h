@@ -0,0 +1,62 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#ifdef BAIDU_INTERNAL
+#include <raft/snapshot_throttle.h>
+#else
+#include <braft/snapshot_throttle.h>
+#endif
+#include <bthread/mutex.h>
+#include <bvar/bvar.h>
+#include "common.h"
+
+namespace baikaldb {
+// store内add_peer和snapshot安装的数据传输调度
+// 带宽: 所有region的raft node共享一个snapshot throttle, 限制snapshot拷贝的读写速率
+// 并发: 同时进行的add_peer数有上限, 超过时直接拒绝, 调用方回复RETRY_LATER由meta稍后重试
+// 优先级: 心跳触发的补副本优先于rpc触发的迁移/均衡
+class TransferScheduler {
+public:
+    enum Priority {
+        PRIORITY_REPAIR = 0,
+        PRIORITY_BALANCE = 1
+    };
+    static TransferScheduler* get_instance() {
+        static TransferScheduler _instance;
+        return &_instance;
+    }
+    // 给braft::NodeOptions::snapshot_throttle使用, 全store共享
+    scoped_refptr<braft::SnapshotThrottle>* snapshot_throttle() {
+        return &_snapshot_throttle;
+    }
+    // 有空闲名额时占用并返回true, 否则返回false, 不阻塞调用方
+    // 调用方拿不到名额时直接失败, 由meta稍后重试
+    bool try_acquire(Priority priority);
+    void release();
+
+private:
+    TransferScheduler();
+
+    bthread::Mutex _mutex;
+    int _running = 0;
+    scoped_refptr<braft::SnapshotThrottle> _snapshot_throttle;
+    bvar::Adder<int64_t> _running_count;
+    bvar::Adder<int64_t> _busy_count;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
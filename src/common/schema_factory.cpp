@@ -711,6 +711,16 @@ TableInfo SchemaFactory::get_table_info(int64_t tableid) {
     return _table_info_mapping[tableid];
 }
 
+int64_t SchemaFactory::get_table_version(int64_t tableid) {
+    SchemaMapping* frontground = _double_buffer_table.read();
+    auto& _table_info_mapping = frontground->table_info_mapping;
+    auto iter = _table_info_mapping.find(tableid);
+    if (iter == _table_info_mapping.end()) {
+        return -1;
+    }
+    return iter->second.version;
+}
+
 IndexInfo SchemaFactory::get_index_info(int64_t indexid) {
     SchemaMapping* frontground = _double_buffer_table.read();
     auto& _index_info_mapping = frontground->index_info_mapping;
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include "table_key.h"
 #include "mut_table_key.h"
 #include "schema_factory.h"
@@ -27,6 +28,109 @@ SmartRecord TableRecord::new_record(int64_t tableid) {
     return factory->new_record(tableid);
 }
 
+// [magic][version][uint16 max_tag][schema bitmap][var bitmap][null bitmap]
+// [定长区: 每个非string字段8字节][偏移区: 每个string字段的uint32结束偏移][string内容]
+// 三个bitmap都按tag寻址, 长度为max_tag / 8 + 1, 字段在定长区/偏移区中按tag从小到大排列
+// null字段也占位, 这样字段的位置只由schema bitmap决定
+int TableRecord::encode_compact(std::string& out) {
+    const Descriptor* descriptor = _message->GetDescriptor();
+    const Reflection* reflection = _message->GetReflection();
+    std::vector<const FieldDescriptor*> fields;
+    fields.reserve(descriptor->field_count());
+    for (int i = 0; i < descriptor->field_count(); i++) {
+        fields.push_back(descriptor->field(i));
+    }
+    std::sort(fields.begin(), fields.end(),
+            [](const FieldDescriptor* l, const FieldDescriptor* r) {
+        return l->number() < r->number();
+    });
+    int max_tag = fields.empty() ? 0 : fields.back()->number();
+    if (max_tag > UINT16_MAX) {
+        return encode(out);
+    }
+    size_t bitmap_size = max_tag / 8 + 1;
+    size_t fixed_cnt = 0;
+    size_t var_cnt = 0;
+    for (auto field : fields) {
+        if (is_var_field(field)) {
+            ++var_cnt;
+        } else {
+            ++fixed_cnt;
+        }
+    }
+    size_t schema_pos = COMPACT_ROW_HEADER_SIZE;
+    size_t var_bits_pos = schema_pos + bitmap_size;
+    size_t null_bits_pos = var_bits_pos + bitmap_size;
+    size_t fixed_pos = null_bits_pos + bitmap_size;
+    size_t offset_pos = fixed_pos + fixed_cnt * sizeof(uint64_t);
+    out.assign(offset_pos + var_cnt * sizeof(uint32_t), '\0');
+    out[0] = COMPACT_ROW_MAGIC;
+    out[1] = COMPACT_ROW_VERSION;
+    uint16_t tag16 = max_tag;
+    memcpy(&out[2], &tag16, sizeof(tag16));
+    uint32_t var_size = 0;
+    std::string scratch;
+    for (auto field : fields) {
+        int tag = field->number();
+        uint8_t bit = 1 << (tag % 8);
+        out[schema_pos + tag / 8] |= bit;
+        bool null = !reflection->HasField(*_message, field);
+        if (null) {
+            out[null_bits_pos + tag / 8] |= bit;
+        }
+        if (is_var_field(field)) {
+            out[var_bits_pos + tag / 8] |= bit;
+            if (!null) {
+                const std::string& val = reflection->GetStringReference(*_message, field, &scratch);
+                out.append(val);
+                var_size += val.size();
+            }
+            memcpy(&out[offset_pos], &var_size, sizeof(var_size));
+            offset_pos += sizeof(uint32_t);
+            continue;
+        }
+        if (!null) {
+            char* slot = &out[fixed_pos];
+            switch (field->cpp_type()) {
+                case FieldDescriptor::CPPTYPE_INT32: {
+                    int64_t val = reflection->GetInt32(*_message, field);
+                    memcpy(slot, &val, sizeof(val));
+                } break;
+                case FieldDescriptor::CPPTYPE_INT64: {
+                    int64_t val = reflection->GetInt64(*_message, field);
+                    memcpy(slot, &val, sizeof(val));
+                } break;
+                case FieldDescriptor::CPPTYPE_UINT32: {
+                    uint64_t val = reflection->GetUInt32(*_message, field);
+                    memcpy(slot, &val, sizeof(val));
+                } break;
+                case FieldDescriptor::CPPTYPE_UINT64: {
+                    uint64_t val = reflection->GetUInt64(*_message, field);
+                    memcpy(slot, &val, sizeof(val));
+                } break;
+                case FieldDescriptor::CPPTYPE_FLOAT: {
+                    float val = reflection->GetFloat(*_message, field);
+                    memcpy(slot, &val, sizeof(val));
+                } break;
+                case FieldDescriptor::CPPTYPE_DOUBLE: {
+                    double val = reflection->GetDouble(*_message, field);
+                    memcpy(slot, &val, sizeof(val));
+                } break;
+                case FieldDescriptor::CPPTYPE_BOOL: {
+                    uint64_t val = reflection->GetBool(*_message, field);
+                    memcpy(slot, &val, sizeof(val));
+                } break;
+                default: {
+                    DB_WARNING("unsupported field type: %d", field->cpp_type());
+                    return -1;
+                }
+            }
+        }
+        fixed_pos += sizeof(uint64_t);
+    }
+    return 0;
+}
+
 bool TableRecord::is_null(const FieldDescriptor* field) {
     const Reflection* _reflection = _message->GetReflection();
     if (!_reflection->HasField(*_message, field)) {
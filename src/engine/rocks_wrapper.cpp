@@ -27,24 +27,100 @@ DEFINE_int32(rocks_transaction_lock_timeout_ms, 1000, "rocksdb transaction_lock_
 DEFINE_int32(rocks_default_lock_timeout_ms, 1000, "rocksdb default_lock_timeout(ms)");
 
 DEFINE_int32(rocks_block_size, 64 * 1024, "rocksdb block_cache size, default: 64KB");
+// 默认和原来一样: raft_log和data共用一个64MB的cache, meta_info用rocksdb默认的8MB cache
+// raft_log单独配置cache后, log写入不会把data的热block挤出去
+DEFINE_int64(rocks_data_block_cache_mb, 64, "block cache size(MB) of data column family");
+DEFINE_int64(rocks_log_block_cache_mb, 0,
+        "block cache size(MB) of raft_log column family, 0 means share data's cache");
+DEFINE_int64(rocks_meta_block_cache_mb, 8, "block cache size(MB) of meta_info column family");
+DEFINE_double(rocks_high_pri_pool_ratio, 0,
+        "ratio of each block cache reserved for index and filter blocks, "
+        "works with rocks_cache_index_and_filter_blocks");
+DEFINE_bool(rocks_cache_index_and_filter_blocks, false,
+        "put index and filter blocks of raft_log and data in block cache with high priority");
+DEFINE_bool(rocks_data_partition_index, false,
+        "use partitioned index and filters for data column family, instead of hash index");
+DEFINE_bool(rocks_log_partition_index, false,
+        "use partitioned index and filters for raft_log column family, instead of hash index");
 DEFINE_bool(rocks_data_dynamic_level_bytes, true, 
         "rocksdb level_compaction_dynamic_level_bytes for data column_family, default true");
+DEFINE_int32(split_filter_index_cache_size, 10000,
+        "max index entries cached by split compaction filter");
 
 const std::string RocksWrapper::RAFT_LOG_CF = "raft_log";
 const std::string RocksWrapper::DATA_CF = "data";
 const std::string RocksWrapper::METAINFO_CF = "meta_info";
 
 RocksWrapper::RocksWrapper() : _is_init(false), _txn_db(nullptr) {}
+
+static int64_t get_cache_usage(void* cache) {
+    return ((rocksdb::Cache*)cache)->GetUsage();
+}
+
+std::shared_ptr<rocksdb::Cache> RocksWrapper::new_block_cache(const std::string& cf_name,
+        int64_t cache_mb) {
+    std::shared_ptr<rocksdb::Cache> cache = rocksdb::NewLRUCache(cache_mb * 1024 * 1024, 8,
+            false, FLAGS_rocks_high_pri_pool_ratio);
+    _cache_usage_vars[cf_name].reset(new bvar::PassiveStatus<int64_t>(
+            "rocks_" + cf_name + "_block_cache_usage", get_cache_usage, cache.get()));
+    return cache;
+}
+
+rocksdb::BlockBasedTableOptions RocksWrapper::make_table_options(const std::string& cf_name,
+        const std::shared_ptr<rocksdb::Cache>& cache, bool partition_index) {
+    rocksdb::BlockBasedTableOptions table_options;
+    table_options.block_size = FLAGS_rocks_block_size;
+    table_options.block_cache = cache;
+    if (FLAGS_rocks_cache_index_and_filter_blocks) {
+        table_options.cache_index_and_filter_blocks = true;
+        table_options.cache_index_and_filter_blocks_with_high_priority = true;
+        table_options.pin_l0_filter_and_index_blocks_in_cache = true;
+    }
+    if (partition_index) {
+        // 分区索引和过滤器需要full filter
+        table_options.index_type = rocksdb::BlockBasedTableOptions::kTwoLevelIndexSearch;
+        table_options.partition_filters = true;
+        table_options.metadata_block_size = 4096;
+        table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
+    } else {
+        table_options.index_type = rocksdb::BlockBasedTableOptions::kHashSearch;
+        table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+    }
+    _block_caches[cf_name] = cache;
+    return table_options;
+}
+
+void RocksWrapper::get_block_cache_usage(std::map<std::string, size_t>* usage) {
+    for (auto& pair : _block_caches) {
+        (*usage)[pair.first] = pair.second->GetUsage();
+    }
+}
+
+void RocksWrapper::get_block_caches(std::unordered_set<const rocksdb::Cache*>* caches) {
+    for (auto& pair : _block_caches) {
+        caches->insert(pair.second.get());
+    }
+}
+
 int32_t RocksWrapper::init(const std::string& path) {
     if (_is_init) {
         return 0;
     }
-    rocksdb::BlockBasedTableOptions table_options;
-    table_options.index_type = rocksdb::BlockBasedTableOptions::kHashSearch;
-    table_options.block_size = FLAGS_rocks_block_size;
-    table_options.block_cache = rocksdb::NewLRUCache(64 * 1024 * 1024, 8);
-    table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
-    _cache = table_options.block_cache.get();
+    std::shared_ptr<rocksdb::Cache> data_cache = new_block_cache(DATA_CF,
+            FLAGS_rocks_data_block_cache_mb);
+    std::shared_ptr<rocksdb::Cache> log_cache = data_cache;
+    if (FLAGS_rocks_log_block_cache_mb > 0) {
+        log_cache = new_block_cache(RAFT_LOG_CF, FLAGS_rocks_log_block_cache_mb);
+    }
+    rocksdb::BlockBasedTableOptions log_table_options = make_table_options(RAFT_LOG_CF,
+            log_cache, FLAGS_rocks_log_partition_index);
+    rocksdb::BlockBasedTableOptions data_table_options = make_table_options(DATA_CF,
+            data_cache, FLAGS_rocks_data_partition_index);
+    // meta_info保持rocksdb默认的二分索引, 不加filter, 只是cache单独创建以便统计
+    rocksdb::BlockBasedTableOptions meta_table_options;
+    meta_table_options.block_cache = new_block_cache(METAINFO_CF, FLAGS_rocks_meta_block_cache_mb);
+    _block_caches[METAINFO_CF] = meta_table_options.block_cache;
+    _cache = data_cache.get();
     rocksdb::Options db_options;
     db_options.IncreaseParallelism();
     db_options.create_if_missing = true;
@@ -68,7 +144,7 @@ int32_t RocksWrapper::init(const std::string& path) {
     _log_cf_option.OptimizeLevelStyleCompaction();
     _log_cf_option.compaction_pri = rocksdb::kOldestLargestSeqFirst;
     _log_cf_option.compaction_filter = RaftLogCompactionFilter::get_instance();
-    _log_cf_option.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+    _log_cf_option.table_factory.reset(rocksdb::NewBlockBasedTableFactory(log_table_options));
     //log_cf_option.compression = rocksdb::kLZ4Compression;
     _log_cf_option.compaction_style = rocksdb::kCompactionStyleLevel;
     _log_cf_option.level0_file_num_compaction_trigger = 5;
@@ -84,7 +160,7 @@ int32_t RocksWrapper::init(const std::string& path) {
     _data_cf_option.OptimizeLevelStyleCompaction();
     _data_cf_option.compaction_pri = rocksdb::kByCompensatedSize;
     _data_cf_option.compaction_filter = SplitCompactionFilter::get_instance();
-    _data_cf_option.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+    _data_cf_option.table_factory.reset(rocksdb::NewBlockBasedTableFactory(data_table_options));
     //data_cf_option.compression = rocksdb::kLZ4Compression;
     _data_cf_option.compaction_style = rocksdb::kCompactionStyleLevel;
     _data_cf_option.level0_file_num_compaction_trigger = 5;
@@ -101,6 +177,7 @@ int32_t RocksWrapper::init(const std::string& path) {
             rocksdb::NewFixedPrefixTransform(1));
     _meta_info_option.OptimizeLevelStyleCompaction();
     _meta_info_option.compaction_pri = rocksdb::kOldestSmallestSeqFirst;
+    _meta_info_option.table_factory.reset(rocksdb::NewBlockBasedTableFactory(meta_table_options));
 
     _db_path = path;
     // List Column Family
@@ -17,18 +17,35 @@
 #include "tuple_record.h"
 
 namespace baikaldb {
+DEFINE_int64(scan_readahead_size, 2 * 1024 * 1024, "readahead size for bulk region scan, default 2MB");
+
+// 大于所有以key为前缀的key的最小key, key全是0xFF时返回空
+static std::string prefix_successor(const std::string& key) {
+    std::string succ = key;
+    while (!succ.empty()) {
+        uint8_t& last = (uint8_t&)succ.back();
+        if (last != 0xFF) {
+            ++last;
+            return succ;
+        }
+        succ.pop_back();
+    }
+    return succ;
+}
 
 TableIterator* Iterator::scan_primary(
         SmartTransaction        txn,
         const IndexRange&       range, 
         std::vector<int32_t>&   fields, 
         bool                    check_region, 
-        bool                    forward) {
+        bool                    forward,
+        bool                    bulk_scan) {
     txn->reset_active_time();
     TableIterator* iter = new (std::nothrow)TableIterator(check_region, forward);
     if (nullptr == iter) {
         return nullptr;
     }
+    iter->set_bulk_scan(bulk_scan);
     if (0 != iter->open(range, fields, txn)) {
         DB_WARNING("open table iterator failed");
         delete iter;
@@ -238,6 +255,14 @@ int Iterator::open(const IndexRange& range, std::vector<int32_t>& fields, SmartT
         read_options.prefix_same_as_start = false;
         read_options.total_order_seek = true;
     }
+    read_options.snapshot = _snapshot;
+    if (_forward) {
+        _set_iterate_upper_bound(read_options);
+    }
+    if (_bulk_scan) {
+        read_options.readahead_size = FLAGS_scan_readahead_size;
+        read_options.fill_cache = false;
+    }
 
     if (_txn != nullptr) {
         _iter = _txn->GetIterator(read_options, _data_cf);
@@ -256,7 +281,11 @@ int Iterator::open(const IndexRange& range, std::vector<int32_t>& fields, SmartT
             _lower_suffix = 8;
         }
         TimeCost cost;
-        _iter->Seek(_lower_bound.data());
+        if (!_sub_begin.empty() && _sub_begin > _lower_bound.data()) {
+            _iter->Seek(_sub_begin);
+        } else {
+            _iter->Seek(_lower_bound.data());
+        }
         DB_DEBUG("region:%ld, Seek cost:%ld", _region, cost.get_time());
         //skip left bound if _left_open
         if (_left_open) {
@@ -284,6 +313,34 @@ int Iterator::open(const IndexRange& range, std::vector<int32_t>& fields, SmartT
     return 0;
 }
 
+// 正向扫描时把右边界下推给rocksdb, 越界后不再读取后面的sst和tombstone
+// 这里只是个严格的上界, 精确的边界判断仍在_fits_right_bound中做
+void Iterator::_set_iterate_upper_bound(rocksdb::ReadOptions& read_options) {
+    const std::string& upper = _upper_bound.data();
+    if (_right_open || _upper_is_end) {
+        if ((int)upper.size() > _prefix_len) {
+            _iterate_upper_key = upper;
+        } else {
+            _iterate_upper_key = prefix_successor(upper.substr(0, _prefix_len));
+        }
+    } else {
+        //前缀相同时可以越界, 取upper和right_key前缀后继的较大值
+        _iterate_upper_key = prefix_successor(upper);
+        std::string right_succ = prefix_successor(_end.data());
+        if (right_succ.empty() || (!_iterate_upper_key.empty() && right_succ > _iterate_upper_key)) {
+            _iterate_upper_key = right_succ;
+        }
+    }
+    if (!_sub_end.empty() && (_iterate_upper_key.empty() || _sub_end < _iterate_upper_key)) {
+        _iterate_upper_key = _sub_end;
+    }
+    if (_iterate_upper_key.empty()) {
+        return;
+    }
+    _iterate_upper_slice = _iterate_upper_key;
+    read_options.iterate_upper_bound = &_iterate_upper_slice;
+}
+
 bool Iterator::_fits_left_bound() {
     rocksdb::Slice key = _iter->key();
     rocksdb::Slice lower(_lower_bound.data().c_str(), _lower_bound.size() - _lower_suffix);
@@ -320,6 +377,9 @@ bool Iterator::_fits_region() {
 bool Iterator::_fits_right_bound() {
     //check range end_key
     rocksdb::Slice key = _iter->key();
+    if (!_sub_end.empty() && key.compare(_sub_end) >= 0) {
+        return false;
+    }
     rocksdb::Slice upper(_upper_bound.data().c_str(), _upper_bound.size() - _upper_sufix);
     rocksdb::Slice right_key(_end.data());
 
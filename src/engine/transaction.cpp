@@ -20,6 +20,8 @@
 
 namespace baikaldb {
 DEFINE_bool(disable_wal, true, "disable rocksdb interanal WAL log, only use raft log");
+// 旧版本store无法解析紧凑格式, 所有store升级后再打开
+DEFINE_bool(compact_row_format, false, "write primary rows in compact row format");
 // DEFINE_int32(rocks_transaction_expiration_ms, 600 * 1000, 
 //         "rocksdb transaction_expiration timeout(us)");
 
@@ -210,7 +212,11 @@ int Transaction::put_primary(int64_t region, IndexInfo& pk_index, SmartRecord re
         return -1;
     }
     std::string value;
-    ret = record->encode(value);
+    if (FLAGS_compact_row_format) {
+        ret = record->encode_compact(value);
+    } else {
+        ret = record->encode(value);
+    }
     if (ret != 0) {
         DB_WARNING("encode record failed: reg=%ld, tab=%ld", region, pk_index.id);
         return -1;
@@ -399,6 +405,41 @@ int Transaction::get_update_primary(
     return 0;
 }
 
+int Transaction::multi_get_primary(
+        int64_t         region,
+        IndexInfo&      pk_index,
+        const std::vector<SmartRecord>& keys,
+        std::vector<std::string>* values,
+        std::vector<int>* rets) {
+    BAIDU_SCOPED_LOCK(_txn_mutex);
+    last_active_time = butil::gettimeofday_us();
+    std::vector<MutTableKey> encoded_keys(keys.size());
+    std::vector<rocksdb::Slice> slices;
+    slices.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        encoded_keys[i].append_i64(region).append_i64(pk_index.id);
+        if (0 != encoded_keys[i].append_index(pk_index, keys[i].get(), -1, false)) {
+            DB_WARNING("Fail to append_index, reg:%ld, tab:%ld", region, pk_index.id);
+            return -1;
+        }
+        slices.emplace_back(encoded_keys[i].data());
+    }
+    std::vector<rocksdb::ColumnFamilyHandle*> cfs(keys.size(), _data_cf);
+    // 通过事务读, 能读到本事务未提交的写
+    std::vector<rocksdb::Status> statuses = _txn->MultiGet(_read_opt, cfs, slices, values);
+    rets->assign(keys.size(), 0);
+    for (size_t i = 0; i < statuses.size(); i++) {
+        if (statuses[i].IsNotFound()) {
+            (*rets)[i] = -2;
+        } else if (!statuses[i].ok()) {
+            DB_WARNING("multi get fail, reg:%ld, tab:%ld, err:%s", 
+                    region, pk_index.id, statuses[i].ToString().c_str());
+            return -1;
+        }
+    }
+    return 0;
+}
+
 //TODO: update return status
 int Transaction::get_update_secondary(
         int64_t             region, 
@@ -13,9 +13,14 @@
 // limitations under the License.
 
 #include "agg_node.h"
+#include "fetcher_node.h"
 #include "runtime_state.h"
 
 namespace baikaldb {
+DEFINE_bool(agg_use_fixed_key, true, "use fixed width key hash map when all group by columns are numeric");
+DEFINE_int64(agg_partial_flush_groups, 100000, "partial agg on store outputs groups when group count reaches it");
+DEFINE_bool(agg_streaming_merge, true, "merge agg node merges region results as soon as they return");
+
 int AggNode::init(const pb::PlanNode& node) {
     int ret = 0;
     ret = ExecNode::init(node);
@@ -55,6 +60,7 @@ int AggNode::init(const pb::PlanNode& node) {
     }
     //_group_tuple_id = node.derive_node().agg_node().group_tuple_id();
     _agg_tuple_id = node.derive_node().agg_node().agg_tuple_id();
+    _partial_flush = node.derive_node().agg_node().partial_flush();
     _hash_map.init(12301);
     _iter = _hash_map.end();
     return 0;
@@ -101,11 +107,7 @@ int AggNode::expr_optimize(std::vector<pb::TupleDescriptor>* tuple_descs) {
 
 int AggNode::open(RuntimeState* state) {
     int ret = 0;
-    ret = ExecNode::open(state);
-    if (ret < 0) {
-        DB_WARNING_STATE(state, "ExecNode::open fail, ret:%d", ret);
-        return ret;
-    }
+    // 先准备好表达式和hash表, 流式merge时孩子open过程中就会回调merge_batch
     for (auto expr : _group_exprs) {
         ret = expr->open();
         if (ret < 0) {
@@ -121,34 +123,36 @@ int AggNode::open(RuntimeState* state) {
         }
     }
     _mem_row_desc = state->mem_row_desc();
-
-    TimeCost cost;
-    int64_t agg_time = 0;
-    int64_t scan_time = 0;
-    int row_cnt = 0;
-    for (auto child : _children) {
-        bool eos = false;
-        do {
-            TimeCost cost;
-            RowBatch batch;
-            ret = child->get_next(state, &batch, &eos);
-            if (ret < 0) {
-                DB_WARNING_STATE(state, "child->get_next fail, ret:%d", ret);
-                return ret;
-            }
-            scan_time += cost.get_time();
-            cost.reset();
-            process_row_batch(batch);
-            agg_time += cost.get_time();
-            row_cnt += batch.size();
-            // 对于用order by分组的特殊优化
-            //if (_agg_tuple_id == -1 && _limit != -1 && (int64_t)_hash_map.size() >= _limit) {
-            //    break;
-            //}
-        } while (!eos);
-    }
-    DB_WARNING_STATE(state, "region:%ld, agg time:%ld ,scan time:%ld total:%ld, row_cnt:%d", 
-        state->region_id(), agg_time, scan_time, cost.get_time(), row_cnt);
+    _use_fixed_key = FLAGS_agg_use_fixed_key && can_use_fixed_key();
+    if (_use_fixed_key) {
+        _fixed_key.resize(_group_exprs.size() + 1);
+        _fixed_hash_map.init(_fixed_key.size());
+    }
+    _mem_tracker = state->mem_tracker();
+    _mem_used = 0;
+    _child_idx = 0;
+    // 各region的结果一返回就merge, 不用等所有region的结果都攒在fetcher里
+    if (_is_merger && FLAGS_agg_streaming_merge && _children.size() == 1 &&
+            _children[0]->node_type() == pb::FETCHER_NODE) {
+        static_cast<FetcherNode*>(_children[0])->set_batch_handler(
+                [this, state](RowBatch* batch) {
+            return process_row_batch(state, *batch);
+        });
+    }
+    ret = ExecNode::open(state);
+    if (ret < 0) {
+        DB_WARNING_STATE(state, "ExecNode::open fail, ret:%d", ret);
+        return ret;
+    }
+    // store上的部分聚合分批输出, 在get_next里边拉数据边聚合
+    if (_partial_flush && _group_exprs.size() > 0) {
+        reset_group_iter();
+        return 0;
+    }
+    ret = agg_child_rows(state, 0);
+    if (ret < 0) {
+        return ret;
+    }
     // select count(*) from t; 无数据时返回0
     if (_hash_map.size() == 0 && _group_exprs.size() == 0) {
         std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
@@ -159,10 +163,115 @@ int AggNode::open(RuntimeState* state) {
         _hash_map.insert(key.data(), row.release());
     }
     //等hash_map构建完毕后才取位置
-    _iter = _hash_map.begin();
+    reset_group_iter();
+    return 0;
+}
+
+int AggNode::agg_child_rows(RuntimeState* state, size_t max_groups) {
+    TimeCost cost;
+    int64_t agg_time = 0;
+    int64_t scan_time = 0;
+    int row_cnt = 0;
+    while (_child_idx < _children.size()) {
+        TimeCost cost;
+        RowBatch batch;
+        batch.set_allow_columnar(true);
+        bool eos = false;
+        int ret = _children[_child_idx]->get_next(state, &batch, &eos);
+        if (ret < 0) {
+            DB_WARNING_STATE(state, "child->get_next fail, ret:%d", ret);
+            return ret;
+        }
+        scan_time += cost.get_time();
+        cost.reset();
+        ret = process_row_batch(state, batch);
+        if (ret < 0) {
+            return ret;
+        }
+        agg_time += cost.get_time();
+        row_cnt += batch.size();
+        if (eos) {
+            ++_child_idx;
+        }
+        // 对于用order by分组的特殊优化
+        //if (_agg_tuple_id == -1 && _limit != -1 && (int64_t)_hash_map.size() >= _limit) {
+        //    break;
+        //}
+        if (max_groups > 0 && group_count() >= max_groups) {
+            break;
+        }
+    }
+    DB_WARNING_STATE(state, "region:%ld, agg time:%ld ,scan time:%ld total:%ld, row_cnt:%d, "
+        "group_cnt:%lu, use_fixed_key:%d", state->region_id(), agg_time, scan_time,
+        cost.get_time(), row_cnt, group_count(), _use_fixed_key);
     return 0;
 }
 
+size_t AggNode::group_count() {
+    if (_use_fixed_key) {
+        return _fixed_hash_map.size();
+    }
+    return _hash_map.size();
+}
+
+void AggNode::reset_group_iter() {
+    _iter = _hash_map.begin();
+    if (_use_fixed_key) {
+        _fixed_pos = _fixed_hash_map.next_used(0);
+    }
+}
+
+bool AggNode::group_iter_end() {
+    if (_use_fixed_key) {
+        return _fixed_pos >= _fixed_hash_map.capacity();
+    }
+    return _iter == _hash_map.end();
+}
+
+MemRow* AggNode::release_group_row() {
+    MemRow* row = nullptr;
+    if (_use_fixed_key) {
+        row = _fixed_hash_map.value_at(_fixed_pos);
+        _fixed_hash_map.value_at(_fixed_pos) = nullptr;
+        _fixed_pos = _fixed_hash_map.next_used(_fixed_pos + 1);
+    } else {
+        row = _iter->second;
+        _iter->second = nullptr;
+        _iter++;
+    }
+    return row;
+}
+
+bool AggNode::can_use_fixed_key() {
+    // key[0]作为null标记, 每个分组列占一位, 最多64列
+    if (_group_exprs.size() == 0 || _group_exprs.size() > 64) {
+        return false;
+    }
+    for (auto expr : _group_exprs) {
+        if (get_num_size(expr->col_type()) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AggNode::encode_fixed_key(MemRow* row, uint64_t* key) {
+    uint64_t null_flag = 0;
+    for (uint32_t i = 0; i < _group_exprs.size(); i++) {
+        ExprValue value = _group_exprs[i]->get_value(row);
+        if (value.is_null()) {
+            null_flag |= (1ULL << i);
+            key[i + 1] = 0;
+        } else if (is_double(value.type)) {
+            double d = value.get_numberic<double>();
+            memcpy(&key[i + 1], &d, sizeof(d));
+        } else {
+            key[i + 1] = value.get_numberic<uint64_t>();
+        }
+    }
+    key[0] = null_flag;
+}
+
 void AggNode::encode_agg_key(MemRow* row, MutTableKey& key) {
     uint8_t null_flag = 0;
     key.append_u8(null_flag);
@@ -177,41 +286,107 @@ void AggNode::encode_agg_key(MemRow* row, MutTableKey& key) {
     key.replace_u8(null_flag, 0);
 }
 
-void AggNode::process_row_batch(RowBatch& batch) {
+int AggNode::process_row_batch(RuntimeState* state, RowBatch& batch) {
+    bool is_columnar = batch.is_columnar();
+    MemRow column_row(0);
     for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
-        std::unique_ptr<MemRow>& row = batch.get_row();
+        MemRow* cur_row = nullptr;
+        if (is_columnar) {
+            column_row.bind_column_row(batch.mutable_columns(), batch.column_row());
+            cur_row = &column_row;
+        } else {
+            cur_row = batch.get_row().get();
+        }
         MutTableKey key;
-        MemRow* cur_row = row.get();
-        encode_agg_key(cur_row, key);
-        MemRow** agg_row = _hash_map.seek(key.data());
-        if (agg_row == nullptr) { //不存在则新建
-            cur_row = row.release();
-            agg_row = &cur_row;
-            AggFnCall::initialize_all(_agg_fn_calls, *agg_row);
-            // 可能会rehash
-            _hash_map.insert(key.data(), *agg_row);
+        MemRow** agg_row = nullptr;
+        if (_use_fixed_key) {
+            bool inserted = false;
+            encode_fixed_key(cur_row, _fixed_key.data());
+            agg_row = _fixed_hash_map.seek_or_insert(_fixed_key.data(), &inserted);
+        } else {
+            encode_agg_key(cur_row, key);
+            agg_row = _hash_map.seek(key.data());
+        }
+        MemRow* new_row = nullptr;
+        // 设置了query内存上限时按分组行大小的变化记账, 包括已有分组的状态增长
+        bool track_mem = _mem_tracker->limit() > 0;
+        int64_t old_size = 0;
+        if (agg_row == nullptr || *agg_row == nullptr) { //不存在则新建
+            if (is_columnar) {
+                // 列存行只是视图, 新分组才物化一行作为聚合结果
+                std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+                batch.mutable_columns()->fill_mem_row(batch.column_row(), row.get());
+                new_row = row.release();
+            } else {
+                new_row = batch.get_row().release();
+                cur_row = new_row;
+            }
+            AggFnCall::initialize_all(_agg_fn_calls, new_row);
+            if (_use_fixed_key) {
+                *agg_row = new_row;
+            } else {
+                agg_row = &new_row;
+                // 可能会rehash
+                _hash_map.insert(key.data(), *agg_row);
+            }
+        } else if (track_mem) {
+            old_size = (*agg_row)->used_size();
         }
         if (_is_merger) {
             AggFnCall::merge_all(_agg_fn_calls, cur_row, *agg_row);
         } else {
             AggFnCall::update_all(_agg_fn_calls, cur_row, *agg_row);
         }
+        if (track_mem) {
+            int64_t delta = (int64_t)(*agg_row)->used_size() - old_size;
+            _mem_used += delta;
+            _mem_tracker->consume(delta);
+            if (_mem_tracker->exceeded()) {
+                // 分组状态不落盘, 超过显式设置的query内存上限时报错, 已有分组在close时释放
+                DB_WARNING_STATE(state, "agg memory exceed limit, mem_used:%ld, "
+                        "query_mem_used:%ld, limit:%ld, group_cnt:%lu", _mem_used,
+                        _mem_tracker->used(), _mem_tracker->limit(), group_count());
+                state->error_code = ER_OUT_OF_RESOURCES;
+                state->error_msg.str("");
+                state->error_msg << "query memory exceed limit " << _mem_tracker->limit();
+                return -1;
+            }
+        }
     }
+    return 0;
 }
 
 int AggNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
     while (1) {
-        if (reached_limit() || _iter == _hash_map.end()) {
+        if (reached_limit()) {
             *eos = true;
             return 0;
         }
         if (batch->is_full()) {
             return 0;
         }
-        AggFnCall::finalize_all(_agg_fn_calls, _iter->second);
-        batch->move_row(std::move(std::unique_ptr<MemRow>(_iter->second)));
-        _iter->second = nullptr;
-        _iter++;
+        if (group_iter_end()) {
+            if (!_partial_flush || _child_idx >= _children.size()) {
+                *eos = true;
+                return 0;
+            }
+            //上一批分组已输出, 清空后继续聚合下一批
+            _hash_map.clear();
+            if (_use_fixed_key) {
+                _fixed_hash_map.clear();
+            }
+            _mem_tracker->release(_mem_used);
+            _mem_used = 0;
+            int ret = agg_child_rows(state, FLAGS_agg_partial_flush_groups);
+            if (ret < 0) {
+                return ret;
+            }
+            reset_group_iter();
+            continue;
+        }
+        MemRow* row = release_group_row();
+        AggFnCall::finalize_all(_agg_fn_calls, row);
+        batch->move_row(std::move(std::unique_ptr<MemRow>(row)));
     }
 }
 
@@ -225,6 +400,17 @@ void AggNode::close(RuntimeState* state) {
     for (; _iter != _hash_map.end(); _iter++) {
         delete _iter->second;
     }
+    if (_use_fixed_key) {
+        for (; _fixed_pos < _fixed_hash_map.capacity();
+                _fixed_pos = _fixed_hash_map.next_used(_fixed_pos + 1)) {
+            delete _fixed_hash_map.value_at(_fixed_pos);
+            _fixed_hash_map.value_at(_fixed_pos) = nullptr;
+        }
+    }
+    if (_mem_tracker != nullptr) {
+        _mem_tracker->release(_mem_used);
+    }
+    _mem_used = 0;
 }
 void AggNode::transfer_pb(pb::PlanNode* pb_node) {
     ExecNode::transfer_pb(pb_node);
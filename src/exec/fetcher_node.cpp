@@ -23,12 +23,18 @@
 #include "insert_node.h"
 #include "network_socket.h"
 #include "schema_factory.h"
+#include "select_stream.h"
 #include "proto/store.interface.pb.h"
 
 namespace baikaldb {
+DECLARE_int64(sort_topn_max_limit);
 
 DEFINE_int32(retry_interval_us, 500 * 1000, "retry interval ");
 DEFINE_int32(single_store_concurrency, 20, "max request for one store");
+DEFINE_bool(fetcher_streaming_result, true, "select outputs rows as soon as regions respond");
+DEFINE_bool(fetcher_column_result, true, "store returns select result in column format attachment");
+DEFINE_int32(fetcher_stream_chunk_rows, 4096,
+        "store returns select result by stream in chunks of this many rows, 0 means one response");
 
 int FetcherNode::init(const pb::PlanNode& node) {
     int ret = 0;
@@ -106,6 +112,9 @@ int FetcherNode::send_request(
     for (auto& desc : state->tuple_descs()) {
         req.add_tuples()->CopyFrom(desc);
     }
+    if (_op_type == pb::OP_SELECT && FLAGS_fetcher_column_result) {
+        req.set_column_result(true);
+    }
 
     pb::TransactionInfo* txn_info = req.add_txn_infos();
     txn_info->set_txn_id(state->txn_id);
@@ -198,7 +207,20 @@ int FetcherNode::send_request(
                 addr.c_str(), ret, region_id, log_id);
         return -1;
     }
+    // select结果按chunk从stream返回, 不支持或者在事务中时store仍然整包回复
+    std::unique_ptr<SelectStreamReader> reader;
+    if (_op_type == pb::OP_SELECT && FLAGS_fetcher_stream_chunk_rows > 0) {
+        reader.reset(new SelectStreamReader);
+        if (reader->create(&cntl) == 0) {
+            req.set_stream_chunk_rows(FLAGS_fetcher_stream_chunk_rows);
+        } else {
+            reader.reset();
+        }
+    }
     pb::StoreService_Stub(&channel).query(&cntl, &req, &res, NULL);
+    if (reader != nullptr && (cntl.Failed() || !res.stream_result())) {
+        reader.reset();
+    }
 
     DB_WARNING("wait region_id: %ld version:%ld time:%ld log_id:%lu txn_id: %lu, ip:%s", 
             region_id, info.version(), cost.get_time(), log_id, state->txn_id,
@@ -339,26 +361,222 @@ int FetcherNode::send_request(
         std::lock_guard<std::mutex> lck(client_conn->region_lock);
         client_conn->region_infos[region_id].set_leader(res.leader());
     }
+    if (reader == nullptr) {
+        return add_select_result(state, info, res, cntl.response_attachment(), region_id, log_id);
+    }
+    // stream在有行返回给客户端之前断开(store重启, 超时等)时整个region重试
+    auto retry_broken_stream = [&](const pb::StoreRes& chunk) {
+        if (chunk.has_errcode() && chunk.errcode() != pb::SUCCESS) {
+            if (chunk.has_mysql_errcode()) {
+                state->error_code = (MysqlErrCode)chunk.mysql_errcode();
+                state->error_msg.str(chunk.errmsg());
+            }
+            return -1;
+        }
+        DB_WARNING("select stream broken, retry region_id:%ld, retry:%d, log_id:%lu",
+                region_id, retry_times, log_id);
+        reader.reset();
+        bthread_usleep(FLAGS_retry_interval_us);
+        return send_request(state, info, records, region_id, log_id, retry_times + 1, start_seq_id);
+    };
+    if (_streaming) {
+        // 第一个chunk在这里收, 之后的chunk在get_next时再读, 没读走的chunk由流控限制在少量几个
+        std::shared_ptr<RegionStream> stream = std::make_shared<RegionStream>();
+        stream->region_id = region_id;
+        pb::StoreRes chunk;
+        butil::IOBuf attachment;
+        bool eos = false;
+        ret = reader->next_chunk(&chunk, &attachment, &eos);
+        if (ret < 0) {
+            DB_WARNING("recv first chunk of select stream fail, region_id:%ld, log_id:%lu",
+                    region_id, log_id);
+            return retry_broken_stream(chunk);
+        }
+        ret = create_region_result(chunk, attachment, region_id, &stream->result);
+        if (ret < 0) {
+            DB_WARNING("parse region result fail, region_id:%ld, log_id:%lu", region_id, log_id);
+            return ret;
+        }
+        if (!eos) {
+            stream->reader = std::move(reader);
+        }
+        std::lock_guard<std::mutex> lck(_region_lock);
+        _region_streams[info.start_key()] = stream;
+        return 0;
+    }
+    // 每个chunk和整包的结果一样处理, 取走后store才继续写
     cost.reset();
-    std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
-    for (auto& pb_row : *res.mutable_row_values()) {
-        std::unique_ptr<MemRow> row = state->mem_row_desc()->fetch_mem_row();
-        for (int i = 0; i < res.tuple_ids_size(); i++) {
-            int32_t tuple_id = res.tuple_ids(i);
-            row->from_string(tuple_id, pb_row.tuple_values(i));
+    bool eos = false;
+    while (!eos) {
+        pb::StoreRes chunk;
+        butil::IOBuf attachment;
+        ret = reader->next_chunk(&chunk, &attachment, &eos);
+        if (ret < 0) {
+            DB_WARNING("recv select stream fail, region_id:%ld, log_id:%lu", region_id, log_id);
+            if (!reader->received()) {
+                return retry_broken_stream(chunk);
+            }
+            // 已经收到的行还在fetcher里时丢掉重来, 已经交出去的行无法撤回
+            if (!_topn && !_batch_handler) {
+                {
+                    std::lock_guard<std::mutex> lck(_region_lock);
+                    _region_batch.erase(region_id);
+                }
+                return retry_broken_stream(chunk);
+            }
+            if (chunk.has_mysql_errcode()) {
+                state->error_code = (MysqlErrCode)chunk.mysql_errcode();
+                state->error_msg.str(chunk.errmsg());
+            }
+            return -1;
         }
-        batch->move_row(std::move(row));
+        ret = add_select_result(state, info, chunk, attachment, region_id, log_id);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    DB_WARNING("recv select stream region:%ld time:%ld log_id:%lu",
+            region_id, cost.get_time(), log_id);
+    return 0;
+}
+
+int FetcherNode::add_select_result(RuntimeState* state, const pb::RegionInfo& info,
+        pb::StoreRes& res, butil::IOBuf& attachment, int64_t region_id, uint64_t log_id) {
+    TimeCost cost;
+    std::shared_ptr<RegionResult> result;
+    int ret = create_region_result(res, attachment, region_id, &result);
+    if (ret < 0) {
+        DB_WARNING("parse region result fail, region_id:%ld, log_id:%lu", region_id, log_id);
+        return ret;
+    }
+    if (_streaming) {
+        std::shared_ptr<RegionStream> stream = std::make_shared<RegionStream>();
+        stream->region_id = region_id;
+        stream->result = result;
+        std::lock_guard<std::mutex> lck(_region_lock);
+        _region_streams[info.start_key()] = stream;
+        return 0;
+    }
+    if (_batch_handler) {
+        return handle_region_rows(state, result.get(), region_id, log_id);
+    }
+    if (_topn) {
+        // 各region的行收到后直接进有界堆, 内存中最多保留limit行
+        while (!result->eof()) {
+            std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+            ret = decode_region_rows(state, result.get(), batch.get());
+            if (ret < 0) {
+                DB_WARNING("decode region rows fail, region_id:%ld, log_id:%lu",
+                        region_id, log_id);
+                return ret;
+            }
+            std::lock_guard<std::mutex> lck(_region_lock);
+            _sorter->add_batch(batch);
+        }
+        DB_WARNING("topn merge region:%ld time:%ld rows:%d log_id:%lu ",
+                region_id, cost.get_time(), result->rows, log_id);
+        return 0;
+    }
+    std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+    batch->set_capacity(std::max(batch->capacity(), (size_t)result->rows));
+    ret = decode_region_rows(state, result.get(), batch.get());
+    if (ret < 0) {
+        DB_WARNING("decode region rows fail, region_id:%ld, log_id:%lu", region_id, log_id);
+        return ret;
     }
     {
         std::lock_guard<std::mutex> lck(_region_lock);
         _start_key_sort[info.start_key()] = region_id;
-        _region_batch[region_id] = batch;
+        _region_batch[region_id].push_back(batch);
     }
     DB_WARNING("parse region:%ld time:%ld rows:%u log_id:%lu ", 
             region_id, cost.get_time(), batch->size(), log_id);
     return 0;
 }
 
+int FetcherNode::handle_region_rows(RuntimeState* state, RegionResult* result,
+        int64_t region_id, uint64_t log_id) {
+    TimeCost cost;
+    RowBatch batch;
+    while (!result->eof()) {
+        batch.clear();
+        int ret = decode_region_rows(state, result, &batch);
+        if (ret < 0) {
+            DB_WARNING("decode region rows fail, region_id:%ld, log_id:%lu", region_id, log_id);
+            return ret;
+        }
+        std::lock_guard<std::mutex> lck(_region_lock);
+        ret = _batch_handler(&batch);
+        if (ret < 0) {
+            DB_WARNING("handle batch fail, region_id:%ld, log_id:%lu", region_id, log_id);
+            return ret;
+        }
+    }
+    DB_WARNING("handle region:%ld time:%ld rows:%d log_id:%lu ",
+            region_id, cost.get_time(), result->rows, log_id);
+    return 0;
+}
+
+int FetcherNode::create_region_result(pb::StoreRes& res, butil::IOBuf& attachment,
+        int64_t region_id, std::shared_ptr<RegionResult>* result) {
+    result->reset(new RegionResult);
+    RegionResult* region_result = result->get();
+    region_result->region_id = region_id;
+    region_result->res = std::make_shared<pb::StoreRes>();
+    region_result->res->Swap(&res);
+    if (region_result->res->column_result()) {
+        region_result->decoder = std::make_shared<ColumnDecoder>();
+        int ret = region_result->decoder->init(attachment);
+        if (ret < 0) {
+            return ret;
+        }
+        region_result->rows = region_result->decoder->rows();
+    } else {
+        region_result->rows = region_result->res->row_values_size();
+    }
+    // 每个region的结果是有序的, 超过limit的行不会被输出, 不用解析
+    if (_limit > 0 && region_result->rows > _limit) {
+        region_result->rows = _limit;
+    }
+    return 0;
+}
+
+int FetcherNode::decode_region_rows(RuntimeState* state, RegionResult* result,
+        RowBatch* batch) {
+    if (result->decoder != nullptr) {
+        size_t n = std::min(batch->capacity() - batch->size(),
+                (size_t)(result->rows - result->next_row));
+        int32_t tuple_id = result->decoder->single_tuple_id();
+        int ret = 0;
+        if (batch->allow_columnar() && batch->size() == 0 && tuple_id >= 0
+                && state->get_tuple_desc(tuple_id) != nullptr) {
+            // 只有一个tuple时直接按列拷贝, 不用转成MemRow
+            ret = batch->init_columns(*state->get_tuple_desc(tuple_id));
+            if (ret == 0) {
+                ret = result->decoder->decode_columns(result->next_row, n, batch);
+            }
+        } else {
+            ret = result->decoder->decode_rows(state->mem_row_desc(), result->next_row, n, batch);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        result->next_row += n;
+        return 0;
+    }
+    pb::StoreRes& res = *result->res;
+    for (; result->next_row < result->rows && !batch->is_full(); ++result->next_row) {
+        std::unique_ptr<MemRow> row = state->mem_row_desc()->fetch_mem_row();
+        auto& pb_row = res.row_values(result->next_row);
+        for (int i = 0; i < res.tuple_ids_size(); i++) {
+            int32_t tuple_id = res.tuple_ids(i);
+            row->from_string(tuple_id, pb_row.tuple_values(i));
+        }
+        batch->move_row(std::move(row));
+    }
+    return 0;
+}
+
 int FetcherNode::push_cmd_to_cache(RuntimeState* state) {
     if (state->txn_id == 0) {
         return 0;
@@ -413,6 +631,14 @@ int FetcherNode::open(RuntimeState* state) {
         return -1;
     }
     _error = false;
+    //join分批下推in条件时会多次open
+    _store_cond.wait();
+    _region_batch.clear();
+    _start_key_sort.clear();
+    _region_streams.clear();
+    _streaming = false;
+    _stream_started = false;
+    _num_rows_returned = 0;
     //fetcher 的孩子运行在store上，可以认为无孩子
     for (auto expr : _slot_order_exprs) {
         ret = expr->open();
@@ -458,12 +684,20 @@ int FetcherNode::open(RuntimeState* state) {
         }
     }
 
-    BthreadCond store_cond; // 不同store发请全并发
+    // 不同store发请全并发
     _affected_rows = 0;
+    _streaming = _op_type == pb::OP_SELECT && !_batch_handler && FLAGS_fetcher_streaming_result
+            && FLAGS_fetcher_stream_chunk_rows > 0;
+    // 整包返回的有序结果带limit时用有界堆归并, 流式返回时每个region只解析一个batch
+    _topn = _op_type == pb::OP_SELECT && !_streaming && !_batch_handler
+            && _slot_order_exprs.size() > 0 && _limit > 0 && _limit <= FLAGS_sort_topn_max_limit;
+    if (_topn) {
+        _sorter->set_limit(_limit);
+    }
     for (auto& pair : send_region_ids_map) {
-        store_cond.increase();
-        auto store_thread = [this, state, pair, log_id, &store_cond]() {
-            ON_SCOPE_EXIT([&store_cond]{store_cond.decrease_signal();});
+        _store_cond.increase();
+        auto store_thread = [this, state, pair, log_id]() {
+            ON_SCOPE_EXIT([this]{_store_cond.decrease_signal();});
             BthreadCond cond(-FLAGS_single_store_concurrency); // 单store内并发数
             for (auto region_id : pair.second) {
                 // 这两个资源后续不会分配新的，因此不需要加锁
@@ -496,7 +730,7 @@ int FetcherNode::open(RuntimeState* state) {
         Bthread bth(&BTHREAD_ATTR_SMALL);
         bth.run(store_thread);
     }
-    store_cond.wait();
+    _store_cond.wait();
     if (_error) {
         DB_FATAL("fetcher node open fail, log_id:%lu, txn_id: %lu, seq_id: %d", 
             log_id, state->txn_id, state->seq_id);
@@ -505,14 +739,17 @@ int FetcherNode::open(RuntimeState* state) {
         }
         return -1;
     }
-    DB_WARNING("fetcher time:%ld, txn_id: %lu, log_id:%lu, batch_size:%lu", 
-            cost.get_time(), state->txn_id, log_id, _region_batch.size());
+    DB_WARNING("fetcher time:%ld, txn_id: %lu, log_id:%lu, batch_size:%lu, stream_size:%lu", 
+            cost.get_time(), state->txn_id, log_id, _region_batch.size(), _region_streams.size());
     // 默认按主键排序，也就是按region的key排序
-    if (_op_type == pb::OP_SELECT) {
+    if (_topn) {
+        _sorter->sort();
+    } else if (_op_type == pb::OP_SELECT && !_streaming) {
         for (auto& pair : _start_key_sort) {
-            auto& batch = _region_batch[pair.second];
-            if (batch != NULL && batch->size() != 0) {
-                _sorter->add_batch(batch);
+            for (auto& batch : _region_batch[pair.second]) {
+                if (batch != NULL && batch->size() != 0) {
+                    _sorter->add_batch(batch);
+                }
             }
         }
         // 无sort节点时不会排序，按顺序输出
@@ -529,7 +766,11 @@ int FetcherNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
         return 0;
     }
     int ret = 0;
-    ret = _sorter->get_next(batch, eos);
+    if (_streaming) {
+        ret = get_next_streaming(state, batch, eos);
+    } else {
+        ret = _sorter->get_next(batch, eos);
+    }
     if (ret < 0) {
         DB_WARNING("sort get_next fail");
         return ret;
@@ -538,11 +779,88 @@ int FetcherNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
     //DB_WARNING("_num_rows_returned:%ld", _num_rows_returned);
     if (reached_limit()) {
         *eos = true;
+        batch->keep_first_rows(batch->size() - (_num_rows_returned - _limit));
         _num_rows_returned = _limit;
         return 0;
     }
     return 0;
 }
+
+int FetcherNode::read_region_stream(RuntimeState* state, RegionStream* stream,
+        RowBatch* batch) {
+    while (true) {
+        if (stream->result != nullptr && !stream->result->eof()) {
+            return decode_region_rows(state, stream->result.get(), batch);
+        }
+        if (stream->reader == nullptr) {
+            return 0;
+        }
+        pb::StoreRes chunk;
+        butil::IOBuf attachment;
+        bool eos = false;
+        int ret = stream->reader->next_chunk(&chunk, &attachment, &eos);
+        if (ret < 0) {
+            DB_WARNING("recv select stream fail, region_id:%ld", stream->region_id);
+            if (chunk.has_mysql_errcode()) {
+                state->error_code = (MysqlErrCode)chunk.mysql_errcode();
+                state->error_msg.str(chunk.errmsg());
+            }
+            return -1;
+        }
+        ret = create_region_result(chunk, attachment, stream->region_id, &stream->result);
+        if (ret < 0) {
+            DB_WARNING("parse region result fail, region_id:%ld", stream->region_id);
+            return ret;
+        }
+        if (eos) {
+            stream->reader.reset();
+        }
+    }
+    return 0;
+}
+
+int FetcherNode::get_next_streaming(RuntimeState* state, RowBatch* batch, bool* eos) {
+    if (_slot_order_exprs.size() > 0) {
+        // 有序时每个region的第一个chunk到达后就可以开始堆归并, 每个region只解析一个batch
+        if (!_stream_started) {
+            TimeCost cost;
+            _stream_started = true;
+            for (auto& pair : _region_streams) {
+                RegionStream* stream = pair.second.get();
+                std::shared_ptr<RowBatch> first_batch = std::make_shared<RowBatch>();
+                int ret = read_region_stream(state, stream, first_batch.get());
+                if (ret < 0) {
+                    return ret;
+                }
+                _sorter->add_sorted_stream(first_batch, [this, state, stream](RowBatch* batch) {
+                    return read_region_stream(state, stream, batch);
+                });
+            }
+            DB_WARNING("fetcher streaming merge, first chunk time:%ld, region_size:%lu",
+                    cost.get_time(), _region_streams.size());
+            _sorter->merge_sort();
+        }
+        return _sorter->get_next(batch, eos);
+    }
+    // 无序时和整包返回一样按region的key顺序输出, 后面的region在读前面时继续接收
+    if (!_stream_started) {
+        _stream_started = true;
+        _stream_iter = _region_streams.begin();
+    }
+    while (_stream_iter != _region_streams.end()) {
+        int ret = read_region_stream(state, _stream_iter->second.get(), batch);
+        if (ret < 0) {
+            return ret;
+        }
+        if (batch->size() > 0) {
+            return 0;
+        }
+        // 当前region读完, 关闭stream
+        _stream_iter = _region_streams.erase(_stream_iter);
+    }
+    *eos = true;
+    return 0;
+}
 }
 
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
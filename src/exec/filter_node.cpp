@@ -146,6 +146,16 @@ inline bool FilterNode::need_copy(MemRow* row) {
     return true;
 }
 
+void FilterNode::filter_columns(RowBatch* batch) {
+    std::vector<uint32_t>* selection = batch->mutable_selection();
+    for (auto conjunct : _pruned_conjuncts) {
+        if (selection->empty()) {
+            break;
+        }
+        conjunct->filter_batch(batch->mutable_columns(), selection);
+    }
+}
+
 int FilterNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
     while (1) {
         if (batch->is_full()) {
@@ -159,6 +169,8 @@ int FilterNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
                 //TimeCost cost;
                 _child_row_batch.clear();
                 _child_row_batch.set_capacity(state->multiple_row_batch_capacity());
+                _child_row_batch.set_allow_columnar(true);
+                _child_filtered = false;
                 auto ret = _children[0]->get_next(state, &_child_row_batch, &_child_eos);
                 if (ret < 0) {
                     DB_WARNING_STATE(state, "_children get_next fail");
@@ -166,6 +178,29 @@ int FilterNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
                 }
                 //DB_WARNING_STATE(state, "_child_row_batch:%u %u", _child_row_batch.capacity(), _child_row_batch.size());
                 //DB_NOTICE("scan cost:%ld", cost.get_time());
+                _child_filtered = _child_pre_filtered;
+                if (_child_row_batch.is_columnar()) {
+                    // 列存只修改selection, 过滤掉的行不用构造MemRow
+                    if (!_child_filtered) {
+                        filter_columns(&_child_row_batch);
+                    }
+                    _child_filtered = true;
+                    if (_child_row_batch.size() > 0 && batch->allow_columnar() && batch->size() == 0) {
+                        if (_limit != -1) {
+                            _child_row_batch.keep_first_rows(_limit - _num_rows_returned);
+                        }
+                        _num_rows_returned += _child_row_batch.size();
+                        batch->swap(_child_row_batch);
+                        _child_row_batch.clear();
+                        *eos = _child_eos || reached_limit();
+                        return 0;
+                    }
+                    ret = _child_row_batch.materialize(state->mem_row_desc());
+                    if (ret < 0) {
+                        DB_WARNING_STATE(state, "materialize columnar batch fail");
+                        return ret;
+                    }
+                }
                 continue;
             }
         }
@@ -175,7 +210,7 @@ int FilterNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
             return 0;
         }
         std::unique_ptr<MemRow>& row = _child_row_batch.get_row();
-        if (need_copy(row.get())) {
+        if (_child_filtered || need_copy(row.get())) {
             batch->move_row(std::move(row));
             ++_num_rows_returned;
         }
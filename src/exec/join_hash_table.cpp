@@ -0,0 +1,132 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "join_hash_table.h"
+#include <functional>
+#include "slot_ref.h"
+#include "mut_table_key.h"
+
+namespace baikaldb {
+JoinHashTable::KeyType JoinHashTable::key_type(pb::PrimitiveType build_type,
+        pb::PrimitiveType probe_type) {
+    auto is_integer = [](pb::PrimitiveType type) {
+        return is_int(type) || type == pb::BOOL;
+    };
+    // uint64和有符号数混用时按bit比较会出错
+    if ((build_type == pb::UINT64) != (probe_type == pb::UINT64)) {
+        return KEY_STRING;
+    }
+    if (is_integer(build_type) && is_integer(probe_type)) {
+        return KEY_INT;
+    }
+    if ((is_integer(build_type) || is_double(build_type)) &&
+            (is_integer(probe_type) || is_double(probe_type))) {
+        return KEY_DOUBLE;
+    }
+    // 同类型的时间类型内部都是整数
+    if (build_type == probe_type && get_num_size(build_type) > 0) {
+        return KEY_INT;
+    }
+    return KEY_STRING;
+}
+
+void JoinHashTable::init(const std::vector<ExprNode*>& build_slots,
+        const std::vector<ExprNode*>& probe_slots) {
+    _build_slots = build_slots;
+    _probe_slots = probe_slots;
+    _key_types.clear();
+    _use_fixed_key = true;
+    for (size_t i = 0; i < _build_slots.size(); i++) {
+        KeyType type = key_type(_build_slots[i]->col_type(), _probe_slots[i]->col_type());
+        if (type == KEY_STRING) {
+            _use_fixed_key = false;
+        }
+        _key_types.push_back(type);
+    }
+    if (_use_fixed_key) {
+        _fixed_key.resize(_build_slots.size());
+        _fixed_map.init(_fixed_key.size());
+    }
+}
+
+bool JoinHashTable::encode_key(MemRow* row, bool is_build) {
+    const std::vector<ExprNode*>& slots = is_build ? _build_slots : _probe_slots;
+    if (_use_fixed_key) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            SlotRef* slot = static_cast<SlotRef*>(slots[i]);
+            ExprValue value = row->get_value(slot->tuple_id(), slot->slot_id());
+            if (value.is_null()) {
+                return false;
+            }
+            if (_key_types[i] == KEY_DOUBLE) {
+                double d = value.get_numberic<double>();
+                if (!is_double(value.type)) {
+                    //超过2^53的整数转double会丢精度, 不能精确转换的整数不会等于任何double
+                    if (d >= 9223372036854775808.0
+                            || (int64_t)d != value.get_numberic<int64_t>()) {
+                        return false;
+                    }
+                }
+                // -0.0 == 0.0
+                if (d == 0) {
+                    d = 0;
+                }
+                memcpy(&_fixed_key[i], &d, sizeof(d));
+            } else {
+                _fixed_key[i] = value.get_numberic<uint64_t>();
+            }
+        }
+        _key_hash = FixedKeyHashMap<std::vector<MemRow*>>::hash(
+                _fixed_key.data(), _fixed_key.size());
+        return true;
+    }
+    MutTableKey key;
+    for (auto slot_ref : slots) {
+        SlotRef* slot = static_cast<SlotRef*>(slot_ref);
+        ExprValue value = row->get_value(slot->tuple_id(), slot->slot_id());
+        if (value.is_null()) {
+            return false;
+        }
+        key.append_value(value.cast_to(pb::STRING));
+    }
+    _str_key.swap(key.data());
+    _key_hash = std::hash<std::string>()(_str_key);
+    return true;
+}
+
+void JoinHashTable::insert(MemRow* row) {
+    if (_use_fixed_key) {
+        bool inserted = false;
+        _fixed_map.seek_or_insert(_fixed_key.data(), _key_hash, &inserted)->push_back(row);
+        return;
+    }
+    _str_map[_str_key].push_back(row);
+}
+
+std::vector<MemRow*>* JoinHashTable::seek() {
+    if (_use_fixed_key) {
+        return _fixed_map.seek(_fixed_key.data(), _key_hash);
+    }
+    return _str_map.seek(_str_key);
+}
+
+void JoinHashTable::clear() {
+    if (_use_fixed_key) {
+        _fixed_map.init(_fixed_key.size());
+    }
+    _str_map.clear();
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -23,6 +23,16 @@
 #include "literal.h"
 
 namespace baikaldb {
+DEFINE_string(join_spill_dir, "", "directory of hash join spill files, "
+        "empty means baikaldb_spill under $TMPDIR(/tmp if unset)");
+DEFINE_int32(join_spill_partitions, 16, "partition number of hash join when spilling to disk");
+DEFINE_int32(join_spill_max_level, 3,
+        "max times a spilled partition is partitioned again when it alone exceeds memory limit");
+DEFINE_int32(join_in_batch_size, 2000,
+        "max distinct values of the first equal column pushed to inner table in one batch");
+DEFINE_int32(join_build_fetch_concurrency, 4,
+        "max inner batches fetched concurrently when inner table is the build table");
+
 int JoinNode::init(const pb::PlanNode& node) {
     int ret = 0;
     ret = ExecNode::init(node);
@@ -48,7 +58,6 @@ int JoinNode::init(const pb::PlanNode& node) {
     for (auto& tuple_id : join_node.right_tuple_ids()) {
         _right_tuple_ids.insert(tuple_id);
     }
-    _hash_map.init(12301);
     return 0;
 }
 int JoinNode::expr_optimize(std::vector<pb::TupleDescriptor>* tuple_descs) {
@@ -253,78 +262,51 @@ int JoinNode::open(RuntimeState* state) {
     }
     DB_WARNING("when join, outer join open(fetcher data), time_cost:%ld", join_time_cost.get_time());
     join_time_cost.reset();
-    //从左表中把全部数据拿出
-    ret = _fetcher_join_table(state, _outer_node, _outer_tuple_data);
+    //inner join时outer表为build表, 否则inner表为build表
+    bool outer_is_build = _join_type != pb::LEFT_JOIN && _join_type != pb::RIGHT_JOIN;
+    if (outer_is_build) {
+        _hash_table.init(_outer_equal_slot, _inner_equal_slot);
+    } else {
+        _hash_table.init(_inner_equal_slot, _outer_equal_slot);
+    }
+    //从左表中把全部数据拿出, 边拉取边检查内存, 超过上限后分区落盘
+    int64_t outer_rows = 0;
+    ret = _fetcher_outer_table(state, outer_is_build, &outer_rows);
     if (ret < 0) {
         DB_WARNING("ExecNode::join open fail when fetch left table");
         return ret;
     }
-    if (_outer_tuple_data.size() == 0) {
+    if (outer_rows == 0) {
         _outer_table_is_null = true;
         return 0;
     }
-    DB_WARNING("when join, fetch outer data size:%d, time_cost:%ld", 
-                _outer_tuple_data.size(), join_time_cost.get_time());
-    join_time_cost.reset();
-    _save_join_value(_outer_tuple_data, _outer_equal_slot);
-    DB_WARNING("when join, save join value, time_cost:%ld",
-                join_time_cost.get_time());
-    join_time_cost.reset();
-    std::vector<ExprNode*> in_exprs;
-    //驱动表表返回的join条件下推 todo
-    ret = _construct_in_condition(_inner_equal_slot, _outer_join_values, in_exprs);
-    if (ret < 0) {
-        DB_WARNING("ExecNode::create in condition for right table fail");
-        return ret;
-    }
-    DB_WARNING("when join, _construct_in_condition, time_cost:%ld",
-                join_time_cost.get_time());
-    join_time_cost.reset();
-    //表达式下推，下推的那个节点重新做索引选择，路由选择
-    _inner_node->predicate_pushdown(in_exprs);
-    if (in_exprs.size() > 0) {
-        DB_WARNING("inner node add filter node");
-        _inner_node->add_filter_node(in_exprs);
-    }
-    DB_WARNING("when join,  re predicate pushdown, time_cost:%ld",
-                join_time_cost.get_time());
+    _make_join_value_chunks();
+    DB_WARNING("when join, fetch outer data size:%ld, spilled:%d, chunk size:%lu, time_cost:%ld", 
+                outer_rows, _spilled, _join_value_chunks.size(), join_time_cost.get_time());
     join_time_cost.reset();
-
-    std::vector<ExecNode*> scan_nodes;
-    _inner_node->get_node(pb::SCAN_NODE, scan_nodes);
-    //重新做路由选择
-    for (auto& exec_node : scan_nodes) {
-        RocksdbScanNode* scan_node = static_cast<RocksdbScanNode*>(exec_node);
-        ExecNode* parent_node_ptr = scan_node->get_parent();
-        if (parent_node_ptr->get_node_type() == pb::WHERE_FILTER_NODE
-                || parent_node_ptr->get_node_type() == pb::TABLE_FILTER_NODE) {
-            auto get_slot_id = [state](int32_t tuple_id, int32_t field_id) ->
-                    int32_t {return state->get_slot_id(tuple_id, field_id);};
-            scan_node->clear_possible_indexes();
-            //索引选择
-            IndexSelector().index_selector(get_slot_id,
-                                            NULL,
-                                            scan_node, 
-                                            static_cast<FilterNode*>(parent_node_ptr),
-                                            NULL,
-                                            NULL);
-            //路由选择
-            PlanRouter().scan_plan_router(scan_node);
-            FetcherNode* related_fetcher_node = scan_node->
-                                                get_related_fetcher_node();
-            auto region_infos = scan_node->region_infos();
-            //更改scan_node对应的fethcer_node的region信息
-            related_fetcher_node->set_region_infos(region_infos);
+    if (_join_value_chunks.size() == 1) {
+        ret = _open_inner_chunk(state, _inner_node, 0);
+        if (ret < 0) {
+            return ret;
         }
-    }
-    DB_WARNING("when join, index_selector and scan plan, time_cost:%ld",
-                join_time_cost.get_time());
-    join_time_cost.reset();
-    //_inner_node->print_all_exec_node();
-    ret = _inner_node->open(state);
-    if (ret < 0) {
-        DB_WARNING("ExecNode::inner table open fial");
-        return -1;
+    } else if (_join_value_chunks.size() > 1) {
+        //多批时每批克隆一份inner子树, 在后台bthread中用独立的RuntimeState拉取
+        //子树上面加一个空的filter做根, 下推产生的filter节点都在克隆的子树内
+        _inner_plan.Clear();
+        pb::PlanNode* holder = _inner_plan.add_nodes();
+        holder->set_node_type(pb::TABLE_FILTER_NODE);
+        holder->set_num_children(1);
+        holder->set_limit(-1);
+        ExecNode::create_pb_plan(&_inner_plan, _inner_node);
+        //inner join时拉取下一批和probe当前批重叠;
+        //outer join时inner表是build表, 没有probe可重叠, 多批并发拉取
+        //事务内的select用同一个seq_id, 不并发
+        _max_fetching_chunks = 1;
+        if (!outer_is_build && state->txn_id == 0) {
+            _max_fetching_chunks = std::max(FLAGS_join_build_fetch_concurrency, 1);
+        }
+        _next_fetch_chunk = 0;
+        _start_chunk_fetches(state);
     }
     DB_WARNING("when join, _inner_node open(fetcher data), time_cost:%ld",
                 join_time_cost.get_time());
@@ -332,20 +314,42 @@ int JoinNode::open(RuntimeState* state) {
     if (_join_type == pb::LEFT_JOIN 
             || _join_type == pb::RIGHT_JOIN) {
         join_time_cost.reset();
-        ret = _fetcher_join_table(state, _inner_node, _inner_tuple_data);
+        ret = _fetcher_build_table(state, _inner_tuple_data);
         if (ret < 0) {
             DB_WARNING("fetcher inner node fail");
             return ret;
         }
-        DB_WARNING("when join, fetch inner data size:%d, time_cost:%ld", 
-                    _outer_tuple_data.size(), join_time_cost.get_time());
+        DB_WARNING("when join, fetch inner data size:%d, spilled:%d, time_cost:%ld", 
+                    _inner_tuple_data.size(), _spilled, join_time_cost.get_time());
         join_time_cost.reset();
-        _construct_hash_map(_inner_tuple_data, _inner_equal_slot);
+        if (_spilled) {
+            ret = _spill_probe_rows(state);
+            if (ret < 0) {
+                return ret;
+            }
+            ret = _load_partition(state, 0);
+            if (ret < 0) {
+                return ret;
+            }
+        } else {
+            _construct_hash_map(_inner_tuple_data);
+            _outer_iter = _outer_tuple_data.begin();
+        }
         DB_WARNING("when join, _construct_hash_map time_cost:%ld", join_time_cost.get_time());
-        _outer_iter = _outer_tuple_data.begin();
     } else {
         join_time_cost.reset();
-        _construct_hash_map(_outer_tuple_data, _outer_equal_slot);
+        if (_spilled) {
+            ret = _spill_probe_rows(state);
+            if (ret < 0) {
+                return ret;
+            }
+            ret = _load_partition(state, 0);
+            if (ret < 0) {
+                return ret;
+            }
+        } else {
+            _construct_hash_map(_outer_tuple_data);
+        }
         DB_WARNING("when join, _construct_hash_map time_cost:%ld", join_time_cost.get_time());
     } 
     return 0;
@@ -441,53 +445,550 @@ int JoinNode::_construct_in_condition(std::vector<ExprNode*>& slot_refs,
     return 0;
 }
 
-int JoinNode::_fetcher_join_table(RuntimeState* state, ExecNode* child_node,
-                                  std::vector<MemRow*>& tuple_data) {
+int JoinNode::_fetcher_outer_table(RuntimeState* state, bool is_build, int64_t* rows) {
     bool eos = false;
     do {
         RowBatch batch;
-        auto ret = child_node->get_next(state, &batch, &eos);
+        auto ret = _outer_node->get_next(state, &batch, &eos);
         if (ret < 0) {
             DB_WARNING("children:get_next fail:%d", ret);
             return ret;
         }
         for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+            MemRow* row = batch.get_row().get();
+            ++(*rows);
+            _save_join_value(row, _outer_equal_slot);
+            if (_spilled) {
+                ret = _spill_row(row, is_build);
+                if (ret < 0) {
+                    return ret;
+                }
+                continue;
+            }
+            _consume_memory(state, row->used_size());
+            _outer_tuple_data.push_back(batch.get_row().release());
+        }
+        if (!_spilled && state->mem_tracker()->exceeded()) {
+            ret = _start_spill(state, _outer_tuple_data, is_build);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    } while (!eos);
+    return 0;
+}
+
+int JoinNode::_fetcher_build_table(RuntimeState* state, std::vector<MemRow*>& tuple_data) {
+    bool eos = false;
+    do {
+        RowBatch batch;
+        auto ret = _next_inner_batch(state, &batch, &eos);
+        if (ret < 0) {
+            DB_WARNING("children:get_next fail:%d", ret);
+            return ret;
+        }
+        for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+            if (_spilled) {
+                ret = _spill_row(batch.get_row().get(), true);
+                if (ret < 0) {
+                    return ret;
+                }
+                continue;
+            }
+            _consume_memory(state, batch.get_row()->used_size());
             tuple_data.push_back(batch.get_row().release());
         }
+        if (!_spilled && state->mem_tracker()->exceeded()) {
+            ret = _start_spill(state, tuple_data, true);
+            if (ret < 0) {
+                return ret;
+            }
+        }
     } while (!eos);
     return 0;
 }
 
-void JoinNode::_construct_hash_map(const std::vector<MemRow*>& tuple_data, 
-                                  const std::vector<ExprNode*>& slot_refs) {
+void JoinNode::_consume_memory(RuntimeState* state, int64_t bytes) {
+    _mem_tracker = state->mem_tracker();
+    _mem_used += bytes;
+    _mem_tracker->consume(bytes);
+}
+
+void JoinNode::_release_memory() {
+    if (_mem_tracker != nullptr) {
+        _mem_tracker->release(_mem_used);
+    }
+    _mem_used = 0;
+}
+
+int JoinNode::_open_partitions(int level, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        auto build_file = std::make_shared<SpillFile>();
+        auto probe_file = std::make_shared<SpillFile>();
+        if (build_file->open_write(FLAGS_join_spill_dir) < 0
+                || probe_file->open_write(FLAGS_join_spill_dir) < 0) {
+            DB_WARNING("open join spill file fail");
+            return -1;
+        }
+        _build_files.push_back(build_file);
+        _probe_files.push_back(probe_file);
+        _partition_levels.push_back(level);
+    }
+    return 0;
+}
+
+int JoinNode::_start_spill(RuntimeState* state, std::vector<MemRow*>& rows, bool is_build) {
+    TimeCost cost;
+    if (_open_partitions(0, std::max(FLAGS_join_spill_partitions, 1)) < 0) {
+        return -1;
+    }
+    _spilled = true;
+    for (auto& row : rows) {
+        int ret = _spill_row(row, is_build);
+        if (ret < 0) {
+            return ret;
+        }
+        delete row;
+        row = nullptr;
+    }
+    DB_WARNING("join exceed memory limit:%ld, query_mem_used:%ld, spill %s rows:%lu, "
+            "time_cost:%ld", state->memory_limit(), state->mem_tracker()->used(),
+            is_build ? "build" : "probe", rows.size(), cost.get_time());
+    rows.clear();
+    _release_memory();
+    return 0;
+}
+
+//每次重新分区用不同的hash, 同一分区的行再分区时能被打散
+static uint64_t partition_hash(uint64_t hash, int level) {
+    if (level == 0) {
+        return hash >> 32;
+    }
+    hash ^= level * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+int JoinNode::_spill_row(MemRow* row, bool is_build) {
+    return _spill_row(row, is_build, 0, 0, _build_files.size());
+}
+
+int JoinNode::_spill_row(MemRow* row, bool is_build, int level, size_t begin, size_t count) {
+    size_t partition = begin;
+    if (_hash_table.encode_key(row, is_build)) {
+        partition = begin + partition_hash(_hash_table.key_hash(), level) % count;
+    } else if (is_build || _join_type == pb::INNER_JOIN) {
+        //等值列为null的行不会匹配, 只有外连接的probe行需要保留来补null
+        return 0;
+    }
+    auto& files = is_build ? _build_files : _probe_files;
+    return files[partition]->write_row(row, _mem_row_desc->tuple_size());
+}
+
+int JoinNode::_spill_probe_rows(RuntimeState* state) {
+    TimeCost cost;
+    int ret = 0;
+    if (_join_type == pb::INNER_JOIN) {
+        bool eos = false;
+        do {
+            RowBatch batch;
+            ret = _next_inner_batch(state, &batch, &eos);
+            if (ret < 0) {
+                DB_WARNING("children:get_next fail:%d", ret);
+                return ret;
+            }
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                ret = _spill_row(batch.get_row().get(), false);
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+        } while (!eos);
+    } else {
+        for (auto& row : _outer_tuple_data) {
+            ret = _spill_row(row, false);
+            if (ret < 0) {
+                return ret;
+            }
+            delete row;
+        }
+        _outer_tuple_data.clear();
+    }
+    for (size_t i = 0; i < _build_files.size(); i++) {
+        if (_build_files[i]->finish_write() < 0 || _probe_files[i]->finish_write() < 0) {
+            return -1;
+        }
+    }
+    DB_WARNING("when join, spill probe rows, time_cost:%ld", cost.get_time());
+    return 0;
+}
+
+int JoinNode::_repartition(RuntimeState* state, size_t partition) {
+    TimeCost cost;
+    int level = _partition_levels[partition] + 1;
+    size_t begin = _build_files.size();
+    size_t count = std::max(FLAGS_join_spill_partitions, 2);
+    if (_open_partitions(level, count) < 0) {
+        return -1;
+    }
+    int ret = 0;
+    size_t build_rows = _partition_rows.size();
+    for (auto row : _partition_rows) {
+        ret = _spill_row(row, true, level, begin, count);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    for (auto row : _partition_rows) {
+        delete row;
+    }
+    _partition_rows.clear();
+    _release_memory();
+    // build分区剩下的行和对应的probe分区都按新的hash写到子分区
+    for (int i = 0; i < 2; i++) {
+        bool is_build = (i == 0);
+        auto& file = is_build ? _build_files[partition] : _probe_files[partition];
+        bool eof = false;
+        while (!eof) {
+            RowBatch batch;
+            ret = file->read_batch(_mem_row_desc, &batch, batch.capacity(), &eof);
+            if (ret < 0) {
+                return ret;
+            }
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                ret = _spill_row(batch.get_row().get(), is_build, level, begin, count);
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+            if (is_build) {
+                build_rows += batch.size();
+            }
+        }
+        file.reset();
+    }
+    for (size_t i = begin; i < _build_files.size(); i++) {
+        if (_build_files[i]->finish_write() < 0 || _probe_files[i]->finish_write() < 0) {
+            return -1;
+        }
+    }
+    DB_WARNING("when join, partition:%lu exceed memory limit:%ld, build rows:%lu, "
+            "repartition to level:%d, time_cost:%ld", partition, state->memory_limit(),
+            build_rows, level, cost.get_time());
+    return 0;
+}
+
+int JoinNode::_load_partition(RuntimeState* state, size_t partition) {
+    while (true) {
+        _hash_table.clear();
+        for (auto row : _partition_rows) {
+            delete row;
+        }
+        _partition_rows.clear();
+        for (auto row : _outer_tuple_data) {
+            delete row;
+        }
+        _outer_tuple_data.clear();
+        _release_memory();
+        _hash_mapped_index = 0;
+        _partition_idx = partition;
+        bool eof = false;
+        bool too_large = false;
+        while (!eof) {
+            RowBatch batch;
+            int ret = _build_files[partition]->read_batch(_mem_row_desc, &batch,
+                    batch.capacity(), &eof);
+            if (ret < 0) {
+                return ret;
+            }
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                _consume_memory(state, batch.get_row()->used_size());
+                _partition_rows.push_back(batch.get_row().release());
+            }
+            //单个分区就超过内存上限时重新分区, 分区次数有上限, 避免同一个key的大量行反复分区
+            if (!eof && state->mem_tracker()->exceeded()
+                    && _partition_levels[partition] < FLAGS_join_spill_max_level) {
+                too_large = true;
+                break;
+            }
+        }
+        if (too_large) {
+            int ret = _repartition(state, partition);
+            if (ret < 0) {
+                return ret;
+            }
+            //子分区追加在最后, 当前分区已经清空
+            ++partition;
+            continue;
+        }
+        //读完即可删除文件
+        _build_files[partition].reset();
+        _construct_hash_map(_partition_rows);
+        if (_join_type == pb::INNER_JOIN) {
+            //inner表的分区在get_next中分批读取
+            _inner_row_batch.clear();
+            _child_eos = false;
+            return 0;
+        }
+        eof = false;
+        while (!eof) {
+            RowBatch batch;
+            int ret = _probe_files[partition]->read_batch(_mem_row_desc, &batch,
+                    batch.capacity(), &eof);
+            if (ret < 0) {
+                return ret;
+            }
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                _consume_memory(state, batch.get_row()->used_size());
+                _outer_tuple_data.push_back(batch.get_row().release());
+            }
+        }
+        _probe_files[partition].reset();
+        _outer_iter = _outer_tuple_data.begin();
+        DB_WARNING("when join, load partition:%lu, build rows:%lu, probe rows:%lu",
+                partition, _partition_rows.size(), _outer_tuple_data.size());
+        return 0;
+    }
+    return 0;
+}
+
+void JoinNode::_construct_hash_map(const std::vector<MemRow*>& tuple_data) {
     for (auto& mem_row : tuple_data) {
-        MutTableKey key;
-        _encode_hash_key(mem_row, slot_refs, key);
-        _hash_map[key.data()].push_back(mem_row);
+        if (_hash_table.encode_key(mem_row, true)) {
+            _hash_table.insert(mem_row);
+        }
     } 
 }
 
-void JoinNode::_save_join_value(const std::vector<MemRow*>& tuple_data,
-                                const std::vector<ExprNode*>& slot_refs) {
-    for (auto& mem_row : tuple_data) {
-        std::vector<ExprValue> join_values;
-        for (auto& slot_ref_expr : slot_refs) {
-            ExprValue value = mem_row->get_value(static_cast<SlotRef*>(slot_ref_expr)->tuple_id(), 
-                                             static_cast<SlotRef*>(slot_ref_expr)->slot_id());
-            join_values.push_back(value);
+void JoinNode::_save_join_value(MemRow* mem_row, const std::vector<ExprNode*>& slot_refs) {
+    //第一个等值列相同的值放在同一批, inner表的一行只会被一批的in条件选中
+    std::vector<ExprValue> join_values;
+    MutTableKey key;
+    for (auto& slot_ref_expr : slot_refs) {
+        ExprValue value = mem_row->get_value(static_cast<SlotRef*>(slot_ref_expr)->tuple_id(), 
+                                         static_cast<SlotRef*>(slot_ref_expr)->slot_id());
+        //null不会匹配任何行
+        if (value.is_null()) {
+            return;
         }
-        _outer_join_values.push_back(join_values);
+        key.append_value(value.cast_to(pb::STRING));
+        join_values.push_back(value);
+    }
+    if (!_join_keys.insert(key.data()).second) {
+        return;
     }
+    std::string first_value = join_values[0].get_string();
+    auto iter = _first_value_groups.find(first_value);
+    if (iter == _first_value_groups.end()) {
+        iter = _first_value_groups.emplace(first_value, _join_value_groups.size()).first;
+        _join_value_groups.emplace_back();
+    }
+    _join_value_groups[iter->second].push_back(join_values);
 }
 
-void JoinNode::_encode_hash_key(MemRow* row, 
-                     const std::vector<ExprNode*>& slot_ref_exprs,
-                     MutTableKey& key) {
-    for (auto& slot_ref_expr : slot_ref_exprs) {
-        ExprValue value = row->get_value(static_cast<SlotRef*>(slot_ref_expr)->tuple_id(), 
-                                         static_cast<SlotRef*>(slot_ref_expr)->slot_id());
-        key.append_value(value.cast_to(pb::STRING)); 
+void JoinNode::_make_join_value_chunks() {
+    //inner表里还有join时不能重复open, 只分一批
+    int64_t batch_size = FLAGS_join_in_batch_size;
+    if (_inner_node->get_node(pb::JOIN_NODE) != nullptr) {
+        batch_size = 0;
+    }
+    _join_value_chunks.clear();
+    int64_t distinct_values = 0;
+    for (auto& group : _join_value_groups) {
+        if (_join_value_chunks.empty() || (batch_size > 0 && distinct_values >= batch_size)) {
+            _join_value_chunks.emplace_back();
+            distinct_values = 0;
+        }
+        auto& chunk = _join_value_chunks.back();
+        chunk.insert(chunk.end(), group.begin(), group.end());
+        ++distinct_values;
+    }
+    _join_keys.clear();
+    _first_value_groups.clear();
+    _join_value_groups.clear();
+}
+
+ExecNode* JoinNode::_subtree_root(ExecNode* node) {
+    //下推时add_filter_node会在节点上面插入filter, 向上找到join下面真正的子树根
+    while (node->get_parent() != nullptr && node->get_parent() != this) {
+        node = node->get_parent();
+    }
+    return node;
+}
+
+int JoinNode::_open_inner_chunk(RuntimeState* state, ExecNode* inner_node, size_t chunk_idx) {
+    TimeCost cost;
+    std::vector<ExprNode*> in_exprs;
+    int ret = _construct_in_condition(_inner_equal_slot, _join_value_chunks[chunk_idx], in_exprs);
+    if (ret < 0) {
+        DB_WARNING("ExecNode::create in condition for right table fail");
+        return ret;
+    }
+    //表达式下推，下推的那个节点重新做索引选择，路由选择
+    inner_node->predicate_pushdown(in_exprs);
+    if (in_exprs.size() > 0) {
+        DB_WARNING("inner node add filter node");
+        inner_node->add_filter_node(in_exprs);
+    }
+    ExecNode* root = _subtree_root(inner_node);
+
+    std::vector<ExecNode*> scan_nodes;
+    root->get_node(pb::SCAN_NODE, scan_nodes);
+    //重新做路由选择
+    for (auto& exec_node : scan_nodes) {
+        RocksdbScanNode* scan_node = static_cast<RocksdbScanNode*>(exec_node);
+        ExecNode* parent_node_ptr = scan_node->get_parent();
+        if (parent_node_ptr->get_node_type() == pb::WHERE_FILTER_NODE
+                || parent_node_ptr->get_node_type() == pb::TABLE_FILTER_NODE) {
+            auto get_slot_id = [state](int32_t tuple_id, int32_t field_id) ->
+                    int32_t {return state->get_slot_id(tuple_id, field_id);};
+            scan_node->clear_possible_indexes();
+            //索引选择
+            IndexSelector().index_selector(get_slot_id,
+                                            NULL,
+                                            scan_node, 
+                                            static_cast<FilterNode*>(parent_node_ptr),
+                                            NULL,
+                                            NULL);
+            //路由选择
+            PlanRouter().scan_plan_router(scan_node);
+            FetcherNode* related_fetcher_node = scan_node->
+                                                get_related_fetcher_node();
+            auto region_infos = scan_node->region_infos();
+            //更改scan_node对应的fethcer_node的region信息
+            related_fetcher_node->set_region_infos(region_infos);
+        }
+    }
+    DB_WARNING("when join, push in chunk:%lu, values:%lu, time_cost:%ld",
+                chunk_idx, _join_value_chunks[chunk_idx].size(), cost.get_time());
+    ret = root->open(state);
+    if (ret < 0) {
+        DB_WARNING("ExecNode::inner table open fial");
+        return -1;
+    }
+    return 0;
+}
+
+int JoinNode::_clone_inner_tree(ExecNode** root) {
+    int ret = ExecNode::create_tree(_inner_plan, root);
+    if (ret < 0 || *root == nullptr) {
+        DB_WARNING("clone inner tree fail");
+        return -1;
+    }
+    //scan_node和fetcher_node的关联不在pb里, 按树结构重新关联
+    std::vector<ExecNode*> scan_nodes;
+    (*root)->get_node(pb::SCAN_NODE, scan_nodes);
+    for (auto& scan_node : scan_nodes) {
+        ExecNode* parent = scan_node->get_parent();
+        while (parent != nullptr && parent->get_node_type() != pb::FETCHER_NODE) {
+            parent = parent->get_parent();
+        }
+        if (parent == nullptr) {
+            DB_WARNING("no fetcher node above scan node");
+            return -1;
+        }
+        static_cast<RocksdbScanNode*>(scan_node)->set_related_fetcher_node(
+                static_cast<FetcherNode*>(parent));
     }
+    return 0;
+}
+
+int JoinNode::_fetch_inner_chunk(RuntimeState* state, size_t chunk_idx,
+                                 std::vector<std::shared_ptr<RowBatch>>* batches) {
+    ExecNode* root = nullptr;
+    int ret = _clone_inner_tree(&root);
+    if (ret < 0) {
+        ExecNode::destory_tree(root);
+        return ret;
+    }
+    ON_SCOPE_EXIT([&]() {
+        root->close(state);
+        ExecNode::destory_tree(root);
+    });
+    ret = _open_inner_chunk(state, root->children(0), chunk_idx);
+    if (ret < 0) {
+        return ret;
+    }
+    bool eos = false;
+    do {
+        std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+        ret = root->get_next(state, batch.get(), &eos);
+        if (ret < 0) {
+            DB_WARNING("children:get_next fail:%d", ret);
+            return ret;
+        }
+        if (batch->size() > 0) {
+            batches->push_back(batch);
+        }
+    } while (!eos);
+    return 0;
+}
+
+void JoinNode::_start_chunk_fetches(RuntimeState* state) {
+    while (_next_fetch_chunk < _join_value_chunks.size()
+            && _chunk_fetches.size() < _max_fetching_chunks) {
+        auto fetch = std::make_shared<InnerChunkFetch>();
+        fetch->chunk_idx = _next_fetch_chunk++;
+        fetch->state.init_sub_state(state);
+        fetch->cond.increase();
+        _chunk_fetches.push_back(fetch);
+        auto fetch_thread = [this, fetch]() {
+            fetch->ret = _fetch_inner_chunk(&fetch->state, fetch->chunk_idx, &fetch->batches);
+            fetch->cond.decrease_signal();
+        };
+        Bthread bth(&BTHREAD_ATTR_SMALL);
+        bth.run(fetch_thread);
+    }
+}
+
+void JoinNode::_wait_chunk_fetches() {
+    for (auto& fetch : _chunk_fetches) {
+        fetch->cond.wait();
+    }
+    _chunk_fetches.clear();
+}
+
+int JoinNode::_next_inner_batch(RuntimeState* state, RowBatch* batch, bool* eos) {
+    if (_join_value_chunks.empty()) {
+        //outer表的join值全是null
+        *eos = true;
+        return 0;
+    }
+    if (_join_value_chunks.size() == 1) {
+        return _subtree_root(_inner_node)->get_next(state, batch, eos);
+    }
+    while (_chunk_batch_idx >= _chunk_batches.size()) {
+        if (_chunk_fetches.empty()) {
+            *eos = true;
+            return 0;
+        }
+        TimeCost cost;
+        auto fetch = _chunk_fetches.front();
+        fetch->cond.wait();
+        _chunk_fetches.pop_front();
+        if (fetch->ret < 0) {
+            DB_WARNING("fetch inner chunk:%lu fail", fetch->chunk_idx);
+            state->error_code = fetch->state.error_code;
+            state->error_msg.str(fetch->state.error_msg.str());
+            return fetch->ret;
+        }
+        _chunk_batches.clear();
+        _chunk_batches.swap(fetch->batches);
+        _chunk_batch_idx = 0;
+        DB_WARNING("when join, switch to inner chunk:%lu, batch_size:%lu, wait_time:%ld",
+                fetch->chunk_idx, _chunk_batches.size(), cost.get_time());
+        //当前批交给probe/build, 同时发起后面批次的拉取
+        _start_chunk_fetches(state);
+    }
+    batch->swap(*_chunk_batches[_chunk_batch_idx]);
+    _chunk_batches[_chunk_batch_idx].reset();
+    ++_chunk_batch_idx;
+    *eos = false;
+    return 0;
 }
 
 int JoinNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
@@ -506,13 +1007,21 @@ int JoinNode::get_next_for_other_join(RuntimeState* state, RowBatch* batch, bool
     TimeCost get_next_time;
     while (1) {
         if (_outer_iter == _outer_tuple_data.end()) {
+            if (_spilled && _partition_idx + 1 < _build_files.size()) {
+                auto ret = _load_partition(state, _partition_idx + 1);
+                if (ret < 0) {
+                    return ret;
+                }
+                continue;
+            }
             DB_WARNING("when join, outer iter is end, time_cost:%ld", get_next_time.get_time());
             *eos = true;
             return 0;
         }
-        MutTableKey outer_key;
-        _encode_hash_key(*_outer_iter, _outer_equal_slot, outer_key);
-        auto inner_mem_rows = _hash_map.seek(outer_key.data());
+        std::vector<MemRow*>* inner_mem_rows = nullptr;
+        if (_hash_table.encode_key(*_outer_iter, false)) {
+            inner_mem_rows = _hash_table.seek();
+        }
         if (inner_mem_rows != NULL) {
             for (; _hash_mapped_index < inner_mem_rows->size(); ++_hash_mapped_index) {
                 if (reached_limit()) {
@@ -564,6 +1073,13 @@ int JoinNode::get_next_for_inner_join(RuntimeState* state, RowBatch* batch, bool
     TimeCost get_next_time;
     while (1) {
         if (_inner_row_batch.is_traverse_over()) {
+            if (_child_eos && _spilled && _partition_idx + 1 < _build_files.size()) {
+                auto ret = _load_partition(state, _partition_idx + 1);
+                if (ret < 0) {
+                    return ret;
+                }
+                continue;
+            }
             if (_child_eos) {
                 *eos = true;
                 DB_WARNING("when join, get next complete, child eos, time_cost:%ld", 
@@ -571,7 +1087,13 @@ int JoinNode::get_next_for_inner_join(RuntimeState* state, RowBatch* batch, bool
                 return 0;
             } else {
                 _inner_row_batch.clear();
-                auto ret = _inner_node->get_next(state, &_inner_row_batch, &_child_eos);
+                int ret = 0;
+                if (_spilled) {
+                    ret = _probe_files[_partition_idx]->read_batch(_mem_row_desc,
+                            &_inner_row_batch, _inner_row_batch.capacity(), &_child_eos);
+                } else {
+                    ret = _next_inner_batch(state, &_inner_row_batch, &_child_eos);
+                }
                 if (ret < 0) {
                     DB_WARNING("_children get_next fail");
                     return ret;
@@ -582,9 +1104,10 @@ int JoinNode::get_next_for_inner_join(RuntimeState* state, RowBatch* batch, bool
             }
         }
         std::unique_ptr<MemRow>& inner_mem_row = _inner_row_batch.get_row();
-        MutTableKey inner_key;
-        _encode_hash_key(inner_mem_row.get(), _inner_equal_slot, inner_key);
-        auto outer_mem_rows = _hash_map.seek(inner_key.data());
+        std::vector<MemRow*>* outer_mem_rows = nullptr;
+        if (_hash_table.encode_key(inner_mem_row.get(), false)) {
+            outer_mem_rows = _hash_table.seek();
+        }
         if (outer_mem_rows != NULL) {
             for (; _hash_mapped_index < outer_mem_rows->size(); ++_hash_mapped_index) {
                 if (reached_limit()) {
@@ -673,6 +1196,9 @@ int JoinNode:: _construct_null_result_batch(RowBatch* batch, MemRow* outer_mem_r
 }
 
 void JoinNode::close(RuntimeState* state) {
+    //limit提前结束时等待后台拉取完成
+    _wait_chunk_fetches();
+    _chunk_batches.clear();
     for (auto expr : _conditions) {
         expr->close();
     }
@@ -682,6 +1208,10 @@ void JoinNode::close(RuntimeState* state) {
     for (auto& mem_row : _inner_tuple_data) {
         delete mem_row;
     }
+    for (auto& mem_row : _partition_rows) {
+        delete mem_row;
+    }
+    _release_memory();
 }
  
 }//namespace
@@ -15,8 +15,14 @@
 #include "packet_node.h"
 #include "runtime_state.h"
 #include "network_socket.h"
+#include "hll_common.h"
 
 namespace baikaldb {
+DEFINE_int64(result_flush_size, 1024 * 1024LL,
+        "send packed rows to client when send buf exceeds it, 0 means send after query finished");
+DEFINE_int32(result_flush_timeout_ms, 600 * 1000, "max time waiting for client to receive rows");
+DEFINE_int64(send_buf_segment_size, 256 * 1024LL,
+        "packed rows are sealed into a new send buf segment past this size");
 int PacketNode::init(const pb::PlanNode& node) {
     int ret = 0;
     ret = ExecNode::init(node);
@@ -78,6 +84,7 @@ int PacketNode::open(RuntimeState* state) {
     }
     _send_buf = state->send_buf();
     _wrapper = MysqlWrapper::get_instance();
+    _binary_protocol = state->binary_protocol();
     state->set_num_affected_rows(ret);
     if (op_type() != pb::OP_SELECT) {
         if (op_type() == pb::OP_INSERT) {
@@ -99,21 +106,40 @@ int PacketNode::open(RuntimeState* state) {
     pack_fields();
     if (_children.size() == 0) {
         if (!reached_limit()) {
-            pack_row(nullptr);
+            if (_binary_protocol) {
+                pack_binary_row(nullptr);
+            } else {
+                pack_row(nullptr);
+            }
         }
     } else {
         bool eos = false;
         int64_t pack_time = 0;
         do {
             RowBatch batch;
+            batch.set_allow_columnar(true);
             ret = _children[0]->get_next(state, &batch, &eos);
             if (ret < 0) {
                 DB_WARNING("children:get_next fail:%d", ret);
                 return ret;
             }
+            // 列存batch直接在列上计算projection
+            bool is_columnar = batch.is_columnar();
+            MemRow column_row(0);
             for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
                 TimeCost cost;
-                ret = pack_row(batch.get_row().get());
+                MemRow* row = nullptr;
+                if (is_columnar) {
+                    column_row.bind_column_row(batch.mutable_columns(), batch.column_row());
+                    row = &column_row;
+                } else {
+                    row = batch.get_row().get();
+                }
+                if (_binary_protocol) {
+                    ret = pack_binary_row(row);
+                } else {
+                    ret = pack_row(row);
+                }
                 pack_time += cost.get_time();
                 cost.reset();
                 state->inc_num_returned_rows(1);
@@ -121,6 +147,17 @@ int PacketNode::open(RuntimeState* state) {
                     DB_WARNING("pack_row fail:%d", ret);
                     return ret;
                 }
+                if (FLAGS_result_flush_size > 0
+                        && (int64_t)_send_buf->total_size() >= FLAGS_result_flush_size) {
+                    ret = flush(state);
+                    if (ret < 0) {
+                        return ret;
+                    }
+                }
+                if (!_send_buf->byte_array_seal(FLAGS_send_buf_segment_size)) {
+                    DB_WARNING("seal send buf failed");
+                    return -1;
+                }
             }
         } while (!eos);
         DB_WARNING("txn_id: %lu, pack_time: %ld", state->txn_id, pack_time);
@@ -136,8 +173,25 @@ void PacketNode::close(RuntimeState* state) {
     }
 }
 
+int PacketNode::flush(RuntimeState* state) {
+    NetworkSocket* client = state->client_conn();
+    if (client == nullptr) {
+        return 0;
+    }
+    state->set_result_flushed();
+    int ret = _wrapper->flush_write(client, FLAGS_result_flush_timeout_ms);
+    if (ret != RET_SUCCESS) {
+        DB_WARNING("flush result failed, ret: %d, fd: %d, txn_id: %lu",
+                ret, client->fd, state->txn_id);
+        state->error_code = ER_NET_ERROR_ON_WRITE;
+        state->error_msg << "send result to client failed";
+        return -1;
+    }
+    return 0;
+}
+
 int PacketNode::pack_ok(int num_affected_rows, int64_t last_insert_id) {
-    if (_send_buf->_size > 0) {
+    if (_send_buf->total_size() > 0) {
         _send_buf->byte_array_clear();
     }
 
@@ -218,6 +272,130 @@ int PacketNode::pack_row(MemRow* row) {
     return 0;
 }
 
+int PacketNode::pack_binary_row(MemRow* row) {
+    ++_packet_id;
+    int start_pos = _send_buf->_size;
+    uint8_t bytes[4];
+    bytes[0] = '\x01';
+    bytes[1] = '\x00';
+    bytes[2] = '\x00';
+    bytes[3] = _packet_id & 0xff;
+    if (!_send_buf->byte_array_append_len(bytes, 4)) {
+        DB_FATAL("Failed to append len. value:[%s], len:[1]", bytes);
+        return -1;
+    }
+    // header 0x00, null bitmap的offset为2
+    std::string null_bitmap((_projections.size() + 7 + 2) / 8 + 1, '\0');
+    if (!_send_buf->byte_array_append_len((const uint8_t*)null_bitmap.data(),
+                null_bitmap.size())) {
+        DB_FATAL("Failed to append null bitmap.");
+        return -1;
+    }
+    int bitmap_pos = start_pos + 4 + 1;
+    for (size_t i = 0; i < _projections.size(); i++) {
+        auto expr = _projections[i];
+        ExprValue value = expr->get_value(row).cast_to(expr->col_type());
+        if (value.is_null()) {
+            _send_buf->_data[bitmap_pos + (i + 2) / 8] |= (1 << ((i + 2) % 8));
+            continue;
+        }
+        if (append_binary_value(value, _fields[i].type) < 0) {
+            DB_FATAL("Failed to append table cell.");
+            return -1;
+        }
+    }
+    int packet_body_len = _send_buf->_size - start_pos - 4;
+    _send_buf->_data[start_pos] = packet_body_len & 0xff;
+    _send_buf->_data[start_pos + 1] = (packet_body_len >> 8) & 0xff;
+    _send_buf->_data[start_pos + 2] = (packet_body_len >> 16) & 0xff;
+    return 0;
+}
+
+int PacketNode::append_binary_value(const ExprValue& value, int32_t mysql_type) {
+    uint8_t bytes[12];
+    switch (mysql_type) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG: {
+            uint64_t num = 0;
+            if (value.type == pb::HLL) {
+                num = hll::hll_estimate(value);
+            } else {
+                num = value.get_numberic<uint64_t>();
+            }
+            int len = 8;
+            if (mysql_type == MYSQL_TYPE_TINY) {
+                len = 1;
+            } else if (mysql_type == MYSQL_TYPE_SHORT) {
+                len = 2;
+            } else if (mysql_type == MYSQL_TYPE_LONG) {
+                len = 4;
+            }
+            for (int i = 0; i < len; i++) {
+                bytes[i] = (num >> (i * 8)) & 0xff;
+            }
+            return _send_buf->byte_array_append_len(bytes, len) ? 0 : -1;
+        }
+        case MYSQL_TYPE_FLOAT: {
+            float num = value.get_numberic<float>();
+            return _send_buf->byte_array_append_len((const uint8_t*)&num, 4) ? 0 : -1;
+        }
+        case MYSQL_TYPE_DOUBLE: {
+            double num = value.get_numberic<double>();
+            return _send_buf->byte_array_append_len((const uint8_t*)&num, 8) ? 0 : -1;
+        }
+        case MYSQL_TYPE_DATETIME:
+        case MYSQL_TYPE_TIMESTAMP:
+        case MYSQL_TYPE_DATE: {
+            // 格式: 长度(0/4/7/11), year(2), month, day, hour, minute, second, microsecond(4)
+            uint64_t datetime = ExprValue(value).cast_to(pb::DATETIME)._u.uint64_val;
+            int year_month = ((datetime >> 46) & 0x1FFFF);
+            int year = year_month / 13;
+            uint32_t macrosec = (datetime & 0xFFFFFF);
+            bytes[1] = year & 0xff;
+            bytes[2] = (year >> 8) & 0xff;
+            bytes[3] = year_month % 13;
+            bytes[4] = ((datetime >> 41) & 0x1F);
+            bytes[5] = ((datetime >> 36) & 0x1F);
+            bytes[6] = ((datetime >> 30) & 0x3F);
+            bytes[7] = ((datetime >> 24) & 0x3F);
+            for (int i = 0; i < 4; i++) {
+                bytes[8 + i] = (macrosec >> (i * 8)) & 0xff;
+            }
+            bytes[0] = 11;
+            if (macrosec == 0) {
+                bytes[0] = 7;
+                if (mysql_type == MYSQL_TYPE_DATE
+                        || (bytes[5] == 0 && bytes[6] == 0 && bytes[7] == 0)) {
+                    bytes[0] = 4;
+                }
+            }
+            return _send_buf->byte_array_append_len(bytes, bytes[0] + 1) ? 0 : -1;
+        }
+        case MYSQL_TYPE_TIME: {
+            // 格式: 长度(0/8/12), is_negative, days(4), hour, minute, second, microsecond(4)
+            int32_t time = ExprValue(value).cast_to(pb::TIME)._u.int32_val;
+            memset(bytes, 0, sizeof(bytes));
+            if (time < 0) {
+                bytes[1] = 1;
+                time = -time;
+            }
+            int hour = (time >> 12) & 0x3FF;
+            // days在bytes[2..5]
+            bytes[2] = (hour / 24) & 0xff;
+            bytes[6] = hour % 24;
+            bytes[7] = (time >> 6) & 0x3F;
+            bytes[8] = time & 0x3F;
+            bytes[0] = 8;
+            return _send_buf->byte_array_append_len(bytes, bytes[0] + 1) ? 0 : -1;
+        }
+        default:
+            // 其他类型同text protocol, length coded string
+            return _send_buf->pack_length_coded_string(value.get_string(), false) ? 0 : -1;
+    }
+}
+
 int PacketNode::pack_eof() {
     ++_packet_id;
     _wrapper->make_eof_packet(_send_buf, _packet_id);
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <map>
+#include <algorithm>
 #include "rocksdb_scan_node.h"
 #include "filter_node.h"
 #include "join_node.h"
@@ -21,8 +22,16 @@
 #include "slot_ref.h"
 #include "runtime_state.h"
 #include "parser.h"
+#include "tuple_record.h"
 
 namespace baikaldb {
+DEFINE_bool(scan_use_columnar_batch, true, "rocksdb scan node output columnar row batch when parent accept");
+DEFINE_int32(parallel_scan_concurrency, 8, "max bthreads to scan one region's table or index range, 1 means off");
+DEFINE_int64(parallel_scan_min_bytes, 256 * 1024 * 1024LL,
+        "min approximate table size in a region to use parallel scan");
+DEFINE_int32(index_lookup_batch_size, 256, "primary keys per MultiGet when looking up table by secondary index");
+DEFINE_int32(parallel_scan_queue_batches, 4, "max buffered batches of each parallel scan bthread");
+
 int RocksdbScanNode::select_index(RuntimeState* state, 
                            const pb::PlanNode& node, 
                            std::vector<int>& multi_reverse_index) {
@@ -414,6 +423,12 @@ int RocksdbScanNode::open(RuntimeState* state) {
 }
 
 int RocksdbScanNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
+    if (FLAGS_scan_use_columnar_batch && batch->allow_columnar() && batch->size() == 0) {
+        if (batch->init_columns(*_tuple_desc) < 0) {
+            DB_WARNING_STATE(state, "init columns fail, tuple_id:%d", _tuple_id);
+            return -1;
+        }
+    }
     if (_index_id == _table_id) {
         if (_use_get) {
             return get_next_by_table_get(state, batch, eos);
@@ -423,6 +438,9 @@ int RocksdbScanNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
     } else {
         if (_use_get) {
             return get_next_by_index_get(state, batch, eos);
+        } else if (!_is_covering_index && _reverse_indexes.empty() && _reverse_index == nullptr
+                && FLAGS_index_lookup_batch_size > 1) {
+            return get_next_by_index_lookup(state, batch, eos);
         } else {
             return get_next_by_index_seek(state, batch, eos);
         }
@@ -431,12 +449,33 @@ int RocksdbScanNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
 }
 
 void RocksdbScanNode::close(RuntimeState* state) {
+    stop_parallel_scan();
+    _lookup_cond.wait();
     ScanNode::close(state);
     for (auto expr : _index_conjuncts) {
         expr->close();
     }
 }
 
+void RocksdbScanNode::append_record(RowBatch* batch, SmartRecord& record) {
+    if (batch->is_columnar()) {
+        ColumnBatch* columns = batch->mutable_columns();
+        for (int i = 0; i < _tuple_desc->slots_size(); i++) {
+            auto field = record->get_field_by_tag(_tuple_desc->slots(i).field_id());
+            columns->column(i).append_value(record->get_value(field));
+        }
+        batch->add_column_row();
+        return;
+    }
+    std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+    for (auto& slot : _tuple_desc->slots()) {
+        auto field = record->get_field_by_tag(slot.field_id());
+        row->set_value(slot.tuple_id(), slot.slot_id(),
+                record->get_value(field));
+    }
+    batch->move_row(std::move(row));
+}
+
 int RocksdbScanNode::get_next_by_table_get(RuntimeState* state, RowBatch* batch, bool* eos) {
     auto txn = state->txn();
     if (txn == nullptr) {
@@ -464,13 +503,7 @@ int RocksdbScanNode::get_next_by_table_get(RuntimeState* state, RowBatch* batch,
                     _table_id, ret, record->to_string().c_str());
             continue;
         }
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
-        for (auto slot : _tuple_desc->slots()) {
-            auto field = record->get_field_by_tag(slot.field_id());
-            row->set_value(slot.tuple_id(), slot.slot_id(),
-                    record->get_value(field));
-        }
-        batch->move_row(std::move(row));
+        append_record(batch, record);
         ++_num_rows_returned;
     }
 }
@@ -507,18 +540,21 @@ int RocksdbScanNode::get_next_by_index_get(RuntimeState* state, RowBatch* batch,
             }
         }
 
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
-        for (auto slot : _tuple_desc->slots()) {
-            auto field = record->get_field_by_tag(slot.field_id());
-            row->set_value(slot.tuple_id(), slot.slot_id(),
-                    record->get_value(field));
-        }
-        batch->move_row(std::move(row));
+        append_record(batch, record);
         ++_num_rows_returned;
     }
 }
 
 int RocksdbScanNode::get_next_by_table_seek(RuntimeState* state, RowBatch* batch, bool* eos) {
+    if (!_parallel_checked) {
+        _parallel_checked = true;
+        if (need_parallel_scan(state) && start_parallel_scan(state, batch->is_columnar()) == 0) {
+            _parallel_scan = true;
+        }
+    }
+    if (_parallel_scan) {
+        return get_next_by_parallel_seek(state, batch, eos);
+    }
     SmartRecord record = _factory->new_record(*_table_info);
     int64_t time = 0;
     while (1) {
@@ -543,8 +579,12 @@ int RocksdbScanNode::get_next_by_table_seek(RuntimeState* state, RowBatch* batch
                         _right_field_cnts[_idx], 
                         _left_opens[_idx], 
                         _right_opens[_idx]);
+                //没有limit的全region扫描走预读, 不污染block cache
+                bool bulk_scan = _limit == -1 && _left_field_cnts[_idx] == 0
+                        && _right_field_cnts[_idx] == 0;
                 delete _table_iter;
-                _table_iter = Iterator::scan_primary(state->txn(), range, _field_ids, true, _scan_forward);
+                _table_iter = Iterator::scan_primary(state->txn(), range, _field_ids, true,
+                        _scan_forward, bulk_scan);
                 if (_table_iter == nullptr) {
                     DB_WARNING_STATE(state, "open TableIterator fail, table_id:%ld", _index_id);
                     return -1;
@@ -563,19 +603,574 @@ int RocksdbScanNode::get_next_by_table_seek(RuntimeState* state, RowBatch* batch
         }
         TimeCost cost;
         //DB_WARNING_STATE(state, "get_next:%lu", cost.get_time());
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
-        for (auto slot : _tuple_desc->slots()) {
-            auto field = record->get_field_by_tag(slot.field_id());
-            row->set_value(slot.tuple_id(), slot.slot_id(),
-                    record->get_value(field));
-        }
-        batch->move_row(std::move(row));
+        append_record(batch, record);
         ++_num_rows_returned;
         time += cost.get_time();
     }
 }
 
+bool RocksdbScanNode::need_parallel_scan(RuntimeState* state) {
+    if (FLAGS_parallel_scan_concurrency <= 1 || !_scan_forward || _limit != -1 ||
+            _left_records.size() != 1) {
+        return false;
+    }
+    // 倒排索引不按key区间扫描
+    if (!_reverse_indexes.empty() || _reverse_index != nullptr) {
+        return false;
+    }
+    // 并行扫描读的是新建的snapshot, 事务里的查询要和事务读到的数据一致, 只能顺序扫描
+    if (state->txn_id != 0) {
+        return false;
+    }
+    auto txn = state->txn();
+    if (txn != nullptr && txn->get_txn() != nullptr &&
+            (txn->get_txn()->GetNumPuts() > 0 || txn->get_txn()->GetNumDeletes() > 0)) {
+        return false;
+    }
+    return true;
+}
+
+// 取key从pos开始的8字节作为整数, 不足的补0
+static uint64_t key_window(const std::string& key, size_t pos) {
+    uint64_t val = 0;
+    for (size_t i = pos; i < pos + sizeof(uint64_t); i++) {
+        val <<= 8;
+        if (i < key.size()) {
+            val |= (uint8_t)key[i];
+        }
+    }
+    return val;
+}
+
+// 取lower < mid < upper的中间key, 区间太小切不开时返回false
+static bool middle_key(const std::string& lower, const std::string& upper, std::string* mid) {
+    size_t pos = 0;
+    while (pos < lower.size() && pos < upper.size() && lower[pos] == upper[pos]) {
+        ++pos;
+    }
+    uint64_t low = key_window(lower, pos);
+    uint64_t high = key_window(upper, pos);
+    if (high <= low || high - low < 2) {
+        return false;
+    }
+    uint64_t val = low + (high - low) / 2;
+    mid->assign(lower, 0, pos);
+    for (int i = sizeof(uint64_t) - 1; i >= 0; i--) {
+        mid->push_back((char)(val >> (i * 8)));
+    }
+    return true;
+}
+
+static int clone_conjuncts(const std::vector<ExprNode*>& conjuncts,
+        std::vector<ExprNode*>* clones) {
+    for (auto conjunct : conjuncts) {
+        pb::Expr pb_expr;
+        ExprNode::create_pb_expr(&pb_expr, conjunct);
+        ExprNode* expr = nullptr;
+        if (ExprNode::create_tree(pb_expr, &expr) < 0 || expr == nullptr) {
+            return -1;
+        }
+        clones->push_back(expr);
+        if (expr->open() < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 每次把估算数据量最大的一段按key二分, 再按数据量把小段合并成concurrency段
+// 只用到本区间的sst索引, 代价和db里的文件总数无关
+void RocksdbScanNode::split_scan_range(const std::string& lower, const std::string& upper,
+        size_t concurrency, std::vector<std::string>* bounds) {
+    struct Piece {
+        std::string begin;
+        std::string end;
+        uint64_t size;
+        bool splittable;
+    };
+    RocksWrapper* db = RocksWrapper::get_instance();
+    auto approximate_size = [db](const std::string& begin, const std::string& end) -> uint64_t {
+        rocksdb::Range range(begin, end);
+        uint64_t size = 0;
+        db->get_db()->GetApproximateSizes(db->get_data_handle(), &range, 1, &size);
+        return size;
+    };
+    std::vector<Piece> pieces;
+    pieces.push_back({lower, upper, approximate_size(lower, upper), true});
+    uint64_t total = pieces[0].size;
+    if (total == 0) {
+        return;
+    }
+    for (size_t i = 0; i < concurrency * 8; i++) {
+        size_t max_idx = pieces.size();
+        for (size_t j = 0; j < pieces.size(); j++) {
+            if (pieces[j].splittable && (max_idx == pieces.size() ||
+                    pieces[j].size > pieces[max_idx].size)) {
+                max_idx = j;
+            }
+        }
+        // 每段都不超过目标大小的一半时已经足够均匀
+        if (max_idx == pieces.size() || pieces[max_idx].size * concurrency * 2 <= total) {
+            break;
+        }
+        Piece& piece = pieces[max_idx];
+        std::string mid;
+        if (!middle_key(piece.begin, piece.end, &mid)) {
+            piece.splittable = false;
+            continue;
+        }
+        Piece right = {mid, piece.end, approximate_size(mid, piece.end), true};
+        piece.end = mid;
+        piece.size = approximate_size(piece.begin, mid);
+        pieces.insert(pieces.begin() + max_idx + 1, right);
+    }
+    uint64_t accumulated = 0;
+    for (size_t i = 0; i + 1 < pieces.size() && bounds->size() + 1 < concurrency; i++) {
+        accumulated += pieces[i].size;
+        if (accumulated * concurrency >= total * (bounds->size() + 1)) {
+            bounds->push_back(pieces[i].end);
+        }
+    }
+}
+
+int RocksdbScanNode::start_parallel_scan(RuntimeState* state, bool columnar) {
+    RocksWrapper* db = RocksWrapper::get_instance();
+    MutTableKey prefix;
+    MutTableKey prefix_end;
+    prefix.append_i64(_region_id).append_i64(_index_id);
+    prefix_end.append_i64(_region_id).append_i64(_index_id + 1);
+    rocksdb::Range range(prefix.data(), prefix_end.data());
+    uint64_t size = 0;
+    db->get_db()->GetApproximateSizes(db->get_data_handle(), &range, 1, &size);
+    if (size < (uint64_t)FLAGS_parallel_scan_min_bytes) {
+        return -1;
+    }
+    // 主表key在region的[start_key, end_key)内, 二级索引在整个索引前缀内
+    std::string lower = prefix.data();
+    std::string upper = prefix_end.data();
+    if (_index_id == _table_id) {
+        lower += _region_info->start_key();
+        if (!_region_info->end_key().empty()) {
+            upper = prefix.data() + _region_info->end_key();
+        }
+    }
+    std::vector<std::string> bounds;
+    split_scan_range(lower, upper, FLAGS_parallel_scan_concurrency, &bounds);
+    size_t concurrency = bounds.size() + 1;
+    if (concurrency <= 1) {
+        return -1;
+    }
+    // 上层是filter时在worker里过滤, 主线程只做合并
+    FilterNode* filter = nullptr;
+    ExecNode* parent = get_parent();
+    if (parent != nullptr && (parent->node_type() == pb::TABLE_FILTER_NODE ||
+            parent->node_type() == pb::WHERE_FILTER_NODE)) {
+        filter = static_cast<FilterNode*>(parent);
+    }
+    std::string begin;
+    for (size_t i = 0; i < concurrency; i++) {
+        std::unique_ptr<SubRangeScan> sub(new SubRangeScan);
+        sub->begin = begin;
+        if (i < bounds.size()) {
+            sub->end = bounds[i];
+        }
+        begin = sub->end;
+        if ((filter != nullptr && clone_conjuncts(filter->pruned_conjuncts(), &sub->conjuncts) < 0)
+                || clone_conjuncts(_index_conjuncts, &sub->index_conjuncts) < 0) {
+            DB_WARNING_STATE(state, "clone conjuncts fail, table_id:%ld", _table_id);
+            _sub_scans.clear();
+            return -1;
+        }
+        _sub_scans.push_back(std::move(sub));
+    }
+    if (filter != nullptr) {
+        filter->set_child_filtered();
+    }
+    _snapshot = db->get_db()->GetSnapshot();
+    for (auto& sub : _sub_scans) {
+        SubRangeScan* sub_scan = sub.get();
+        _scan_worker_cond.increase();
+        Bthread bth(&BTHREAD_ATTR_SMALL);
+        bth.run([this, sub_scan, columnar]() {
+            scan_sub_range(sub_scan, columnar);
+            _scan_worker_cond.decrease_signal();
+        });
+    }
+    DB_WARNING_STATE(state, "parallel scan, table_id:%ld, index_id:%ld, approximate size:%lu, "
+            "concurrency:%lu", _table_id, _index_id, size, concurrency);
+    return 0;
+}
+
+void RocksdbScanNode::scan_sub_range(SubRangeScan* sub, bool columnar) {
+    IndexRange range(_left_records[0].get(), 
+            _right_records[0].get(), 
+            _index_info,
+            _pri_info,
+            _region_info,
+            _left_field_cnts[0], 
+            _right_field_cnts[0], 
+            _left_opens[0], 
+            _right_opens[0]);
+    std::unique_ptr<TableIterator> table_iter;
+    std::unique_ptr<IndexIterator> index_iter;
+    Iterator* iter = nullptr;
+    std::vector<int32_t> dummy;
+    if (_index_id == _table_id) {
+        table_iter.reset(new TableIterator(true, true));
+        iter = table_iter.get();
+    } else {
+        index_iter.reset(new IndexIterator(true, true));
+        iter = index_iter.get();
+    }
+    iter->set_sub_range(sub->begin, sub->end, _snapshot);
+    iter->set_bulk_scan(true);
+    int ret = iter->open(range, table_iter != nullptr ? _field_ids : dummy);
+    if (ret == 0 && table_iter != nullptr && _is_covering_index) {
+        table_iter->set_mode(KEY_ONLY);
+    }
+    SmartRecord record = _factory->new_record(*_table_info);
+    std::shared_ptr<RowBatch> batch;
+    while (ret == 0 && iter->valid()) {
+        if (batch == nullptr) {
+            batch = std::make_shared<RowBatch>();
+            if (columnar && batch->init_columns(*_tuple_desc) < 0) {
+                ret = -1;
+                break;
+            }
+        }
+        record->clear();
+        if (table_iter != nullptr) {
+            if (table_iter->get_next(record) < 0) {
+                continue;
+            }
+        } else {
+            if (index_iter->get_next(record) < 0) {
+                continue;
+            }
+            if (!match_index_conjuncts(record, sub->index_conjuncts, sub->index_row)) {
+                continue;
+            }
+            if (!_is_covering_index && get_primary_by_snapshot(record) < 0) {
+                continue;
+            }
+        }
+        append_record(batch.get(), record);
+        if (batch->is_full()) {
+            filter_sub_batch(sub, batch.get());
+            if (batch->size() > 0 && !push_sub_batch(sub, batch)) {
+                break;
+            }
+            batch.reset();
+        }
+    }
+    if (ret == 0 && batch != nullptr) {
+        filter_sub_batch(sub, batch.get());
+        if (batch->size() > 0) {
+            push_sub_batch(sub, batch);
+        }
+    }
+    bthread_mutex_lock(&_scan_mutex);
+    sub->ret = ret;
+    sub->finished = true;
+    bthread_cond_broadcast(&_scan_cond);
+    bthread_mutex_unlock(&_scan_mutex);
+}
+
+void RocksdbScanNode::filter_sub_batch(SubRangeScan* sub, RowBatch* batch) {
+    if (sub->conjuncts.empty()) {
+        return;
+    }
+    if (batch->is_columnar()) {
+        std::vector<uint32_t>* selection = batch->mutable_selection();
+        for (auto conjunct : sub->conjuncts) {
+            if (selection->empty()) {
+                break;
+            }
+            conjunct->filter_batch(batch->mutable_columns(), selection);
+        }
+        return;
+    }
+    RowBatch filtered;
+    for (batch->reset(); !batch->is_traverse_over(); batch->next()) {
+        std::unique_ptr<MemRow>& row = batch->get_row();
+        if (need_copy(row.get(), sub->conjuncts)) {
+            filtered.move_row(std::move(row));
+        }
+    }
+    batch->swap(filtered);
+    batch->reset();
+}
+
+int RocksdbScanNode::get_primary_by_snapshot(SmartRecord& record) {
+    MutTableKey key;
+    key.append_i64(_region_id).append_i64(_pri_info->id);
+    if (0 != key.append_index(*_pri_info, record.get(), -1, false)) {
+        DB_WARNING("Fail to append_index, reg:%ld, tab:%ld", _region_id, _pri_info->id);
+        return -1;
+    }
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = _snapshot;
+    std::string value;
+    RocksWrapper* db = RocksWrapper::get_instance();
+    rocksdb::Status s = db->get(read_options, db->get_data_handle(), key.data(), &value);
+    if (!s.ok()) {
+        DB_FATAL("get primary:%ld fail, index primary may be not consistency: %s, err:%s", 
+                _table_id, record->to_string().c_str(), s.ToString().c_str());
+        return -1;
+    }
+    TupleRecord tuple_record(value);
+    if (0 != tuple_record.decode_fields(_field_ids, record)) {
+        DB_WARNING("decode value failed: %ld", _table_id);
+        return -1;
+    }
+    return 0;
+}
+
+// 队列满时等待get_next取走, 扫描被停止时返回false
+bool RocksdbScanNode::push_sub_batch(SubRangeScan* sub, const std::shared_ptr<RowBatch>& batch) {
+    bthread_mutex_lock(&_scan_mutex);
+    while (!_scan_stopped && sub->batches.size() >= (size_t)FLAGS_parallel_scan_queue_batches) {
+        bthread_cond_wait(&_scan_cond, &_scan_mutex);
+    }
+    bool stopped = _scan_stopped;
+    if (!stopped) {
+        sub->batches.push_back(batch);
+        bthread_cond_broadcast(&_scan_cond);
+    }
+    bthread_mutex_unlock(&_scan_mutex);
+    return !stopped;
+}
+
+// 用了索引排序时按子区间顺序输出, 否则哪个子区间有数据就先输出哪个
+int RocksdbScanNode::get_next_by_parallel_seek(RuntimeState* state, RowBatch* batch, bool* eos) {
+    if (batch->size() > 0) {
+        return 0;
+    }
+    std::shared_ptr<RowBatch> result;
+    bthread_mutex_lock(&_scan_mutex);
+    while (true) {
+        bool all_finished = true;
+        for (size_t i = _sub_scan_idx; i < _sub_scans.size(); i++) {
+            SubRangeScan* sub = _sub_scans[i].get();
+            if (!sub->batches.empty()) {
+                result = sub->batches.front();
+                sub->batches.pop_front();
+                break;
+            }
+            if (sub->finished) {
+                if (sub->ret < 0) {
+                    bthread_mutex_unlock(&_scan_mutex);
+                    DB_WARNING_STATE(state, "parallel scan fail, table_id:%ld", _table_id);
+                    return -1;
+                }
+                if (i == _sub_scan_idx) {
+                    ++_sub_scan_idx;
+                }
+                continue;
+            }
+            all_finished = false;
+            if (_sort_use_index) {
+                break;
+            }
+        }
+        if (result != nullptr || all_finished) {
+            break;
+        }
+        bthread_cond_wait(&_scan_cond, &_scan_mutex);
+    }
+    bthread_cond_broadcast(&_scan_cond);
+    bthread_mutex_unlock(&_scan_mutex);
+    if (result == nullptr) {
+        *eos = true;
+        return 0;
+    }
+    batch->swap(*result);
+    _num_rows_returned += batch->size();
+    return 0;
+}
+
+void RocksdbScanNode::stop_parallel_scan() {
+    if (!_parallel_scan) {
+        return;
+    }
+    bthread_mutex_lock(&_scan_mutex);
+    _scan_stopped = true;
+    bthread_cond_broadcast(&_scan_cond);
+    bthread_mutex_unlock(&_scan_mutex);
+    _scan_worker_cond.wait();
+    _sub_scans.clear();
+    RocksWrapper::get_instance()->get_db()->ReleaseSnapshot(_snapshot);
+    _snapshot = nullptr;
+    _parallel_scan = false;
+}
+
+// 索引谓词过滤, 复用同一个MemRow, 避免过滤掉的行也要分配内存
+bool RocksdbScanNode::match_index_conjuncts(SmartRecord& record) {
+    return match_index_conjuncts(record, _index_conjuncts, _index_row);
+}
+
+bool RocksdbScanNode::match_index_conjuncts(SmartRecord& record,
+        std::vector<ExprNode*>& conjuncts, std::unique_ptr<MemRow>& row) {
+    if (conjuncts.size() == 0) {
+        return true;
+    }
+    if (row == nullptr) {
+        row = _mem_row_desc->fetch_mem_row();
+    }
+    row->clear();
+    for (auto& pair : _index_slot_field_map) {
+        auto field = record->get_field_by_tag(pair.second);
+        row->set_value(_tuple_id, pair.first, record->get_value(field));
+    }
+    return need_copy(row.get(), conjuncts);
+}
+
+bool RocksdbScanNode::can_prefetch_lookup(RuntimeState* state) {
+    for (ExecNode* parent = get_parent(); parent != nullptr; parent = parent->get_parent()) {
+        switch (parent->node_type()) {
+            case pb::INSERT_NODE:
+            case pb::REPLACE_NODE:
+            case pb::UPDATE_NODE:
+            case pb::DELETE_NODE:
+            case pb::TRUNCATE_NODE:
+                return false;
+            default:
+                break;
+        }
+    }
+    auto txn = state->txn();
+    if (txn != nullptr && txn->get_txn() != nullptr &&
+            (txn->get_txn()->GetNumPuts() > 0 || txn->get_txn()->GetNumDeletes() > 0)) {
+        return false;
+    }
+    return true;
+}
+
+int RocksdbScanNode::fetch_lookup_block(RuntimeState* state, LookupBlock* block,
+        int64_t max_rows) {
+    while ((int64_t)block->records.size() < max_rows) {
+        if (_index_iter == nullptr || !_index_iter->valid()) {
+            if (_idx >= _left_records.size()) {
+                block->index_eof = true;
+                break;
+            }
+            IndexRange range(_left_records[_idx].get(), 
+                    _right_records[_idx].get(), 
+                    _index_info,
+                    _pri_info,
+                    _region_info,
+                    _left_field_cnts[_idx], 
+                    _right_field_cnts[_idx], 
+                    _left_opens[_idx], 
+                    _right_opens[_idx]);
+            delete _index_iter;
+            _index_iter = Iterator::scan_secondary(state->txn(), range, true, _scan_forward);
+            if (_index_iter == nullptr) {
+                DB_WARNING_STATE(state, "open IndexIterator fail, index_id:%ld", _index_id);
+                block->ret = -1;
+                return -1;
+            }
+            _idx++;
+            continue;
+        }
+        SmartRecord record = _factory->new_record(*_table_info);
+        if (_index_iter->get_next(record) < 0) {
+            continue;
+        }
+        if (!match_index_conjuncts(record)) {
+            continue;
+        }
+        block->records.push_back(record);
+    }
+    if (block->records.empty()) {
+        return 0;
+    }
+    block->ret = state->txn()->multi_get_primary(_region_id, *_pri_info, block->records,
+            &block->values, &block->rets);
+    if (block->ret < 0) {
+        DB_WARNING_STATE(state, "multi get primary fail, table_id:%ld", _table_id);
+    }
+    return block->ret;
+}
+
+int RocksdbScanNode::get_next_by_index_lookup(RuntimeState* state, RowBatch* batch, bool* eos) {
+    while (1) {
+        if (reached_limit()) {
+            *eos = true;
+            return 0;
+        }
+        if (batch->is_full()) {
+            return 0;
+        }
+        if (_lookup_block == nullptr || _lookup_pos >= _lookup_block->records.size()) {
+            if (_lookup_block == nullptr) {
+                _lookup_prefetch_enabled = can_prefetch_lookup(state);
+            } else if (_lookup_block->index_eof) {
+                *eos = true;
+                return 0;
+            }
+            // 有limit时每批不超过剩余行数
+            int64_t max_rows = FLAGS_index_lookup_batch_size;
+            if (_limit != -1) {
+                max_rows = std::min(max_rows, _limit - _num_rows_returned);
+            }
+            if (_lookup_prefetching) {
+                _lookup_cond.wait();
+                _lookup_prefetching = false;
+                _lookup_block.swap(_prefetch_block);
+            } else {
+                _lookup_block.reset(new LookupBlock);
+                fetch_lookup_block(state, _lookup_block.get(), max_rows);
+            }
+            if (_lookup_block->ret < 0) {
+                return -1;
+            }
+            _lookup_pos = 0;
+            // 当前批解析的同时预取下一批, 预取线程独占_index_iter, 主线程只读当前批
+            int64_t next_rows = FLAGS_index_lookup_batch_size;
+            if (_limit != -1) {
+                next_rows = std::min(next_rows, _limit - _num_rows_returned
+                        - (int64_t)_lookup_block->records.size());
+            }
+            if (_lookup_prefetch_enabled && !_lookup_block->index_eof && next_rows > 0) {
+                _lookup_prefetching = true;
+                _prefetch_block.reset(new LookupBlock);
+                _lookup_cond.increase();
+                Bthread bth(&BTHREAD_ATTR_SMALL);
+                bth.run([this, state, next_rows]() {
+                    fetch_lookup_block(state, _prefetch_block.get(), next_rows);
+                    _lookup_cond.decrease_signal();
+                });
+            }
+            continue;
+        }
+        size_t pos = _lookup_pos++;
+        SmartRecord& record = _lookup_block->records[pos];
+        if (_lookup_block->rets[pos] < 0) {
+            DB_FATAL("get primary:%ld fail, index primary may be not consistency: %s", 
+                    _table_id, record->to_string().c_str());
+            continue;
+        }
+        TupleRecord tuple_record(_lookup_block->values[pos]);
+        if (0 != tuple_record.decode_fields(_field_ids, record)) {
+            DB_WARNING_STATE(state, "decode value failed: %ld", _table_id);
+            continue;
+        }
+        append_record(batch, record);
+        ++_num_rows_returned;
+    }
+}
+
 int RocksdbScanNode::get_next_by_index_seek(RuntimeState* state, RowBatch* batch, bool* eos) {
+    if (!_parallel_checked) {
+        _parallel_checked = true;
+        if (need_parallel_scan(state) && start_parallel_scan(state, batch->is_columnar()) == 0) {
+            _parallel_scan = true;
+        }
+    }
+    if (_parallel_scan) {
+        return get_next_by_parallel_seek(state, batch, eos);
+    }
     int ret = 0;
     SmartRecord record = _factory->new_record(*_table_info);
     while (1) {
@@ -624,7 +1219,6 @@ int RocksdbScanNode::get_next_by_index_seek(RuntimeState* state, RowBatch* batch
         }
         //TimeCost cost;
         record->clear();
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
         if (_reverse_indexes.size() > 0) {
             ret = _m_index.get_next(record);
             if (ret < 0) {
@@ -646,12 +1240,7 @@ int RocksdbScanNode::get_next_by_index_seek(RuntimeState* state, RowBatch* batch
         }
         // 倒排索引直接下推到了布尔引擎，但是主键条件未下推，因此也需要再次过滤
         // toto: 后续可以再次优化，把userid和source的条件干掉
-        // 索引谓词过滤
-        for (auto& pair : _index_slot_field_map) {
-            auto field = record->get_field_by_tag(pair.second);
-            row->set_value(_tuple_id, pair.first, record->get_value(field));
-        }
-        if (!need_copy(row.get(), _index_conjuncts)) {
+        if (!match_index_conjuncts(record)) {
             continue;
         }
         //DB_NOTICE("get index: %ld", cost.get_time());
@@ -667,13 +1256,7 @@ int RocksdbScanNode::get_next_by_index_seek(RuntimeState* state, RowBatch* batch
         }
         //DB_NOTICE("get pri: %ld", cost.get_time());
         //cost.reset();
-        //row->set_tuple(_tuple_id, _mem_row_desc);
-        for (auto slot : _tuple_desc->slots()) {
-            auto field = record->get_field_by_tag(slot.field_id());
-            row->set_value(slot.tuple_id(), slot.slot_id(),
-                    record->get_value(field));
-        }
-        batch->move_row(std::move(row));
+        append_record(batch, record);
         ++_num_rows_returned;
         //DB_NOTICE("MemRow set: %ld", cost.get_time());
     }
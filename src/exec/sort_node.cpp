@@ -16,6 +16,8 @@
 #include "sort_node.h"
 
 namespace baikaldb {
+DEFINE_int64(sort_topn_max_limit, 100000, "sort node use bounded heap when limit is not greater than it");
+
 int SortNode::init(const pb::PlanNode& node) {
     int ret = 0;
     ret = ExecNode::init(node);
@@ -139,26 +141,48 @@ int SortNode::open(RuntimeState* state) {
     _mem_row_compare = std::make_shared<MemRowCompare>(
             _slot_order_exprs, _is_asc, _is_null_first);
     _sorter = std::make_shared<Sorter>(_mem_row_compare.get());
+    // 有limit时只保留前limit行, 不用全量排序
+    if (_limit > 0 && _limit <= FLAGS_sort_topn_max_limit) {
+        _sorter->set_limit(_limit);
+    } else {
+        // 超过query内存上限时落盘做外排
+        _sorter->set_mem_tracker(state->mem_tracker(), _mem_row_desc);
+    }
 
     bool eos = false;
     int count = 0;
     do {
         std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+        batch->set_allow_columnar(true);
         ret = _children[0]->get_next(state, batch.get(), &eos);
         if (ret < 0) {
             DB_WARNING_STATE(state, "child->get_next fail, ret:%d", ret);
             return ret;
         }
+        // 排序需要交换行, 列存batch先物化成MemRow
+        ret = batch->materialize(_mem_row_desc);
+        if (ret < 0) {
+            DB_WARNING_STATE(state, "materialize fail, ret:%d", ret);
+            return ret;
+        }
         //照理不会出现拿到0行数据
         if (batch->size() == 0) {
             break;
         }
         count += batch->size();
         fill_tuple(batch.get());
-        _sorter->add_batch(batch);
+        ret = _sorter->add_batch(batch);
+        if (ret < 0) {
+            DB_WARNING_STATE(state, "sorter add_batch fail, ret:%d", ret);
+            return ret;
+        }
     } while (!eos);
-    DB_WARNING_STATE(state, "sort_size:%d", count);
-    _sorter->sort();
+    DB_WARNING_STATE(state, "sort_size:%d, spill_run_size:%lu", count, _sorter->spill_run_size());
+    ret = _sorter->sort();
+    if (ret < 0) {
+        DB_WARNING_STATE(state, "sorter sort fail, ret:%d", ret);
+        return ret;
+    }
     return 0;
 }
 
@@ -14,6 +14,7 @@
 
 #include "mem_row_descriptor.h"
 #include "mem_row.h"
+#include "column_batch.h"
 
 namespace baikaldb {
 
@@ -37,6 +38,9 @@ std::string MemRow::debug_string(int32_t tuple_id) {
 }
 
 std::string* MemRow::mutable_string(int32_t tuple_id, int32_t slot_id) {
+    if (_column_batch != nullptr) {
+        return nullptr;
+    }
     auto tuple = _tuples[tuple_id];
     if (tuple == nullptr) {
         return nullptr;
@@ -56,6 +60,9 @@ std::string* MemRow::mutable_string(int32_t tuple_id, int32_t slot_id) {
 
 // slot start with 1
 ExprValue MemRow::get_value(int32_t tuple_id, int32_t slot_id) {
+    if (_column_batch != nullptr) {
+        return _column_batch->get_value(tuple_id, slot_id, _column_row);
+    }
     auto tuple = _tuples[tuple_id];
     if (tuple == nullptr) {
         return ExprValue::Null();
@@ -118,6 +125,9 @@ ExprValue MemRow::get_value(int32_t tuple_id, int32_t slot_id) {
     return ExprValue::Null();
 }
 int MemRow::set_value(int32_t tuple_id, int32_t slot_id, const ExprValue& value) {
+    if (_column_batch != nullptr) {
+        return -1;
+    }
     auto tuple = _tuples[tuple_id];
     if (tuple == nullptr) {
         return -1;
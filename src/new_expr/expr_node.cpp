@@ -18,6 +18,7 @@
 #include "scalar_fn_call.h"
 #include "agg_fn_call.h"
 #include "slot_ref.h"
+#include "column_batch.h"
 
 namespace baikaldb {
 void ExprNode::const_pre_calc() {
@@ -256,6 +257,18 @@ int ExprNode::create_expr_node(const pb::ExprNode& node, ExprNode** expr_node) {
     return -1;
 }
 
+void ExprNode::filter_batch(const ColumnBatch* batch, std::vector<uint32_t>* selection) {
+    MemRow row(0);
+    size_t keep = 0;
+    for (size_t i = 0; i < selection->size(); i++) {
+        row.bind_column_row(batch, (*selection)[i]);
+        ExprValue value = get_value(&row);
+        if (!value.is_null() && value.get_numberic<bool>()) {
+            (*selection)[keep++] = (*selection)[i];
+        }
+    }
+    selection->resize(keep);
+}
 }
 
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
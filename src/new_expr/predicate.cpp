@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "predicate.h"
+#include "slot_ref.h"
+#include "column_batch.h"
+#include "vectorized_kernels.h"
 
 namespace baikaldb {
 int InPredicate::type_inferer() {
@@ -226,6 +229,8 @@ int InPredicate::open() {
             }
         }
     }
+    _int_values.assign(_int_set.begin(), _int_set.end());
+    _double_values.assign(_double_set.begin(), _double_set.end());
     return 0;
 }
 
@@ -276,6 +281,40 @@ ExprValue InPredicate::get_value(MemRow* row) {
     return ExprValue::False();
 }
 
+void InPredicate::filter_batch(const ColumnBatch* batch, std::vector<uint32_t>* selection) {
+    if (selection->empty()) {
+        return;
+    }
+    const ColumnVector* column = nullptr;
+    if (_children[0]->node_type() == pb::SLOT_REF) {
+        SlotRef* slot = static_cast<SlotRef*>(_children[0]);
+        column = batch->get_column(slot->tuple_id(), slot->slot_id());
+    }
+    if (column == nullptr || column->type() != _children[0]->col_type() ||
+            _map_type == M_STRING || _map_type == M_NULL) {
+        ExprNode::filter_batch(batch, selection);
+        return;
+    }
+    size_t rows = batch->rows();
+    _mask.resize(rows);
+    if (_map_type == M_DOUBLE) {
+        in_double(column->double_data(), rows, _double_values, _mask.data());
+    } else {
+        in_int64(column->int_data(), rows, _int_values, _mask.data());
+    }
+    // null行的结果和逐行计算保持一致
+    ExprValue null_result = get_value(nullptr);
+    if (null_result.is_null() || !null_result.get_numberic<bool>()) {
+        select_by_mask(_mask.data(), column->null_flags(), selection);
+        return;
+    }
+    const uint8_t* null_flags = column->null_flags();
+    for (size_t i = 0; i < rows; i++) {
+        _mask[i] |= null_flags[i];
+    }
+    select_by_mask(_mask.data(), nullptr, selection);
+}
+
 int LikePredicate::open() {
     int ret = 0;
     ret = ExprNode::open();
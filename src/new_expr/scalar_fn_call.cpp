@@ -14,6 +14,9 @@
 
 #include "scalar_fn_call.h"
 #include "slot_ref.h"
+#include "column_batch.h"
+#include "vectorized_kernels.h"
+#include "parser.h"
 
 namespace baikaldb {
 int ScalarFnCall::init(const pb::ExprNode& node) {
@@ -94,6 +97,116 @@ ExprValue ScalarFnCall::get_value(MemRow* row) {
     }
     return _fn_call(args);
 }
+
+// 列中存的int64/double和按arg_type转换后的值按位一致时才能直接比较
+static bool column_match_arg_type(pb::PrimitiveType col_type, pb::PrimitiveType arg_type) {
+    switch (arg_type) {
+        case pb::INT64:
+        case pb::UINT64:
+            switch (col_type) {
+                case pb::BOOL:
+                case pb::INT8:
+                case pb::INT16:
+                case pb::INT32:
+                case pb::INT64:
+                case pb::UINT8:
+                case pb::UINT16:
+                case pb::UINT32:
+                case pb::UINT64:
+                    return true;
+                default:
+                    return false;
+            }
+        case pb::DOUBLE:
+            return col_type == pb::FLOAT || col_type == pb::DOUBLE;
+        case pb::DATETIME:
+        case pb::TIMESTAMP:
+        case pb::DATE:
+        case pb::TIME:
+            return col_type == arg_type;
+        default:
+            return false;
+    }
+}
+
+int ScalarFnCall::filter_batch_compare(const ColumnBatch* batch, 
+        std::vector<uint32_t>* selection) {
+    CompareOp op = CMP_EQ;
+    switch (_fn.fn_op()) {
+        case parser::FT_EQ:
+            op = CMP_EQ;
+            break;
+        case parser::FT_NE:
+            op = CMP_NE;
+            break;
+        case parser::FT_GT:
+            op = CMP_GT;
+            break;
+        case parser::FT_GE:
+            op = CMP_GE;
+            break;
+        case parser::FT_LT:
+            op = CMP_LT;
+            break;
+        case parser::FT_LE:
+            op = CMP_LE;
+            break;
+        default:
+            return -1;
+    }
+    if (_children.size() != 2 || _fn.arg_types_size() != 2) {
+        return -1;
+    }
+    ExprNode* slot = _children[0];
+    ExprNode* constant = _children[1];
+    if (slot->node_type() != pb::SLOT_REF) {
+        std::swap(slot, constant);
+        op = reverse_compare_op(op);
+    }
+    if (slot->node_type() != pb::SLOT_REF || !constant->is_constant()) {
+        return -1;
+    }
+    const ColumnVector* column = batch->get_column(static_cast<SlotRef*>(slot)->tuple_id(),
+            static_cast<SlotRef*>(slot)->slot_id());
+    pb::PrimitiveType arg_type = _fn.arg_types(0);
+    if (column == nullptr || column->type() != slot->col_type() ||
+            !column_match_arg_type(column->type(), arg_type)) {
+        return -1;
+    }
+    ExprValue value = constant->get_value(nullptr);
+    if (value.is_null()) {
+        selection->clear();
+        return 0;
+    }
+    value.cast_to(arg_type);
+    size_t rows = batch->rows();
+    _mask.resize(rows);
+    switch (arg_type) {
+        case pb::DOUBLE:
+            compare_double(column->double_data(), rows, op, value._u.double_val, _mask.data());
+            break;
+        case pb::UINT64:
+        case pb::DATETIME:
+            compare_uint64(column->int_data(), rows, op, value._u.uint64_val, _mask.data());
+            break;
+        default:
+            compare_int64(column->int_data(), rows, op, 
+                    value.get_numberic<int64_t>(), _mask.data());
+            break;
+    }
+    select_by_mask(_mask.data(), column->null_flags(), selection);
+    return 0;
+}
+
+void ScalarFnCall::filter_batch(const ColumnBatch* batch, std::vector<uint32_t>* selection) {
+    if (selection->empty()) {
+        return;
+    }
+    if (filter_batch_compare(batch, selection) == 0) {
+        return;
+    }
+    ExprNode::filter_batch(batch, selection);
+}
 }
 
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,277 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "vectorized_kernels.h"
+#include <algorithm>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+namespace baikaldb {
+// in列表不超过这个长度时用simd逐个比较, 否则二分查找
+static const size_t SIMD_IN_LIST_MAX = 8;
+
+CompareOp reverse_compare_op(CompareOp op) {
+    switch (op) {
+        case CMP_GT:
+            return CMP_LT;
+        case CMP_GE:
+            return CMP_LE;
+        case CMP_LT:
+            return CMP_GT;
+        case CMP_LE:
+            return CMP_GE;
+        default:
+            return op;
+    }
+}
+
+bool cpu_support_avx2() {
+#ifdef __x86_64__
+    static bool support = __builtin_cpu_supports("avx2");
+    return support;
+#else
+    return false;
+#endif
+}
+
+template <typename T>
+static void compare_scalar(const T* data, size_t begin, size_t rows, CompareOp op, T value,
+        uint8_t* mask) {
+    switch (op) {
+        case CMP_EQ:
+            for (size_t i = begin; i < rows; i++) {
+                mask[i] = data[i] == value;
+            }
+            break;
+        case CMP_NE:
+            for (size_t i = begin; i < rows; i++) {
+                mask[i] = data[i] != value;
+            }
+            break;
+        case CMP_GT:
+            for (size_t i = begin; i < rows; i++) {
+                mask[i] = data[i] > value;
+            }
+            break;
+        case CMP_GE:
+            for (size_t i = begin; i < rows; i++) {
+                mask[i] = data[i] >= value;
+            }
+            break;
+        case CMP_LT:
+            for (size_t i = begin; i < rows; i++) {
+                mask[i] = data[i] < value;
+            }
+            break;
+        case CMP_LE:
+            for (size_t i = begin; i < rows; i++) {
+                mask[i] = data[i] <= value;
+            }
+            break;
+    }
+}
+
+#ifdef __x86_64__
+__attribute__((target("avx2")))
+static inline void store_mask4(int bits, uint8_t* mask) {
+    mask[0] = bits & 1;
+    mask[1] = (bits >> 1) & 1;
+    mask[2] = (bits >> 2) & 1;
+    mask[3] = (bits >> 3) & 1;
+}
+
+// flip不为0时对数据异或符号位, 把无符号比较转成有符号比较
+__attribute__((target("avx2")))
+static size_t compare_int64_avx2(const int64_t* data, size_t rows, CompareOp op,
+        int64_t value, int64_t flip, uint8_t* mask) {
+    const __m256i vflip = _mm256_set1_epi64x(flip);
+    const __m256i vvalue = _mm256_xor_si256(_mm256_set1_epi64x(value), vflip);
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m256i vdata = _mm256_xor_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), vflip);
+        __m256i res;
+        bool negate = false;
+        switch (op) {
+            case CMP_EQ:
+                res = _mm256_cmpeq_epi64(vdata, vvalue);
+                break;
+            case CMP_NE:
+                res = _mm256_cmpeq_epi64(vdata, vvalue);
+                negate = true;
+                break;
+            case CMP_GT:
+                res = _mm256_cmpgt_epi64(vdata, vvalue);
+                break;
+            case CMP_LE:
+                res = _mm256_cmpgt_epi64(vdata, vvalue);
+                negate = true;
+                break;
+            case CMP_LT:
+                res = _mm256_cmpgt_epi64(vvalue, vdata);
+                break;
+            default:
+                res = _mm256_cmpgt_epi64(vvalue, vdata);
+                negate = true;
+                break;
+        }
+        int bits = _mm256_movemask_pd(_mm256_castsi256_pd(res));
+        store_mask4(negate ? ~bits : bits, mask + i);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t compare_double_avx2(const double* data, size_t rows, CompareOp op,
+        double value, uint8_t* mask) {
+    const __m256d vvalue = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m256d vdata = _mm256_loadu_pd(data + i);
+        __m256d res;
+        switch (op) {
+            case CMP_EQ:
+                res = _mm256_cmp_pd(vdata, vvalue, _CMP_EQ_OQ);
+                break;
+            case CMP_NE:
+                res = _mm256_cmp_pd(vdata, vvalue, _CMP_NEQ_UQ);
+                break;
+            case CMP_GT:
+                res = _mm256_cmp_pd(vdata, vvalue, _CMP_GT_OQ);
+                break;
+            case CMP_GE:
+                res = _mm256_cmp_pd(vdata, vvalue, _CMP_GE_OQ);
+                break;
+            case CMP_LT:
+                res = _mm256_cmp_pd(vdata, vvalue, _CMP_LT_OQ);
+                break;
+            default:
+                res = _mm256_cmp_pd(vdata, vvalue, _CMP_LE_OQ);
+                break;
+        }
+        store_mask4(_mm256_movemask_pd(res), mask + i);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t in_int64_avx2(const int64_t* data, size_t rows,
+        const std::vector<int64_t>& values, uint8_t* mask) {
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m256i vdata = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i res = _mm256_setzero_si256();
+        for (auto value : values) {
+            res = _mm256_or_si256(res, _mm256_cmpeq_epi64(vdata, _mm256_set1_epi64x(value)));
+        }
+        store_mask4(_mm256_movemask_pd(_mm256_castsi256_pd(res)), mask + i);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t in_double_avx2(const double* data, size_t rows,
+        const std::vector<double>& values, uint8_t* mask) {
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m256d vdata = _mm256_loadu_pd(data + i);
+        __m256d res = _mm256_setzero_pd();
+        for (auto value : values) {
+            res = _mm256_or_pd(res, _mm256_cmp_pd(vdata, _mm256_set1_pd(value), _CMP_EQ_OQ));
+        }
+        store_mask4(_mm256_movemask_pd(res), mask + i);
+    }
+    return i;
+}
+#endif
+
+void compare_int64(const int64_t* data, size_t rows, CompareOp op, int64_t value, uint8_t* mask) {
+    size_t begin = 0;
+#ifdef __x86_64__
+    if (cpu_support_avx2()) {
+        begin = compare_int64_avx2(data, rows, op, value, 0, mask);
+    }
+#endif
+    compare_scalar<int64_t>(data, begin, rows, op, value, mask);
+}
+
+void compare_uint64(const int64_t* data, size_t rows, CompareOp op, uint64_t value,
+        uint8_t* mask) {
+    size_t begin = 0;
+#ifdef __x86_64__
+    if (cpu_support_avx2()) {
+        begin = compare_int64_avx2(data, rows, op, value, INT64_MIN, mask);
+    }
+#endif
+    compare_scalar<uint64_t>(reinterpret_cast<const uint64_t*>(data), begin, rows,
+            op, value, mask);
+}
+
+void compare_double(const double* data, size_t rows, CompareOp op, double value, uint8_t* mask) {
+    size_t begin = 0;
+#ifdef __x86_64__
+    if (cpu_support_avx2()) {
+        begin = compare_double_avx2(data, rows, op, value, mask);
+    }
+#endif
+    compare_scalar<double>(data, begin, rows, op, value, mask);
+}
+
+void in_int64(const int64_t* data, size_t rows, const std::vector<int64_t>& values,
+        uint8_t* mask) {
+    size_t begin = 0;
+#ifdef __x86_64__
+    if (values.size() <= SIMD_IN_LIST_MAX && cpu_support_avx2()) {
+        begin = in_int64_avx2(data, rows, values, mask);
+    }
+#endif
+    for (size_t i = begin; i < rows; i++) {
+        mask[i] = std::binary_search(values.begin(), values.end(), data[i]);
+    }
+}
+
+void in_double(const double* data, size_t rows, const std::vector<double>& values,
+        uint8_t* mask) {
+    size_t begin = 0;
+#ifdef __x86_64__
+    if (values.size() <= SIMD_IN_LIST_MAX && cpu_support_avx2()) {
+        begin = in_double_avx2(data, rows, values, mask);
+    }
+#endif
+    for (size_t i = begin; i < rows; i++) {
+        mask[i] = std::binary_search(values.begin(), values.end(), data[i]);
+    }
+}
+
+void select_by_mask(const uint8_t* mask, const uint8_t* null_flags,
+        std::vector<uint32_t>* selection) {
+    uint32_t* sel = selection->data();
+    size_t keep = 0;
+    if (null_flags == nullptr) {
+        for (size_t i = 0; i < selection->size(); i++) {
+            sel[keep] = sel[i];
+            keep += mask[sel[i]];
+        }
+    } else {
+        for (size_t i = 0; i < selection->size(); i++) {
+            sel[keep] = sel[i];
+            keep += mask[sel[i]] & (null_flags[sel[i]] ^ 1);
+        }
+    }
+    selection->resize(keep);
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -1157,6 +1157,16 @@ int LogicalPlanner::create_term_literal_node(const parser::LiteralExpr* literal,
             node->set_node_type(pb::NULL_LITERAL);
             node->set_col_type(pb::NULL_TYPE);
             break;
+        case parser::LT_PLACE_HOLDER:
+            if (literal->place_holder_id < (int)_ctx->stmt_params.size()) {
+                *node = _ctx->stmt_params[literal->place_holder_id];
+                break;
+            }
+            // execute时替换成参数对应的literal
+            node->set_node_type(pb::PLACE_HOLDER_LITERAL);
+            node->set_col_type(pb::NULL_TYPE);
+            node->mutable_derive_node()->set_int_val(literal->place_holder_id);
+            break;
     }
     return 0;
 }
@@ -1394,24 +1404,35 @@ int LogicalPlanner::create_scan_nodes() {
 }
 
 void LogicalPlanner::set_dml_txn_state() {
-    auto client = _ctx->runtime_state.client_conn();
+    set_txn_state(_ctx);
+}
+
+void LogicalPlanner::set_txn_state(QueryContext* ctx) {
+    auto client = ctx->runtime_state.client_conn();
+    if (ctx->stmt_type == parser::NT_SELECT) {
+        ctx->runtime_state.set_autocommit(client->txn_id == 0);
+        return;
+    }
     if (client->txn_id == 0) {
-        if (_ctx->enable_2pc) {
-            client->txn_id = get_txn_id();
+        if (ctx->enable_2pc) {
+            client->txn_id = gen_txn_id(client);
             client->seq_id = 0;
         } else {
             client->txn_id = 0;
             client->seq_id = 0;
         }
-        _ctx->runtime_state.set_autocommit(true);
+        ctx->runtime_state.set_autocommit(true);
     } else {
-        _ctx->runtime_state.set_autocommit(false);
+        ctx->runtime_state.set_autocommit(false);
     }
 }
 
-// TODO: instance_part may overflow and wrapped
 uint64_t LogicalPlanner::get_txn_id() {
-    auto client = _ctx->runtime_state.client_conn();
+    return gen_txn_id(_ctx->runtime_state.client_conn());
+}
+
+// TODO: instance_part may overflow and wrapped
+uint64_t LogicalPlanner::gen_txn_id(NetworkSocket* client) {
     uint64_t instance_part = client->server_instance_id & 0x7FFFFF;
 
     uint64_t txn_id_part = _txn_id_counter.fetch_add(1);
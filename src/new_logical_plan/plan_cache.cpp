@@ -0,0 +1,409 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "plan_cache.h"
+#include <cerrno>
+#include <set>
+#include <boost/algorithm/string.hpp>
+#include <gflags/gflags.h>
+#include "logical_planner.h"
+#include "network_socket.h"
+#include "schema_factory.h"
+
+namespace baikaldb {
+DEFINE_bool(enable_plan_cache, true, "cache logical plan of select/update/delete by normalized sql");
+DEFINE_int64(plan_cache_capacity, 10000, "max number of cached logical plans");
+
+int PlanTemplate::create(const std::string& sql, int num_params, QueryContext* ctx,
+        std::shared_ptr<PlanTemplate>* tmpl) {
+    tmpl->reset();
+    std::shared_ptr<QueryContext> plan_ctx(
+            new (std::nothrow)QueryContext(ctx->user_info, ctx->cur_db));
+    if (plan_ctx == nullptr) {
+        DB_FATAL("create query context instance failed");
+        return -1;
+    }
+    plan_ctx->sql = sql;
+    plan_ctx->charset = ctx->charset;
+    plan_ctx->enable_2pc = ctx->enable_2pc;
+    // 计划生成需要client连接, 其中事务状态的改动由bind重新设置, 这里还原
+    NetworkSocket* client = ctx->runtime_state.client_conn();
+    uint64_t txn_id = client->txn_id;
+    int seq_id = client->seq_id;
+    plan_ctx->runtime_state.set_client_conn(client);
+    int ret = LogicalPlanner::analyze(plan_ctx.get());
+    client->txn_id = txn_id;
+    client->seq_id = seq_id;
+    // 模板会被缓存, 不能持有连接
+    plan_ctx->runtime_state.set_client_conn(nullptr);
+    if (ret < 0) {
+        ctx->stat_info.error_code = plan_ctx->stat_info.error_code;
+        ctx->stat_info.error_msg << plan_ctx->stat_info.error_msg.str();
+        return -1;
+    }
+    // 占位符在parse阶段被消费掉(如别名)时, 模板不完整
+    std::set<int64_t> place_holder_ids;
+    visit_place_holders(&plan_ctx->plan, [&place_holder_ids](pb::ExprNode* node) {
+        place_holder_ids.insert(node->derive_node().int_val());
+    });
+    if ((int)place_holder_ids.size() != num_params) {
+        DB_WARNING("place holder not all in plan, %lu vs %d, sql: %s",
+                place_holder_ids.size(), num_params, sql.c_str());
+        return 0;
+    }
+    std::shared_ptr<PlanTemplate> result(new (std::nothrow)PlanTemplate);
+    if (result == nullptr) {
+        DB_FATAL("create plan template failed");
+        return -1;
+    }
+    SchemaFactory* factory = SchemaFactory::get_instance();
+    for (auto& tuple_desc : plan_ctx->tuple_descs()) {
+        if (tuple_desc.has_table_id()) {
+            result->table_versions[tuple_desc.table_id()] =
+                    factory->get_table_version(tuple_desc.table_id());
+        }
+    }
+    result->user_version = ctx->user_info->version;
+    result->ctx = plan_ctx;
+    *tmpl = result;
+    return 0;
+}
+
+bool PlanTemplate::is_valid(const QueryContext* ctx) const {
+    if (ctx->user_info->version != user_version) {
+        return false;
+    }
+    SchemaFactory* factory = SchemaFactory::get_instance();
+    for (auto& pair : table_versions) {
+        if (factory->get_table_version(pair.first) != pair.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PlanTemplate::bind(const std::vector<pb::ExprNode>& params, QueryContext* ctx) const {
+    ctx->plan = this->ctx->plan;
+    *ctx->mutable_tuple_descs() = this->ctx->tuple_descs();
+    ctx->stmt_type = this->ctx->stmt_type;
+    // 逻辑计划阶段填的统计信息, 按库统计请求数和耗时时要用
+    ctx->stat_info.family = this->ctx->stat_info.family;
+    visit_place_holders(&ctx->plan, [&params](pb::ExprNode* node) {
+        *node = params[node->derive_node().int_val()];
+    });
+    LogicalPlanner::set_txn_state(ctx);
+    ctx->is_prepared_plan = true;
+}
+
+// 遍历plan中的所有ExprNode, 对PLACE_HOLDER_LITERAL调用fn
+void PlanTemplate::visit_place_holders(google::protobuf::Message* message,
+        const std::function<void(pb::ExprNode*)>& fn) {
+    if (message->GetDescriptor() == pb::ExprNode::descriptor()) {
+        pb::ExprNode* node = static_cast<pb::ExprNode*>(message);
+        if (node->node_type() == pb::PLACE_HOLDER_LITERAL) {
+            fn(node);
+        }
+        return;
+    }
+    const google::protobuf::Reflection* reflection = message->GetReflection();
+    std::vector<const google::protobuf::FieldDescriptor*> fields;
+    reflection->ListFields(*message, &fields);
+    for (auto field : fields) {
+        if (field->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+            continue;
+        }
+        if (field->is_repeated()) {
+            int size = reflection->FieldSize(*message, field);
+            for (int i = 0; i < size; i++) {
+                visit_place_holders(reflection->MutableRepeatedMessage(message, field, i), fn);
+            }
+        } else {
+            visit_place_holders(reflection->MutableMessage(message, field), fn);
+        }
+    }
+}
+
+PlanCache::PlanCache() :
+        _hit_count("plan_cache_hit_count"),
+        _miss_count("plan_cache_miss_count") {
+    _cache.init(FLAGS_plan_cache_capacity);
+}
+
+int PlanCache::analyze(QueryContext* ctx) {
+    std::string normalized;
+    std::vector<pb::ExprNode> params;
+    // gbk的字符串中可能有0x5c, 转义规则和普通字符串不同, 不走cache
+    if (!FLAGS_enable_plan_cache || ctx->user_info == nullptr || ctx->charset == "gbk"
+            || !normalize(ctx->sql, &normalized, &params)) {
+        return LogicalPlanner::analyze(ctx);
+    }
+    std::string key = ctx->user_info->username + "\n" + ctx->cur_db + "\n" + normalized;
+    std::shared_ptr<PlanTemplate> tmpl;
+    if (_cache.find(key, &tmpl) == 0) {
+        if (tmpl == nullptr) {
+            return LogicalPlanner::analyze(ctx);
+        }
+        if (tmpl->is_valid(ctx)) {
+            tmpl->bind(params, ctx);
+            ctx->stat_info.hit_cache = true;
+            _hit_count << 1;
+            return 0;
+        }
+    }
+    _miss_count << 1;
+    if (PlanTemplate::create(normalized, params.size(), ctx, &tmpl) != 0) {
+        // 归一化后不能生成计划(如常量位置语法要求整数), 用原sql分析, 错误也以原sql为准
+        ctx->stat_info.error_code = ER_ERROR_FIRST;
+        ctx->stat_info.error_msg.str("");
+        int ret = LogicalPlanner::analyze(ctx);
+        if (ret == 0) {
+            _cache.add(key, nullptr);
+        }
+        return ret;
+    }
+    _cache.add(key, tmpl);
+    if (tmpl == nullptr) {
+        return LogicalPlanner::analyze(ctx);
+    }
+    tmpl->bind(params, ctx);
+    return 0;
+}
+
+// 数字常量的长度, 规则同sql_lex.l, 不是数字时返回0
+static size_t number_length(const std::string& sql, size_t pos, bool* is_double) {
+    size_t n = sql.size();
+    size_t i = pos;
+    auto skip_digits = [&sql, n](size_t i) {
+        while (i < n && isdigit((unsigned char)sql[i])) {
+            ++i;
+        }
+        return i;
+    };
+    // E[-+]?[0-9]+
+    auto skip_exponent = [&sql, n, &skip_digits](size_t i) {
+        if (i >= n || (sql[i] != 'e' && sql[i] != 'E')) {
+            return i;
+        }
+        size_t j = i + 1;
+        if (j < n && (sql[j] == '-' || sql[j] == '+')) {
+            ++j;
+        }
+        size_t end = skip_digits(j);
+        return end > j ? end : i;
+    };
+    *is_double = false;
+    if (sql[i] == '.') {
+        size_t end = skip_digits(i + 1);
+        if (end == i + 1) {
+            return 0;
+        }
+        *is_double = true;
+        return skip_exponent(end) - pos;
+    }
+    i = skip_digits(i);
+    if (i == pos) {
+        return 0;
+    }
+    if (i < n && sql[i] == '.') {
+        *is_double = true;
+        i = skip_exponent(skip_digits(i + 1));
+    } else {
+        size_t end = skip_exponent(i);
+        *is_double = end > i;
+        i = end;
+    }
+    return i - pos;
+}
+
+static bool is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+bool PlanCache::normalize(const std::string& sql, std::string* normalized,
+        std::vector<pb::ExprNode>* params) {
+    bool is_select = boost::algorithm::istarts_with(sql, "select");
+    if (!is_select && !boost::algorithm::istarts_with(sql, "update")
+            && !boost::algorithm::istarts_with(sql, "delete")) {
+        return false;
+    }
+    normalized->clear();
+    normalized->reserve(sql.size());
+    params->clear();
+    // select列表中的常量决定列名, from之后才替换
+    bool replace = !is_select;
+    int depth = 0;
+    // limit和group/order by后的数字有语法或位置含义, 在该层括号内保留
+    int keep_depth = -1;
+    size_t n = sql.size();
+    size_t i = 0;
+    while (i < n) {
+        char c = sql[i];
+        if (c == '\'' || c == '"') {
+            if (i > 0 && is_ident_char(sql[i - 1])) {
+                return false;
+            }
+            // 转义规则同String::stripslashes
+            std::string value;
+            size_t j = i + 1;
+            bool closed = false;
+            while (j < n) {
+                if (sql[j] == '\\') {
+                    if (j + 1 >= n || sql[j + 1] == '\n') {
+                        return false;
+                    }
+                    char e = sql[j + 1];
+                    switch (e) {
+                        case 'r': value.push_back('\r'); break;
+                        case 't': value.push_back('\t'); break;
+                        case 'n': value.push_back('\n'); break;
+                        case 'b': value.push_back('\b'); break;
+                        case 'Z': value.push_back('\x1A'); break;
+                        case '%':
+                        case '_':
+                            // like中的特殊符号保留'\'
+                            value.push_back('\\');
+                            value.push_back(e);
+                            break;
+                        default: value.push_back(e); break;
+                    }
+                    j += 2;
+                } else if (sql[j] == c) {
+                    closed = true;
+                    ++j;
+                    break;
+                } else {
+                    if (sql[j] == '\0') {
+                        return false;
+                    }
+                    value.push_back(sql[j++]);
+                }
+            }
+            if (!closed || (j < n && (sql[j] == '\'' || sql[j] == '"'))) {
+                return false;
+            }
+            if (replace) {
+                pb::ExprNode node;
+                node.set_node_type(pb::STRING_LITERAL);
+                node.set_col_type(pb::STRING);
+                node.set_num_children(0);
+                node.mutable_derive_node()->set_string_val(value);
+                params->push_back(node);
+                normalized->push_back('?');
+            } else {
+                normalized->append(sql, i, j - i);
+            }
+            i = j;
+            continue;
+        }
+        if (c == '`') {
+            size_t end = sql.find('`', i + 1);
+            if (end == std::string::npos) {
+                return false;
+            }
+            normalized->append(sql, i, end + 1 - i);
+            i = end + 1;
+            continue;
+        }
+        bool is_double = false;
+        size_t num_len = 0;
+        if (isdigit((unsigned char)c) || c == '.') {
+            num_len = number_length(sql, i, &is_double);
+        }
+        if (num_len > 0 && c == '.' && i > 0 && (is_ident_char(sql[i - 1]) || sql[i - 1] == '`')) {
+            // t.1这类写法, 词法分析结果和字段名不同, 不处理
+            return false;
+        }
+        if (is_ident_char(c)) {
+            size_t end = i;
+            while (end < n && is_ident_char(sql[end])) {
+                ++end;
+            }
+            // 词法分析取最长匹配, 如123abc, 0x1F是标识符
+            if (end - i > num_len) {
+                std::string word = sql.substr(i, end - i);
+                boost::algorithm::to_lower(word);
+                if (word == "from" && depth == 0) {
+                    replace = true;
+                } else if (word == "select" && depth == 0 && is_select) {
+                    // union后的select列表
+                    replace = false;
+                    keep_depth = -1;
+                } else if (word == "by" || word == "limit" || word == "offset") {
+                    keep_depth = depth;
+                } else if (word == "having" && depth == keep_depth) {
+                    keep_depth = -1;
+                }
+                normalized->append(sql, i, end - i);
+                i = end;
+                continue;
+            }
+        }
+        if (num_len > 0) {
+            if (replace && keep_depth < 0) {
+                std::string text = sql.substr(i, num_len);
+                pb::ExprNode node;
+                node.set_num_children(0);
+                if (is_double) {
+                    node.set_node_type(pb::DOUBLE_LITERAL);
+                    node.set_col_type(pb::DOUBLE);
+                    node.mutable_derive_node()->set_double_val(strtod(text.c_str(), NULL));
+                } else {
+                    errno = 0;
+                    uint64_t val = strtoull(text.c_str(), NULL, 10);
+                    if (errno == ERANGE || val > (uint64_t)INT64_MAX) {
+                        // 超出int64的常量保留原文交给parser, 不参数化
+                        normalized->append(text);
+                        i += num_len;
+                        continue;
+                    }
+                    node.set_node_type(pb::INT_LITERAL);
+                    node.set_col_type(pb::INT64);
+                    node.mutable_derive_node()->set_int_val(val);
+                }
+                params->push_back(node);
+                normalized->push_back('?');
+            } else {
+                normalized->append(sql, i, num_len);
+            }
+            i += num_len;
+            continue;
+        }
+        if (c == '?' || c == '#' || (c == '-' && i + 1 < n && sql[i + 1] == '-')
+                || (c == '/' && i + 1 < n && sql[i + 1] == '*')) {
+            return false;
+        }
+        if (isspace((unsigned char)c)) {
+            // 连续空白合并成一个空格
+            if (!normalized->empty() && normalized->back() != ' ') {
+                normalized->push_back(' ');
+            }
+            ++i;
+            continue;
+        }
+        if (c == '(') {
+            ++depth;
+        } else if (c == ')') {
+            --depth;
+            if (depth < keep_depth) {
+                keep_depth = -1;
+            }
+        }
+        normalized->push_back(c);
+        ++i;
+    }
+    return true;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -143,6 +143,8 @@ int Separate::analyze(QueryContext* ctx) {
         pb_node.set_limit(-1);
         merge_agg_node = new AggNode;
         merge_agg_node->init(pb_node);
+        // 上层有merge, store上的聚合可以分批输出
+        agg_node->set_partial_flush();
 
         fetch_node->add_child(agg_node);
         merge_agg_node->add_child(fetch_node.release());
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "data_buffer.h"
+#include <limits.h>
+#include <sys/uio.h>
 
 namespace baikaldb {
 DataBuffer::DataBuffer(uint32_t capacity) {
@@ -32,6 +34,12 @@ DataBuffer::~DataBuffer() {
     if (_data != nullptr) {
         free(_data);
     }
+    for (auto& segment : _sealed) {
+        free(segment.data);
+    }
+    for (auto& segment : _free_segments) {
+        free(segment.data);
+    }
     _data = nullptr;
     _size = 0;
     _capacity = 0;
@@ -51,9 +59,103 @@ void DataBuffer::byte_array_clear() {
         }
     }
     _size = 0;
+    for (auto& segment : _sealed) {
+        recycle_segment(segment);
+    }
+    _sealed.clear();
+    _sealed_size = 0;
+    _sealed_offset = 0;
     return;
 }
 
+void DataBuffer::recycle_segment(const BufferSegment& segment) {
+    if (segment.capacity == DFT_ALLOC_BUF_SIZE && _free_segments.size() < MAX_FREE_SEGMENT_NUM) {
+        _free_segments.push_back(segment);
+    } else {
+        free(segment.data);
+    }
+}
+
+bool DataBuffer::byte_array_seal(size_t threshold) {
+    if (_size < threshold || _size == 0) {
+        return true;
+    }
+    BufferSegment next;
+    if (!_free_segments.empty()) {
+        next = _free_segments.back();
+        _free_segments.pop_back();
+    } else {
+        next.data = (uint8_t*)malloc(DFT_ALLOC_BUF_SIZE);
+        if (next.data == nullptr) {
+            DB_WARNING("malloc segment failed, size: %u", DFT_ALLOC_BUF_SIZE);
+            return false;
+        }
+        next.capacity = DFT_ALLOC_BUF_SIZE;
+    }
+    BufferSegment segment;
+    segment.data = _data;
+    segment.size = _size;
+    segment.capacity = _capacity;
+    _sealed.push_back(segment);
+    _sealed_size += _size;
+    _data = next.data;
+    _size = 0;
+    _capacity = next.capacity;
+    return true;
+}
+
+ssize_t DataBuffer::byte_array_writev(int fd, int* offset, size_t max_len) {
+    struct iovec iov[IOV_MAX];
+    int iov_cnt = 0;
+    size_t total = 0;
+    size_t seg_offset = _sealed_offset;
+    size_t seg_cnt = 0;
+    for (auto& segment : _sealed) {
+        if (iov_cnt >= IOV_MAX - 1 || total >= max_len) {
+            break;
+        }
+        size_t len = std::min(segment.size - seg_offset, max_len - total);
+        iov[iov_cnt].iov_base = segment.data + seg_offset;
+        iov[iov_cnt].iov_len = len;
+        ++iov_cnt;
+        ++seg_cnt;
+        total += len;
+        seg_offset = 0;
+    }
+    // 封存段全部加入后才能发送当前段
+    if (seg_cnt == _sealed.size() && total < max_len && _size > (size_t)*offset) {
+        size_t len = std::min(_size - *offset, max_len - total);
+        iov[iov_cnt].iov_base = _data + *offset;
+        iov[iov_cnt].iov_len = len;
+        ++iov_cnt;
+        total += len;
+    }
+    if (iov_cnt == 0) {
+        return 0;
+    }
+    ssize_t written = writev(fd, iov, iov_cnt);
+    if (written <= 0) {
+        return written;
+    }
+    // 发送完的封存段回收
+    size_t left = written;
+    while (left > 0 && !_sealed.empty()) {
+        BufferSegment& segment = _sealed.front();
+        size_t len = std::min(segment.size - _sealed_offset, left);
+        _sealed_offset += len;
+        _sealed_size -= len;
+        left -= len;
+        if (_sealed_offset < segment.size) {
+            break;
+        }
+        recycle_segment(segment);
+        _sealed.pop_front();
+        _sealed_offset = 0;
+    }
+    *offset += left;
+    return written;
+}
+
 bool DataBuffer::byte_array_append_size(int len, int is_pow) {
     if (_size + len <= _capacity) {
         return true;
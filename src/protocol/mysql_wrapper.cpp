@@ -14,6 +14,8 @@
 
 #include "mysql_wrapper.h"
 #include <unordered_set>
+#include <sys/epoll.h>
+#include <bthread/unstable.h>
 #include "network_socket.h"
 #include "query_context.h"
 
@@ -309,7 +311,7 @@ bool MysqlWrapper::make_err_packet(SmartSocket sock, MysqlErrCode err_code, cons
         return true;
     }
     DataBuffer* send_buf = sock->send_buf;
-    if (send_buf->_size > 0) {
+    if (send_buf->total_size() > 0) {
         send_buf->byte_array_clear();
     }
     MysqlErrorItem* item = _err_handler->get_error_item_by_code(err_code);
@@ -572,7 +574,7 @@ int MysqlWrapper::real_write(SmartSocket sock) {
         return RET_ERROR;
     }
     int ret = RET_ERROR;
-    int32_t we_want = sock->send_buf->_size - sock->send_buf_offset;
+    int32_t we_want = sock->send_buf->total_size() - sock->send_buf_offset;
 
     if (we_want <= 0) {
         if (sock->state == STATE_CONNECTED_CLIENT) {
@@ -582,7 +584,7 @@ int MysqlWrapper::real_write(SmartSocket sock) {
                 sock->fd,
                 sock->port,
                 we_want,
-                sock->send_buf->_size,
+                sock->send_buf->total_size(),
                 sock->send_buf_offset);
         }
         return RET_SUCCESS;
@@ -591,12 +593,10 @@ int MysqlWrapper::real_write(SmartSocket sock) {
     if (we_want > (int)MAX_WRITE_QUERY_RESULT_PACKET_LEN) {
         real_write = MAX_WRITE_QUERY_RESULT_PACKET_LEN;
     }
-    int len = write(sock->fd, sock->send_buf->_data + sock->send_buf_offset, real_write);
-    if (0 < len) {
-        sock->send_buf_offset += len;
-    } else if (len == 0) {
+    int len = sock->send_buf->byte_array_writev(sock->fd, &sock->send_buf_offset, real_write);
+    if (len == 0) {
         return RET_SHUTDOWN;
-    } else {
+    } else if (len < 0) {
         switch (errno) {
             case EAGAIN:
                 ret = RET_WAIT_FOR_EVENT;
@@ -619,6 +619,41 @@ int MysqlWrapper::real_write(SmartSocket sock) {
     return RET_SUCCESS;
 }
 
+int MysqlWrapper::flush_write(NetworkSocket* sock, int64_t timeout_ms) {
+    if (sock == nullptr || sock->send_buf == nullptr) {
+        DB_FATAL("sock == NULL or sock->send_buf == NULL");
+        return RET_ERROR;
+    }
+    DataBuffer* send_buf = sock->send_buf;
+    const timespec abstime = butil::milliseconds_from_now(timeout_ms);
+    while (sock->send_buf_offset < (int)send_buf->total_size()) {
+        if (sock->shutdown) {
+            return RET_SHUTDOWN;
+        }
+        ssize_t len = send_buf->byte_array_writev(sock->fd, &sock->send_buf_offset,
+                send_buf->total_size() - sock->send_buf_offset);
+        if (len > 0) {
+            continue;
+        } else if (len == 0) {
+            return RET_SHUTDOWN;
+        }
+        if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN) {
+            return RET_SHUTDOWN;
+        }
+        // 客户端接收慢时挂起当前bthread, 计划执行随之暂停
+        if (bthread_fd_timedwait(sock->fd, EPOLLOUT, &abstime) != 0) {
+            DB_WARNING("wait fd writable failed, fd: %d, errno: %d", sock->fd, errno);
+            return RET_ERROR;
+        }
+    }
+    // 保留send_buf的容量, 流式发送时不用反复扩容
+    send_buf->_size = 0;
+    sock->send_buf_offset = 0;
+    return RET_SUCCESS;
+}
+
 bool MysqlWrapper::make_eof_packet(DataBuffer* send_buf, int packet_id) {
     uint8_t bytes[4];
     bytes[0] = '\x05';
@@ -645,7 +680,7 @@ bool MysqlWrapper::make_simple_ok_packet(SmartSocket sock) {
         "\x00\x00"
         "\x00\x02"
         "\x00\x00\x00";
-    if (sock->send_buf->_size > 0) {
+    if (sock->send_buf->total_size() > 0) {
         sock->send_buf->byte_array_clear();
     }
     return sock->send_buf->network_queue_send_append(packet_ok, (sizeof(packet_ok) - 1), 1, 0);
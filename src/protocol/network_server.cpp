@@ -25,6 +25,7 @@ namespace baikaldb {
 DEFINE_int32(backlog, 1024, "Size of waitting queue in listen()");
 DEFINE_int32(baikal_port, 28282, "Server port");
 DEFINE_int32(epoll_timeout, 2000, "Epoll wait timeout in epoll_wait().");
+DEFINE_int32(reactor_num, 4, "number of epoll reactor threads, each has its own SO_REUSEPORT listen socket");
 DEFINE_int32(check_interval, 1, "interval for checking thread alive and conn idle timeout");
 DEFINE_int32(thread_idle_timeout, 100, "thread block(hang) threshold (second)");
 DEFINE_int32(connect_idle_timeout_s, 1800, "connection idle timeout threshold (second)");
@@ -56,6 +57,12 @@ void* thread_timer(void* param) {
     return nullptr;
 }
 
+void* thread_reactor(void* param) {
+    Reactor* reactor = static_cast<Reactor*>(param);
+    reactor->ret = NetworkServer::get_instance()->event_loop(reactor);
+    return nullptr;
+}
+
 // 1. read meta_db to get prepared (yet not committed) transactions left by last baikaldb instance
 // 2. try to commit transaction until success
 // 3. remove the transaction entry from the meta_db
@@ -208,13 +215,15 @@ void NetworkServer::connection_timeout_check() {
         DB_WARNING("get current time failed.");
         return;
     }
-    if (_epoll_info == NULL) {
-        DB_WARNING("_epoll_info not initialized yet.");
-        return;
+    for (auto& reactor : _reactors) {
+        connection_timeout_check(reactor.epoll_info);
     }
+}
 
+void NetworkServer::connection_timeout_check(EpollInfo* epoll_info) {
+    time_t time_now = time(NULL);
     for (int32_t idx = 0; idx < CONFIG_MPL_EPOLL_MAX_SIZE; ++idx) {
-        SmartSocket sock = _epoll_info->get_fd_mapping(idx);
+        SmartSocket sock = epoll_info->get_fd_mapping(idx);
         if (!sock) {
             continue;
         }
@@ -235,7 +244,7 @@ void NetworkServer::connection_timeout_check() {
             DB_WARNING("close un_authed connection [fd=%d][ip=%s][port=%d].",
                 sock->fd, sock->ip.c_str(), sock->port);
             sock->shutdown = true;
-            MachineDriver::get_instance()->dispatch(sock, _epoll_info,
+            MachineDriver::get_instance()->dispatch(sock, epoll_info,
                 sock->shutdown || _shutdown);
             continue;
         }
@@ -254,7 +263,7 @@ void NetworkServer::connection_timeout_check() {
             time_now, sock->last_active,
             sock->user_info->username.c_str());
         sock->shutdown = true;
-        MachineDriver::get_instance()->dispatch(sock, _epoll_info,
+        MachineDriver::get_instance()->dispatch(sock, epoll_info,
             sock->shutdown || _shutdown);
     }
 }
@@ -267,15 +276,14 @@ void NetworkServer::graceful_shutdown() {
 
 NetworkServer::NetworkServer():
         _is_init(false),
-        _shutdown(false),
-        _epoll_info(NULL) {
+        _shutdown(false) {
 }
 
 NetworkServer::~NetworkServer() {
     // Free epoll info.
-    if (_epoll_info != NULL) {
-        delete _epoll_info;
-        _epoll_info = NULL;
+    for (auto& reactor : _reactors) {
+        delete reactor.epoll_info;
+        reactor.epoll_info = nullptr;
     }
 }
 
@@ -354,23 +362,24 @@ void NetworkServer::stop() {
     pthread_join(_timer_tid, nullptr);
     _heartbeat_bth.join();
 
-    if (_epoll_info == nullptr) {
-        DB_WARNING("_epoll_info not initialized yet.");
-        return;
-    }
-    for (int32_t idx = 0; idx < CONFIG_MPL_EPOLL_MAX_SIZE; ++idx) {
-        SmartSocket sock = _epoll_info->get_fd_mapping(idx);
-        if (!sock) {
-            continue;
-        }
-        if (sock == nullptr || sock->in_pool == true || sock->fd == 0) {
+    for (auto& reactor : _reactors) {
+        if (reactor.epoll_info == nullptr) {
             continue;
         }
+        for (int32_t idx = 0; idx < CONFIG_MPL_EPOLL_MAX_SIZE; ++idx) {
+            SmartSocket sock = reactor.epoll_info->get_fd_mapping(idx);
+            if (!sock) {
+                continue;
+            }
+            if (sock == nullptr || sock->in_pool == true || sock->fd == 0) {
+                continue;
+            }
 
-        // 待现有工作处理完成，需要获取锁
-        if (sock->mutex.try_lock()) {
-            sock->shutdown = true;
-            MachineDriver::get_instance()->dispatch(sock, _epoll_info, true, false);
+            // 待现有工作处理完成，需要获取锁
+            if (sock->mutex.try_lock()) {
+                sock->shutdown = true;
+                MachineDriver::get_instance()->dispatch(sock, reactor.epoll_info, true, false);
+            }
         }
     }
     return;
@@ -388,7 +397,7 @@ bool NetworkServer::start() {
     return true;
 }
 
-SmartSocket NetworkServer::create_listen_socket() {
+SmartSocket NetworkServer::create_listen_socket(bool reuse_port) {
     // Fetch a socket.
     SocketPool* socket_pool = SocketPool::get_instance();
     SmartSocket sock = socket_pool->fetch(SERVER_SOCKET);
@@ -402,6 +411,11 @@ SmartSocket NetworkServer::create_listen_socket() {
         DB_FATAL("setsockopt fail");
         return SmartSocket();
     }
+    // 多个reactor各自listen同一端口, 由内核均衡accept
+    if (reuse_port && setsockopt(sock->fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) != 0) {
+        DB_FATAL("setsockopt SO_REUSEPORT fail, errno=%d, error=%s", errno, strerror(errno));
+        return SmartSocket();
+    }
     struct sockaddr_in listen_addr;
     listen_addr.sin_family = AF_INET;
     listen_addr.sin_addr.s_addr = INADDR_ANY;
@@ -426,12 +440,41 @@ SmartSocket NetworkServer::create_listen_socket() {
     return sock;
 }
 
+void NetworkServer::close_listen_socket(Reactor* reactor) {
+    if (reactor->service == nullptr || reactor->service->fd < 0) {
+        return;
+    }
+    // close后内核会把fd从epoll中移除
+    close(reactor->service->fd);
+    reactor->service->fd = -1;
+}
+
 int NetworkServer::make_worker_process() {
     _last_time.resize(_driver_thread_num);
     if (MachineDriver::get_instance()->init(_driver_thread_num, _last_time) != 0) {
         DB_FATAL("Failed to init machine driver.");
         exit(-1);
     }
+    // Create listen socket and epoll for each reactor.
+    // 在timer线程启动前建好, 检查连接时_reactors不再变化
+    int reactor_num = std::max(FLAGS_reactor_num, 1);
+    _reactors.resize(reactor_num);
+    for (auto& reactor : _reactors) {
+        reactor.service = create_listen_socket(reactor_num > 1);
+        if (reactor.service == nullptr) {
+            DB_FATAL("Failed to create listen socket.");
+            return -1;
+        }
+        reactor.epoll_info = new EpollInfo();
+        if (!reactor.epoll_info->init()) {
+            DB_FATAL("initial epoll info failed.");
+            return -1;
+        }
+        if (!reactor.epoll_info->poll_events_add(reactor.service, EPOLLIN)) {
+            DB_FATAL("poll_events_add add socket[%d] error", reactor.service->fd);
+            return -1;
+        }
+    }
     //create timer thread
     int ret = pthread_create(&_timer_tid, nullptr, thread_timer, this);
     if (ret != 0) {
@@ -441,36 +484,55 @@ int NetworkServer::make_worker_process() {
     _heartbeat_bth.run([this]() {report_heart_beat();});
     _recover_bth.run([this]() {recovery_transactions();});
 
-    // Create listen socket.
-    _service = create_listen_socket();
-    if (_service == nullptr) {
-        DB_FATAL("Failed to create listen socket.");
-        return -1;
-    }
-
-    // Initail epoll info.
-    _epoll_info = new EpollInfo();
-    if (!_epoll_info->init()) {
-        DB_FATAL("initial epoll info failed.");
-        return -1;
+    for (int i = 1; i < reactor_num; ++i) {
+        if (pthread_create(&_reactors[i].tid, nullptr, thread_reactor, &_reactors[i]) != 0) {
+            DB_FATAL("start reactor thread error, reactor:%d", i);
+            // 停掉已经启动的reactor, 关闭全部listen socket
+            _shutdown = true;
+            for (int j = 1; j < i; ++j) {
+                pthread_join(_reactors[j].tid, nullptr);
+            }
+            for (auto& reactor : _reactors) {
+                close_listen_socket(&reactor);
+            }
+            return -1;
+        }
     }
-    if (!_epoll_info->poll_events_add(_service, EPOLLIN)) {
-        DB_FATAL("poll_events_add add socket[%d] error", _service->fd);
-        return -1;
+    // 第0个reactor在当前线程运行
+    ret = _reactors[0].ret = event_loop(&_reactors[0]);
+    for (int i = 1; i < reactor_num; ++i) {
+        pthread_join(_reactors[i].tid, nullptr);
+        if (_reactors[i].ret != 0) {
+            DB_FATAL("reactor:%d exit with error:%d", i, _reactors[i].ret);
+            ret = _reactors[i].ret;
+        }
     }
+    DB_NOTICE("Baikal instance exit.");
+    return ret;
+}
+
+int NetworkServer::event_loop(Reactor* reactor) {
+    EpollInfo* epoll_info = reactor->epoll_info;
     // Process epoll events.
-    int listen_fd = _service->fd;
+    int listen_fd = reactor->service->fd;
     SocketPool* socket_pool = SocketPool::get_instance();
+    // 出错退出时其他reactor还在运行, 关掉listen socket让新连接只分给它们
+    ON_SCOPE_EXIT([&]() {
+        close_listen_socket(reactor);
+        if (!_shutdown) {
+            DB_FATAL("reactor exit before shutdown, listen socket closed");
+        }
+    });
     while (!_shutdown) {
-        int fd_cnt = _epoll_info->wait(FLAGS_epoll_timeout);
+        int fd_cnt = epoll_info->wait(FLAGS_epoll_timeout);
         if (_shutdown) {
             // Delete event from epoll.
-            _epoll_info->poll_events_delete(_service);
+            epoll_info->poll_events_delete(reactor->service);
         }
 
         for (int cnt = 0; cnt < fd_cnt; ++cnt) {
-            int fd = _epoll_info->get_ready_fd(cnt);
-            int event = _epoll_info->get_ready_events(cnt);
+            int fd = epoll_info->get_ready_fd(cnt);
+            int event = epoll_info->get_ready_events(cnt);
 
             // New connection.
             if (!_shutdown && listen_fd == fd) {
@@ -513,11 +575,13 @@ int NetworkServer::make_worker_process() {
                 client_socket->server_instance_id = _instance_id;
 
                 // Set socket mapping and event.
-                if (!_epoll_info->set_fd_mapping(client_socket->fd, client_socket)) {
-                    DB_FATAL("Failed to set fd mapping.");
-                    return -1;
+                if (!epoll_info->set_fd_mapping(client_socket->fd, client_socket)) {
+                    DB_FATAL("Failed to set fd mapping, fd:[%d]", client_fd);
+                    close(client_fd);
+                    client_socket->fd = -1;
+                    continue;
                 }
-                _epoll_info->poll_events_add(client_socket, 0);
+                epoll_info->poll_events_add(client_socket, 0);
 
                 // New connection will be handled immediately.
                 fd = client_fd;
@@ -529,7 +593,7 @@ int NetworkServer::make_worker_process() {
             }
 
             // Check if socket in fd_mapping or not.
-            SmartSocket sock = _epoll_info->get_fd_mapping(fd);
+            SmartSocket sock = epoll_info->get_fd_mapping(fd);
             if (sock == NULL) {
                 DB_DEBUG("Can't find fd in fd_mapping, fd:[%d], listen_fd:[%d], fd_cnt:[%d]",
                             fd, listen_fd, cnt);
@@ -578,15 +642,14 @@ int NetworkServer::make_worker_process() {
                 }
                 // close the socket event on epoll when the sock is being process
                 // and reopen it when finish process
-                _epoll_info->poll_events_mod(sock, 0);
-                MachineDriver::get_instance()->dispatch(sock, _epoll_info,
+                epoll_info->poll_events_mod(sock, 0);
+                MachineDriver::get_instance()->dispatch(sock, epoll_info,
                     sock->shutdown || _shutdown);
             } else {
                 DB_WARNING("unknown network socket type[%d].", sock->socket_type);
             }
         }
     }
-    DB_NOTICE("Baikal instance exit.");
     return 0;
 }
 
@@ -16,12 +16,15 @@
 #include <boost/algorithm/string.hpp>
 #include "network_server.h"
 #include "query_context.h"
+#include "plan_cache.h"
+#include "parser.h"
 #include <rapidjson/reader.h>
 #include <rapidjson/document.h>
 
 namespace baikaldb {
 DEFINE_int32(max_connections_per_user, 4000, "default user max connections");
 DEFINE_int32(query_quota_per_user, 3000, "default user query quota by 1 second");
+DEFINE_int32(max_prepared_stmt_per_connection, 1024, "max prepared statements of a connection");
 
 void StateMachine::run_machine(SmartSocket client,
         EpollInfo* epoll_info,
@@ -565,16 +568,12 @@ int StateMachine::_query_read(SmartSocket sock) {
     if (COM_PING == command) {                     // COM_PING
         sock->query_ctx->type = _get_query_type(sock->query_ctx);
         return RET_SUCCESS;
-    } else if (COM_STMT_EXECUTE == command) {           // this is COM_EXECUTE Packet
-        DB_FATAL_CLIENT(sock, "server is read_only, so it can not "
-                "execute statement command:[%d]", command);
-        _wrapper->make_err_packet(sock, ER_NOT_ALLOWED_COMMAND, "comand not supported");
-        return RET_CMD_UNSUPPORT;
-    } else if (COM_STMT_CLOSE == command) {      // this is COM_STMT_CLOSE
-        DB_FATAL_CLIENT(sock, "server is read_only, so it can not "
-                "execute stmt_close statement, command:[%d]", command);
-        _wrapper->make_err_packet(sock, ER_NOT_ALLOWED_COMMAND, "comand not supported");
-        return RET_CMD_UNSUPPORT;
+    } else if (COM_STMT_EXECUTE == command || COM_STMT_CLOSE == command
+            || COM_STMT_RESET == command) {
+        // 包体是二进制格式, 在_query_process中按stmt_id处理
+        sock->query_ctx->stmt_packet.assign((const char*)packet + off, sock->packet_len - 1);
+        sock->query_ctx->type = SQL_UNKNOWN_NUM;
+        return RET_SUCCESS;
     } else {                                    // this is COM_QUERY Packet
         // Read query sql.
         int sql_len = sock->packet_len - 1;
@@ -629,6 +628,15 @@ bool StateMachine::_query_process(SmartSocket client) {
         client->state = STATE_READ_QUERY_RESULT;
         return true;
     }
+    if (command == COM_STMT_EXECUTE) {    // 0x17 command: mysql_stmt_execute
+        ret = _handle_client_stmt_execute(client);
+        client->state = STATE_READ_QUERY_RESULT;
+        return ret;
+    } else if (command == COM_STMT_CLOSE || command == COM_STMT_RESET) {
+        ret = _handle_client_stmt_close(client);
+        client->state = STATE_READ_QUERY_RESULT;
+        return ret;
+    }
     if (client->query_ctx->sql.size() == 0) {
         DB_FATAL("SQL size is 0.");
         return false;
@@ -733,17 +741,8 @@ bool StateMachine::_query_process(SmartSocket client) {
         _wrapper->make_err_packet(client, ER_NOT_ALLOWED_COMMAND, "comand not supported");
         client->state = STATE_ERROR_REUSE;
     } else if (command == COM_STMT_PREPARE) { // 0x16 command: mysql_stmt_prepare
-        DB_FATAL_CLIENT(client, "unsupport command[%s]", client->query_ctx->sql.c_str());
-        _wrapper->make_err_packet(client, ER_NOT_ALLOWED_COMMAND, "comand not supported");
-        client->state = STATE_ERROR_REUSE;
-    } else if (command == COM_STMT_EXECUTE) { // 0x17 command: mysql_stmt_execute
-        DB_FATAL_CLIENT(client, "unsupport command[%s]", client->query_ctx->sql.c_str());
-        _wrapper->make_err_packet(client, ER_NOT_ALLOWED_COMMAND, "comand not supported");
-        client->state = STATE_ERROR_REUSE;
-    } else if (command == COM_STMT_CLOSE) {  // 0x19 command: mysql_stmt_close
-        DB_FATAL_CLIENT(client, "unsupport command[%s]", client->query_ctx->sql.c_str());
-        _wrapper->make_err_packet(client, ER_NOT_ALLOWED_COMMAND, "comand not supported");
-        client->state = STATE_ERROR_REUSE;
+        ret = _handle_client_stmt_prepare(client);
+        client->state = STATE_READ_QUERY_RESULT;
     } else {                                 // Unsupport command.
         DB_FATAL_CLIENT(client, "unsupport command[%s]", client->query_ctx->sql.c_str());
         _wrapper->make_err_packet(client, ER_NOT_ALLOWED_COMMAND, "comand not supported");
@@ -2245,7 +2244,10 @@ bool StateMachine::_handle_client_query_common_query(SmartSocket client) {
     TimeCost cost1;
 
     int ret = 0;
-    ret = LogicalPlanner::analyze(client->query_ctx.get());
+    // prepare语句的plan已由模板绑定参数生成
+    if (!client->query_ctx->is_prepared_plan) {
+        ret = PlanCache::get_instance()->analyze(client->query_ctx.get());
+    }
     if (ret < 0) {
         DB_WARNING_CLIENT(client, "Failed to LogicalPlanner::analyze: %s",
             client->query_ctx->sql.c_str());
@@ -2322,6 +2324,10 @@ bool StateMachine::_handle_client_query_common_query(SmartSocket client) {
     if (ret < 0) {
         DB_FATAL_CLIENT(client, "Failed to PhysicalPlanner::execute: %s",
             client->query_ctx->sql.c_str());
+        // 部分结果已经发出, 错误包接不上结果集, 发送后断开连接
+        if (client->query_ctx->runtime_state.result_flushed()) {
+            client->state = STATE_ERROR;
+        }
 
         if (client->query_ctx->stat_info.error_code == ER_ERROR_FIRST) {
             client->query_ctx->stat_info.error_code = ER_EXEC_PLAN_FAILED;
@@ -2333,7 +2339,390 @@ bool StateMachine::_handle_client_query_common_query(SmartSocket client) {
         return false;
     }
     client->query_ctx->stat_info.query_exec_time = cost.get_time();
-    client->query_ctx->stat_info.send_buf_size = client->send_buf->_size;
+    client->query_ctx->stat_info.send_buf_size = client->send_buf->total_size();
+    return true;
+}
+
+int StateMachine::_parse_stmt_params(SmartSocket client, PreparedStmt* stmt,
+        std::vector<pb::ExprNode>* params) {
+    const std::string& packet = client->query_ctx->stmt_packet;
+    // stmt_id(4), flags(1), iteration_count(4)
+    size_t pos = 9;
+    auto read_int = [&packet, &pos](size_t len, uint64_t* value) -> bool {
+        if (pos + len > packet.size()) {
+            return false;
+        }
+        *value = 0;
+        for (size_t i = 0; i < len; i++) {
+            *value |= (uint64_t)(uint8_t)packet[pos + i] << (i * 8);
+        }
+        pos += len;
+        return true;
+    };
+    auto read_length_coded = [&read_int](uint64_t* value) -> bool {
+        uint64_t first = 0;
+        if (!read_int(1, &first)) {
+            return false;
+        }
+        if (first < 251) {
+            *value = first;
+            return true;
+        } else if (first == 252) {
+            return read_int(2, value);
+        } else if (first == 253) {
+            return read_int(3, value);
+        } else if (first == 254) {
+            return read_int(8, value);
+        }
+        return false;
+    };
+    if (stmt->num_params == 0) {
+        return 0;
+    }
+    size_t null_bitmap_pos = pos;
+    pos += (stmt->num_params + 7) / 8;
+    uint64_t new_params_bound = 0;
+    if (!read_int(1, &new_params_bound)) {
+        DB_WARNING_CLIENT(client, "execute packet too short, size: %lu", packet.size());
+        return -1;
+    }
+    // 类型只在第一次execute或类型变化时发送
+    if (new_params_bound == 1) {
+        stmt->param_types.resize(stmt->num_params);
+        for (int i = 0; i < stmt->num_params; i++) {
+            uint64_t type = 0;
+            if (!read_int(2, &type)) {
+                DB_WARNING_CLIENT(client, "read param type failed, idx: %d", i);
+                return -1;
+            }
+            stmt->param_types[i] = type;
+        }
+    }
+    if ((int)stmt->param_types.size() != stmt->num_params) {
+        DB_WARNING_CLIENT(client, "param types not bound");
+        return -1;
+    }
+    params->resize(stmt->num_params);
+    for (int i = 0; i < stmt->num_params; i++) {
+        pb::ExprNode& param = (*params)[i];
+        param.set_num_children(0);
+        uint8_t null_flag = packet[null_bitmap_pos + i / 8];
+        uint8_t type = stmt->param_types[i] & 0xff;
+        bool is_unsigned = (stmt->param_types[i] >> 8) & 0x80;
+        if ((null_flag & (1 << (i % 8))) || type == MYSQL_TYPE_NULL) {
+            param.set_node_type(pb::NULL_LITERAL);
+            param.set_col_type(pb::NULL_TYPE);
+            continue;
+        }
+        uint64_t value = 0;
+        switch (type) {
+            case MYSQL_TYPE_TINY:
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_YEAR:
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_INT24:
+            case MYSQL_TYPE_LONGLONG: {
+                size_t len = 8;
+                if (type == MYSQL_TYPE_TINY) {
+                    len = 1;
+                } else if (type == MYSQL_TYPE_SHORT || type == MYSQL_TYPE_YEAR) {
+                    len = 2;
+                } else if (type == MYSQL_TYPE_LONG || type == MYSQL_TYPE_INT24) {
+                    len = 4;
+                }
+                if (!read_int(len, &value)) {
+                    return -1;
+                }
+                if (is_unsigned && value > (uint64_t)INT64_MAX) {
+                    param.set_node_type(pb::STRING_LITERAL);
+                    param.set_col_type(pb::STRING);
+                    param.mutable_derive_node()->set_string_val(std::to_string(value));
+                    break;
+                }
+                int64_t num = value;
+                if (!is_unsigned && len < 8) {
+                    // 符号扩展
+                    int shift = 64 - len * 8;
+                    num = (int64_t)(value << shift) >> shift;
+                }
+                param.set_node_type(pb::INT_LITERAL);
+                param.set_col_type(pb::INT64);
+                param.mutable_derive_node()->set_int_val(num);
+                break;
+            }
+            case MYSQL_TYPE_FLOAT:
+            case MYSQL_TYPE_DOUBLE: {
+                double num = 0;
+                if (type == MYSQL_TYPE_FLOAT) {
+                    float f = 0;
+                    if (!read_int(4, &value)) {
+                        return -1;
+                    }
+                    uint32_t bits = value;
+                    memcpy(&f, &bits, sizeof(f));
+                    num = f;
+                } else {
+                    if (!read_int(8, &value)) {
+                        return -1;
+                    }
+                    memcpy(&num, &value, sizeof(num));
+                }
+                param.set_node_type(pb::DOUBLE_LITERAL);
+                param.set_col_type(pb::DOUBLE);
+                param.mutable_derive_node()->set_double_val(num);
+                break;
+            }
+            case MYSQL_TYPE_DATE:
+            case MYSQL_TYPE_DATETIME:
+            case MYSQL_TYPE_TIMESTAMP: {
+                // 长度(0/4/7/11), year(2), month, day, hour, minute, second, microsecond(4)
+                uint64_t len = 0;
+                uint64_t fields[7] = {0, 0, 0, 0, 0, 0, 0};
+                size_t field_lens[7] = {2, 1, 1, 1, 1, 1, 4};
+                if (!read_int(1, &len) || len > 11) {
+                    return -1;
+                }
+                size_t end = pos + len;
+                for (int j = 0; j < 7 && pos < end; j++) {
+                    if (!read_int(field_lens[j], &fields[j])) {
+                        return -1;
+                    }
+                }
+                char buf[30] = {0};
+                snprintf(buf, sizeof(buf), "%04lu-%02lu-%02lu %02lu:%02lu:%02lu.%06lu",
+                        fields[0], fields[1], fields[2], fields[3], fields[4], fields[5],
+                        fields[6]);
+                param.set_node_type(pb::STRING_LITERAL);
+                param.set_col_type(pb::STRING);
+                param.mutable_derive_node()->set_string_val(buf);
+                break;
+            }
+            case MYSQL_TYPE_TIME: {
+                // 长度(0/8/12), is_negative, days(4), hour, minute, second, microsecond(4)
+                uint64_t len = 0;
+                uint64_t fields[6] = {0, 0, 0, 0, 0, 0};
+                size_t field_lens[6] = {1, 4, 1, 1, 1, 4};
+                if (!read_int(1, &len) || len > 12) {
+                    return -1;
+                }
+                size_t end = pos + len;
+                for (int j = 0; j < 6 && pos < end; j++) {
+                    if (!read_int(field_lens[j], &fields[j])) {
+                        return -1;
+                    }
+                }
+                char buf[30] = {0};
+                snprintf(buf, sizeof(buf), "%s%02lu:%02lu:%02lu", fields[0] ? "-" : "",
+                        fields[1] * 24 + fields[2], fields[3], fields[4]);
+                param.set_node_type(pb::STRING_LITERAL);
+                param.set_col_type(pb::STRING);
+                param.mutable_derive_node()->set_string_val(buf);
+                break;
+            }
+            default: {
+                // 字符串, decimal, blob等都是length coded string
+                uint64_t len = 0;
+                if (!read_length_coded(&len) || pos + len > packet.size()) {
+                    return -1;
+                }
+                param.set_node_type(pb::STRING_LITERAL);
+                param.set_col_type(pb::STRING);
+                param.mutable_derive_node()->set_string_val(packet.data() + pos, len);
+                pos += len;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+bool StateMachine::_handle_client_stmt_prepare(SmartSocket client) {
+    auto ctx = client->query_ctx;
+    if ((int)client->prepared_stmts.size() >= FLAGS_max_prepared_stmt_per_connection) {
+        _wrapper->make_err_packet(client, ER_MAX_PREPARED_STMT_COUNT_REACHED,
+                "Can't create more than max_prepared_stmt_count statements (current value: %d)",
+                FLAGS_max_prepared_stmt_per_connection);
+        return false;
+    }
+    std::shared_ptr<PreparedStmt> stmt(new (std::nothrow)PreparedStmt);
+    if (stmt == nullptr) {
+        DB_FATAL("create prepared stmt failed");
+        return false;
+    }
+    stmt->sql = ctx->sql;
+    stmt->comments = ctx->comments;
+    stmt->type = ctx->type;
+
+    parser::SqlParser parser;
+    parser.charset = client->charset_name;
+    parser.parse(stmt->sql);
+    if (parser.error != parser::SUCC || parser.result.size() != 1
+            || parser.result[0] == nullptr) {
+        DB_WARNING_CLIENT(client, "parsing error! errno: %d, errmsg: %s, sql: %s",
+                parser.error, parser.syntax_err_str.c_str(), stmt->sql.c_str());
+        _wrapper->make_err_packet(client, ER_SYNTAX_ERROR, "syntax error! errno: %d errmsg: %s",
+                parser.error, parser.syntax_err_str.c_str());
+        return false;
+    }
+    stmt->num_params = parser.place_holder_id;
+    // execute只走逻辑计划, COM_QUERY里单独处理的语句(set/show/use/desc, select @@...等)不支持
+    parser::NodeType stmt_type = parser.result[0]->node_type;
+    bool special_select = boost::icontains(stmt->sql, "@@")
+            || boost::iequals(stmt->sql, SQL_SELECT_1)
+            || boost::iequals(stmt->sql, SQL_SELECT_DATABASE);
+    if ((stmt_type != parser::NT_SELECT && stmt_type != parser::NT_INSERT
+            && stmt_type != parser::NT_UPDATE && stmt_type != parser::NT_DELETE)
+            || (stmt_type == parser::NT_SELECT && special_select)) {
+        DB_WARNING_CLIENT(client, "unsupported prepared stmt, type: %d, sql: %s",
+                stmt_type, stmt->sql.c_str());
+        _wrapper->make_err_packet(client, ER_UNSUPPORTED_PS,
+                "This command is not supported in the prepared statement protocol yet");
+        return false;
+    }
+    ctx->runtime_state.set_client_conn(client.get());
+    // insert在plan时就计算values, 不生成模板
+    if (stmt_type == parser::NT_SELECT || stmt_type == parser::NT_UPDATE
+            || stmt_type == parser::NT_DELETE) {
+        if (PlanTemplate::create(stmt->sql, stmt->num_params, ctx.get(),
+                &stmt->plan_template) != 0) {
+            DB_WARNING_CLIENT(client, "make plan template failed, sql: %s", stmt->sql.c_str());
+            if (ctx->stat_info.error_code == ER_ERROR_FIRST) {
+                ctx->stat_info.error_code = ER_GEN_PLAN_FAILED;
+                ctx->stat_info.error_msg << "get logical plan failed";
+            }
+            _wrapper->make_err_packet(client, ctx->stat_info.error_code, "%s",
+                    ctx->stat_info.error_msg.str().c_str());
+            return false;
+        }
+    }
+    uint32_t stmt_id = ++client->last_stmt_id;
+    client->prepared_stmts[stmt_id] = stmt;
+
+    // COM_STMT_PREPARE_OK: 0x00, stmt_id(4), num_columns(2), num_params(2), filler, warnings(2)
+    // 结果列在execute时返回
+    uint8_t bytes[12];
+    bytes[0] = 0x00;
+    for (int i = 0; i < 4; i++) {
+        bytes[1 + i] = (stmt_id >> (i * 8)) & 0xff;
+    }
+    bytes[5] = 0;
+    bytes[6] = 0;
+    bytes[7] = stmt->num_params & 0xff;
+    bytes[8] = (stmt->num_params >> 8) & 0xff;
+    bytes[9] = 0;
+    bytes[10] = 0;
+    bytes[11] = 0;
+    if (client->send_buf->total_size() > 0) {
+        client->send_buf->byte_array_clear();
+    }
+    if (!client->send_buf->network_queue_send_append(bytes, sizeof(bytes), 1, 0)) {
+        DB_FATAL_CLIENT(client, "Failed to make prepare ok packet.");
+        return false;
+    }
+    int packet_id = 1;
+    if (stmt->num_params > 0) {
+        ResultField field;
+        field.name = "?";
+        field.type = MYSQL_TYPE_VAR_STRING;
+        for (int i = 0; i < stmt->num_params; i++) {
+            _wrapper->make_field_packet(client->send_buf, &field, ++packet_id);
+        }
+        _wrapper->make_eof_packet(client->send_buf, ++packet_id);
+    }
+    DB_NOTICE("prepare stmt_id: %u, num_params: %d, use_template: %d, sql: %s",
+            stmt_id, stmt->num_params, stmt->plan_template != nullptr, stmt->sql.c_str());
+    return true;
+}
+
+bool StateMachine::_handle_client_stmt_execute(SmartSocket client) {
+    auto ctx = client->query_ctx;
+    const std::string& packet = ctx->stmt_packet;
+    if (packet.size() < 9) {
+        DB_WARNING_CLIENT(client, "execute packet too short, size: %lu", packet.size());
+        _wrapper->make_err_packet(client, ER_MALFORMED_PACKET, "Malformed communication packet.");
+        return false;
+    }
+    uint32_t stmt_id = 0;
+    for (int i = 0; i < 4; i++) {
+        stmt_id |= (uint32_t)(uint8_t)packet[i] << (i * 8);
+    }
+    auto iter = client->prepared_stmts.find(stmt_id);
+    if (iter == client->prepared_stmts.end()) {
+        _wrapper->make_err_packet(client, ER_UNKNOWN_STMT_HANDLER,
+                "Unknown prepared statement handler (%u) given to mysqld_stmt_execute", stmt_id);
+        return false;
+    }
+    std::shared_ptr<PreparedStmt> stmt = iter->second;
+    std::vector<pb::ExprNode> params;
+    if (_parse_stmt_params(client, stmt.get(), &params) != 0) {
+        _wrapper->make_err_packet(client, ER_MALFORMED_PACKET, "Malformed communication packet.");
+        return false;
+    }
+    ctx->sql = stmt->sql;
+    ctx->comments = stmt->comments;
+    ctx->type = stmt->type;
+    _get_json_attributes(ctx);
+    ctx->runtime_state.set_client_conn(client.get());
+
+    // 表结构或权限变更后重新生成模板
+    if (stmt->plan_template != nullptr && !stmt->plan_template->is_valid(ctx.get())) {
+        DB_WARNING_CLIENT(client, "plan template expired, re-prepare stmt_id: %u", stmt_id);
+        if (PlanTemplate::create(stmt->sql, stmt->num_params, ctx.get(),
+                &stmt->plan_template) != 0) {
+            if (ctx->stat_info.error_code == ER_ERROR_FIRST) {
+                ctx->stat_info.error_code = ER_GEN_PLAN_FAILED;
+                ctx->stat_info.error_msg << "get logical plan failed";
+            }
+            _wrapper->make_err_packet(client, ctx->stat_info.error_code, "%s",
+                    ctx->stat_info.error_msg.str().c_str());
+            return false;
+        }
+    }
+    if (stmt->plan_template != nullptr) {
+        stmt->plan_template->bind(params, ctx.get());
+    } else {
+        // 参数直接绑定到语法树的literal, 不拼接sql
+        ctx->stmt_params.swap(params);
+    }
+    ctx->runtime_state.set_binary_protocol(true);
+
+    //对于正常的请求做限制
+    if (client->user_info->is_exceed_quota()) {
+        _wrapper->make_err_packet(client, ER_QUERY_EXCEED_QUOTA, "query exceed quota(qps)");
+        DB_WARNING("query exceed quota, user:%s, query:%u, quota:%u, time:%ld", 
+                client->username.c_str(),
+                client->user_info->query_count.load(),
+                client->user_info->query_quota,
+                client->user_info->query_cost.get_time());
+        return true;
+    }
+    return _handle_client_query_common_query(client);
+}
+
+bool StateMachine::_handle_client_stmt_close(SmartSocket client) {
+    auto ctx = client->query_ctx;
+    const std::string& packet = ctx->stmt_packet;
+    if (packet.size() < 4) {
+        DB_WARNING_CLIENT(client, "stmt packet too short, size: %lu", packet.size());
+        _wrapper->make_err_packet(client, ER_MALFORMED_PACKET, "Malformed communication packet.");
+        return false;
+    }
+    uint32_t stmt_id = 0;
+    for (int i = 0; i < 4; i++) {
+        stmt_id |= (uint32_t)(uint8_t)packet[i] << (i * 8);
+    }
+    if (ctx->mysql_cmd == COM_STMT_CLOSE) {
+        // COM_STMT_CLOSE没有回包
+        client->prepared_stmts.erase(stmt_id);
+        return true;
+    }
+    // COM_STMT_RESET: 不支持COM_STMT_SEND_LONG_DATA, 没有需要重置的数据
+    if (client->prepared_stmts.count(stmt_id) == 0) {
+        _wrapper->make_err_packet(client, ER_UNKNOWN_STMT_HANDLER,
+                "Unknown prepared statement handler (%u) given to mysqld_stmt_reset", stmt_id);
+        return false;
+    }
+    _wrapper->make_simple_ok_packet(client);
     return true;
 }
 
@@ -0,0 +1,97 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log_group_writer.h"
+
+namespace baikaldb {
+DEFINE_bool(raft_log_group_commit, true, "merge raft log appends of all regions into one write");
+DEFINE_int32(raft_log_group_max_bytes, 4 * 1024 * 1024,
+        "max bytes of one merged raft log write batch");
+
+int LogGroupWriter::init() {
+    if (_is_init) {
+        return 0;
+    }
+    int ret = bthread::execution_queue_start(&_queue_id, nullptr, group_write, (void*)this);
+    if (ret != 0) {
+        DB_FATAL("execution_queue_start error, %d", ret);
+        return -1;
+    }
+    _is_init = true;
+    return 0;
+}
+
+rocksdb::Status LogGroupWriter::write(RocksWrapper* db, rocksdb::ColumnFamilyHandle* handle,
+        const KVVec& kv_vec) {
+    rocksdb::Status status;
+    if (FLAGS_raft_log_group_commit && _is_init) {
+        BthreadCond cond;
+        cond.increase();
+        WriteTask task = {db, handle, &kv_vec, &status, &cond};
+        if (bthread::execution_queue_execute(_queue_id, task) == 0) {
+            cond.wait();
+            return status;
+        }
+        DB_WARNING("execution_queue_execute fail, write directly");
+    }
+    rocksdb::WriteBatch batch;
+    for (auto& kv : kv_vec) {
+        batch.Put(handle, kv.first, kv.second);
+    }
+    return db->write(rocksdb::WriteOptions(), &batch);
+}
+
+void LogGroupWriter::flush(RocksWrapper* db, rocksdb::WriteBatch* batch,
+        std::vector<WriteTask>* tasks) {
+    if (tasks->empty()) {
+        return;
+    }
+    rocksdb::Status status = db->write(rocksdb::WriteOptions(), batch);
+    if (!status.ok()) {
+        DB_FATAL("group write raft log fail, tasks:%lu, err_mes:%s",
+                tasks->size(), status.ToString().c_str());
+    }
+    for (auto& task : *tasks) {
+        *task.status = status;
+        task.cond->decrease_signal();
+    }
+    batch->Clear();
+    tasks->clear();
+}
+
+// 每次消费时队列里积攒的所有请求合并成一批写入
+int LogGroupWriter::group_write(void* meta, bthread::TaskIterator<WriteTask>& iter) {
+    if (iter.is_queue_stopped()) {
+        return 0;
+    }
+    rocksdb::WriteBatch batch;
+    std::vector<WriteTask> tasks;
+    RocksWrapper* db = nullptr;
+    for (; iter; ++iter) {
+        WriteTask& task = *iter;
+        if (db != task.db || batch.GetDataSize() >= (size_t)FLAGS_raft_log_group_max_bytes) {
+            flush(db, &batch, &tasks);
+            db = task.db;
+        }
+        for (auto& kv : *task.kv_vec) {
+            batch.Put(task.handle, kv.first, kv.second);
+        }
+        tasks.push_back(task);
+    }
+    flush(db, &batch, &tasks);
+    return 0;
+}
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
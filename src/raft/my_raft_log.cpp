@@ -14,6 +14,7 @@
 
 #include <my_raft_log.h>
 #include <my_raft_log_storage.h>
+#include <log_group_writer.h>
 #include <pthread.h> 
 
 namespace baikaldb {
@@ -28,6 +29,9 @@ static void register_once_or_die() {
     static MyRaftLogExtension* s_ext = new MyRaftLogExtension;
     braft::log_storage_extension()->RegisterOrDie("myraftlog", &s_ext->my_raft_log_storage);
     DB_WARNING("Registered myraftlog extension");
+    if (LogGroupWriter::get_instance()->init() != 0) {
+        DB_FATAL("LogGroupWriter init fail, raft log will be written directly");
+    }
 }
 
 int register_myraftlog_extension() {
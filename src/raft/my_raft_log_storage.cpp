@@ -14,10 +14,35 @@
 
 #include "my_raft_log_storage.h"
 #include <boost/lexical_cast.hpp>
+#include <bvar/bvar.h>
 #include "raft_log_compaction_filter.h"
 #include "can_add_peer_setter.h"
+#include "log_group_writer.h"
 
 namespace baikaldb {
+DEFINE_int32(raft_log_cache_entries, 1024, "max cached raft log entries per region");
+DEFINE_int64(raft_log_cache_total_bytes, 512 * 1024 * 1024LL,
+        "max bytes of cached raft log entries of all regions");
+
+static std::atomic<int64_t> g_raft_log_cache_bytes(0);
+// 有缓存的region按最近访问排序, 最久没访问的在前
+struct RaftLogCacheLru {
+    RaftLogCacheLru() {
+        bthread_mutex_init(&mutex, NULL);
+    }
+    bthread_mutex_t mutex;
+    std::list<MyRaftLogStorage*> storages;
+};
+static RaftLogCacheLru g_raft_log_cache_lru;
+static bvar::Adder<int64_t> g_raft_log_cache_hit("raft_log_cache_hit");
+static bvar::Adder<int64_t> g_raft_log_cache_miss("raft_log_cache_miss");
+static double get_raft_log_cache_hit_ratio(void*) {
+    int64_t hit = g_raft_log_cache_hit.get_value();
+    int64_t total = hit + g_raft_log_cache_miss.get_value();
+    return total == 0 ? 0 : (double)hit / total;
+}
+static bvar::PassiveStatus<double> g_raft_log_cache_hit_ratio(
+        "raft_log_cache_hit_ratio", get_raft_log_cache_hit_ratio, NULL);
 
 int parse_my_raft_log_uri(const std::string& uri, std::string& id){
     size_t pos = uri.find("id=");
@@ -40,10 +65,14 @@ MyRaftLogStorage::MyRaftLogStorage(
             _db(db),
             _handle(handle) {
     bthread_mutex_init(&_mutex, NULL);        
+    bthread_mutex_init(&_cache_mutex, NULL);
 }
 
 MyRaftLogStorage::~MyRaftLogStorage() {
+    _lru_remove();
+    _cache_truncate_prefix(INT64_MAX);
     bthread_mutex_destroy(&_mutex);
+    bthread_mutex_destroy(&_cache_mutex);
 }
 
 braft::LogStorage* MyRaftLogStorage::new_instance(const std::string& uri) const {
@@ -210,6 +239,10 @@ int MyRaftLogStorage::init(braft::ConfigurationManager* configuration_manager) {
 }
 
 braft::LogEntry* MyRaftLogStorage::get_entry(const int64_t index) {
+    braft::LogEntry* cached = _cache_get(index);
+    if (cached != NULL) {
+        return cached;
+    }
     char buf[LOG_DATA_KEY_SIZE];
     _encode_log_data_key(buf, LOG_DATA_KEY_SIZE, index);
     std::string value;
@@ -319,16 +352,8 @@ int MyRaftLogStorage::append_entries(const std::vector<braft::LogEntry*>& entrie
         kv_vec.emplace_back(key, value);
     }
     
-    // write date to rocksdb in batch
-    rocksdb::WriteBatch batch;
-    rocksdb::WriteOptions options;
-    //options.sync = true;
-    //options.disableWAL = true;
-    
-    for (auto iter = kv_vec.begin(); iter != kv_vec.end(); ++iter) {
-        batch.Put(_handle, iter->first, iter->second);
-    }
-    auto status = _db->write(options, &batch);
+    // write date to rocksdb in batch, 和其他region的append合并写入
+    auto status = LogGroupWriter::get_instance()->write(_db, _handle, kv_vec);
     if (!status.ok()) {
         DB_FATAL("Fail to write db, region_id: %ld, err_mes:%s",
                         _region_id, status.ToString().c_str());
@@ -345,6 +370,7 @@ int MyRaftLogStorage::append_entries(const std::vector<braft::LogEntry*>& entrie
         }
     }
     _last_log_index.fetch_add(entries.size());
+    _cache_append(entries);
     //DB_WARNING("append_entry, entries.size:%ld, time_cost:%ld, region_id: %ld",
     //            entries.size(), time_cost.get_time(), _region_id);
     return (int)entries.size();
@@ -363,6 +389,7 @@ int MyRaftLogStorage::truncate_prefix(const int64_t first_index_kept) {
         _last_log_index.store(first_index_kept - 1);
     }
     _term_map.truncate_prefix(first_index_kept);
+    _cache_truncate_prefix(first_index_kept);
     RaftLogCompactionFilter::get_instance()->update_first_index_map(_region_id, first_index_kept);
     lck.unlock();
     CanAddPeerSetter::get_instance()->set_can_add_peer(_region_id);
@@ -392,6 +419,7 @@ int MyRaftLogStorage::truncate_suffix(const int64_t last_index_kept) {
     }
     _term_map.truncate_suffix(last_index_kept);
     _last_log_index.store(last_index_kept);
+    _cache_truncate_suffix(last_index_kept);
     lck.unlock();
     DB_WARNING("Truncating region_id: %ld to last index kept:%ld from last log index:%ld",
             _region_id, last_index_kept, _last_log_index.load()); 
@@ -426,6 +454,122 @@ int  MyRaftLogStorage::reset(const int64_t next_log_index) {
     return 0;
 }
 
+void MyRaftLogStorage::_cache_append(const std::vector<braft::LogEntry*>& entries) {
+    if (FLAGS_raft_log_cache_entries <= 0) {
+        return;
+    }
+    {
+        BAIDU_SCOPED_LOCK(_cache_mutex);
+        // 和缓存不连续时(如reset后)清空重建
+        if (!_entry_cache.empty() &&
+                _cache_first_index + (int64_t)_entry_cache.size() != entries.front()->id.index) {
+            while (!_entry_cache.empty()) {
+                _cache_pop_front();
+            }
+        }
+        if (_entry_cache.empty()) {
+            _cache_first_index = entries.front()->id.index;
+        }
+        for (auto entry : entries) {
+            entry->AddRef();
+            _entry_cache.push_back(entry);
+            g_raft_log_cache_bytes.fetch_add(entry->data.size());
+        }
+        // 超过region条数上限时淘汰本region最老的
+        while ((int64_t)_entry_cache.size() > FLAGS_raft_log_cache_entries) {
+            _cache_pop_front();
+        }
+    }
+    _lru_touch();
+    // 超过整个store的内存上限时淘汰最久没访问的region
+    _cache_evict_global();
+}
+
+braft::LogEntry* MyRaftLogStorage::_cache_get(int64_t index) {
+    braft::LogEntry* entry = NULL;
+    {
+        BAIDU_SCOPED_LOCK(_cache_mutex);
+        if (index < _cache_first_index ||
+                index >= _cache_first_index + (int64_t)_entry_cache.size()) {
+            g_raft_log_cache_miss << 1;
+            return NULL;
+        }
+        g_raft_log_cache_hit << 1;
+        // 和braft的内存log一样共享entry, data是引用计数的IOBuf, 不需要拷贝
+        entry = _entry_cache[index - _cache_first_index];
+        entry->AddRef();
+    }
+    _lru_touch();
+    return entry;
+}
+
+void MyRaftLogStorage::_cache_truncate_prefix(int64_t first_index_kept) {
+    BAIDU_SCOPED_LOCK(_cache_mutex);
+    while (!_entry_cache.empty() && _cache_first_index < first_index_kept) {
+        _cache_pop_front();
+    }
+}
+
+void MyRaftLogStorage::_cache_truncate_suffix(int64_t last_index_kept) {
+    BAIDU_SCOPED_LOCK(_cache_mutex);
+    while (!_entry_cache.empty() &&
+            _cache_first_index + (int64_t)_entry_cache.size() - 1 > last_index_kept) {
+        braft::LogEntry* entry = _entry_cache.back();
+        g_raft_log_cache_bytes.fetch_sub(entry->data.size());
+        entry->Release();
+        _entry_cache.pop_back();
+    }
+}
+
+void MyRaftLogStorage::_lru_touch() {
+    BAIDU_SCOPED_LOCK(g_raft_log_cache_lru.mutex);
+    auto& storages = g_raft_log_cache_lru.storages;
+    if (_in_lru) {
+        storages.splice(storages.end(), storages, _lru_iter);
+    } else {
+        _lru_iter = storages.insert(storages.end(), this);
+        _in_lru = true;
+    }
+}
+
+void MyRaftLogStorage::_lru_remove() {
+    BAIDU_SCOPED_LOCK(g_raft_log_cache_lru.mutex);
+    if (_in_lru) {
+        g_raft_log_cache_lru.storages.erase(_lru_iter);
+        _in_lru = false;
+    }
+}
+
+void MyRaftLogStorage::_cache_evict_global() {
+    auto& storages = g_raft_log_cache_lru.storages;
+    while (g_raft_log_cache_bytes.load() > FLAGS_raft_log_cache_total_bytes) {
+        // 持有全局锁期间region不会析构
+        BAIDU_SCOPED_LOCK(g_raft_log_cache_lru.mutex);
+        if (storages.empty()) {
+            return;
+        }
+        MyRaftLogStorage* victim = storages.front();
+        BAIDU_SCOPED_LOCK(victim->_cache_mutex);
+        while (!victim->_entry_cache.empty() &&
+                g_raft_log_cache_bytes.load() > FLAGS_raft_log_cache_total_bytes) {
+            victim->_cache_pop_front();
+        }
+        // 缓存清空的region移出LRU, 下次append时再加入
+        if (victim->_entry_cache.empty()) {
+            storages.erase(victim->_lru_iter);
+            victim->_in_lru = false;
+        }
+    }
+}
+
+void MyRaftLogStorage::_cache_pop_front() {
+    braft::LogEntry* entry = _entry_cache.front();
+    g_raft_log_cache_bytes.fetch_sub(entry->data.size());
+    entry->Release();
+    _entry_cache.pop_front();
+    ++_cache_first_index;
+}
+
 int MyRaftLogStorage::_build_key_value(
         rocksdb::SliceParts* key, rocksdb::SliceParts* value,
         const braft::LogEntry* entry, butil::Arena& arena) {
@@ -0,0 +1,202 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "column_codec.h"
+
+namespace baikaldb {
+void ColumnEncoder::init(const std::vector<pb::TupleDescriptor>& tuple_descs) {
+    _rows = 0;
+    _columns.clear();
+    for (auto& tuple_desc : tuple_descs) {
+        for (auto& slot : tuple_desc.slots()) {
+            _columns.emplace_back();
+            _columns.back().init(tuple_desc.tuple_id(), slot.slot_id(), slot.slot_type(), 0);
+        }
+    }
+}
+
+void ColumnEncoder::add_row(MemRow* row) {
+    for (auto& column : _columns) {
+        column.append_value(row->get_value(column.tuple_id(), column.slot_id()));
+    }
+    ++_rows;
+}
+
+void ColumnEncoder::serialize(butil::IOBuf* buf) const {
+    uint32_t rows = _rows;
+    uint32_t columns = _columns.size();
+    buf->append(&rows, sizeof(rows));
+    buf->append(&columns, sizeof(columns));
+    for (auto& column : _columns) {
+        int32_t header[3] = {column.tuple_id(), column.slot_id(), (int32_t)column.type()};
+        buf->append(header, sizeof(header));
+        buf->append(column.null_flags(), rows);
+        switch (column.storage()) {
+            case CS_INT:
+                buf->append(column.int_data(), rows * sizeof(int64_t));
+                break;
+            case CS_DOUBLE:
+                buf->append(column.double_data(), rows * sizeof(double));
+                break;
+            case CS_STRING:
+                buf->append(column.offsets(), (rows + 1) * sizeof(uint32_t));
+                buf->append(column.str_buf().data(), column.str_buf().size());
+                break;
+        }
+    }
+}
+
+int ColumnDecoder::init(const butil::IOBuf& buf) {
+    _columns.clear();
+    _rows = 0;
+    // 只增加block的引用计数, 不拷贝数据
+    _buf = buf;
+    size_t pos = 0;
+    uint32_t rows = 0;
+    uint32_t columns = 0;
+    if (!read_uint32(0, &rows) || !read_uint32(sizeof(uint32_t), &columns)) {
+        DB_WARNING("column result too short, size:%lu", _buf.size());
+        return -1;
+    }
+    pos = sizeof(uint32_t) * 2;
+    _rows = rows;
+    for (uint32_t i = 0; i < columns; i++) {
+        uint32_t header[3];
+        if (_buf.copy_to(header, sizeof(header), pos) != sizeof(header)) {
+            DB_WARNING("column result truncated, column:%u", i);
+            return -1;
+        }
+        pos += sizeof(header);
+        ColumnPos column;
+        column.tuple_id = header[0];
+        column.slot_id = header[1];
+        column.type = (pb::PrimitiveType)header[2];
+        column.null_pos = pos;
+        column.data_pos = pos + _rows;
+        column.str_pos = 0;
+        size_t end = 0;
+        if (column_storage(column.type) == CS_STRING) {
+            column.str_pos = column.data_pos + (_rows + 1) * sizeof(uint32_t);
+            uint32_t str_size = 0;
+            if (!read_uint32(column.str_pos - sizeof(uint32_t), &str_size)) {
+                DB_WARNING("column result truncated, column:%u", i);
+                return -1;
+            }
+            end = column.str_pos + str_size;
+        } else {
+            end = column.data_pos + _rows * sizeof(int64_t);
+        }
+        if (end > _buf.size()) {
+            DB_WARNING("column result truncated, column:%u", i);
+            return -1;
+        }
+        pos = end;
+        _columns.push_back(column);
+    }
+    return 0;
+}
+
+int32_t ColumnDecoder::single_tuple_id() const {
+    if (_columns.empty()) {
+        return -1;
+    }
+    for (auto& column : _columns) {
+        if (column.tuple_id != _columns[0].tuple_id) {
+            return -1;
+        }
+    }
+    return _columns[0].tuple_id;
+}
+
+void ColumnDecoder::append_column(const ColumnPos& pos, size_t start, size_t n,
+        ColumnVector* column) {
+    _buf.copy_to(column->extend_null_flags(n), n, pos.null_pos + start);
+    if (column_storage(pos.type) == CS_STRING) {
+        _offsets.resize(n + 1);
+        _buf.copy_to(_offsets.data(), (n + 1) * sizeof(uint32_t),
+                pos.data_pos + start * sizeof(uint32_t));
+        _buf.copy_to(column->extend_strings(_offsets.data(), n), _offsets[n] - _offsets[0],
+                pos.str_pos + _offsets[0]);
+    } else {
+        _buf.copy_to(column->extend_fixed(n), n * sizeof(int64_t),
+                pos.data_pos + start * sizeof(int64_t));
+    }
+}
+
+int ColumnDecoder::decode_rows(MemRowDescriptor* desc, size_t start, size_t n,
+        RowBatch* batch) {
+    if (start + n > _rows) {
+        n = _rows > start ? _rows - start : 0;
+    }
+    std::vector<std::unique_ptr<MemRow>> rows;
+    rows.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        rows.push_back(desc->fetch_mem_row());
+    }
+    for (auto& pos : _columns) {
+        ColumnVector column;
+        column.init(pos.tuple_id, pos.slot_id, pos.type, n);
+        append_column(pos, start, n, &column);
+        for (size_t i = 0; i < n; i++) {
+            if (column.is_null(i)) {
+                continue;
+            }
+            int ret = rows[i]->set_value(pos.tuple_id, pos.slot_id, column.get_value(i));
+            if (ret < 0) {
+                DB_WARNING("set value fail, tuple_id:%d, slot_id:%d", pos.tuple_id, pos.slot_id);
+                return ret;
+            }
+        }
+    }
+    for (auto& row : rows) {
+        batch->move_row(std::move(row));
+    }
+    return 0;
+}
+
+int ColumnDecoder::decode_columns(size_t start, size_t n, RowBatch* batch) {
+    if (start + n > _rows) {
+        n = _rows > start ? _rows - start : 0;
+    }
+    ColumnBatch* columns = batch->mutable_columns();
+    for (size_t i = 0; i < columns->columns_size(); i++) {
+        ColumnVector& column = columns->column(i);
+        const ColumnPos* pos = nullptr;
+        for (auto& column_pos : _columns) {
+            if (column_pos.tuple_id == column.tuple_id() && column_pos.slot_id == column.slot_id()) {
+                pos = &column_pos;
+                break;
+            }
+        }
+        if (pos == nullptr) {
+            for (size_t j = 0; j < n; j++) {
+                column.append_null();
+            }
+            continue;
+        }
+        if (column_storage(pos->type) != column.storage()) {
+            DB_WARNING("column type not match, tuple_id:%d, slot_id:%d",
+                    pos->tuple_id, pos->slot_id);
+            return -1;
+        }
+        append_column(*pos, start, n, &column);
+    }
+    for (size_t i = 0; i < n; i++) {
+        batch->add_column_row();
+    }
+    return 0;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
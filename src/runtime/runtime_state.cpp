@@ -17,6 +17,9 @@
 #include "network_socket.h"
 
 namespace baikaldb {
+DEFINE_int64(query_memory_limit, 0,
+        "memory limit(bytes) shared by all operators of one query on baikaldb, sort and join "
+        "spill to disk and agg fails when exceeded, 0(default) means unlimited");
 
 RuntimeState::~RuntimeState() {}
 
@@ -84,9 +87,21 @@ int RuntimeState::init(QueryContext* ctx, DataBuffer* send_buf) {
     }
     txn_id = _client_conn->txn_id;
     _log_id = ctx->stat_info.log_id;
+    _mem_tracker = std::make_shared<MemTracker>(FLAGS_query_memory_limit);
     return 0;
 }
 
+void RuntimeState::init_sub_state(RuntimeState* state) {
+    _tuple_descs = state->tuple_descs();
+    _shared_mem_row_desc = state->mem_row_desc();
+    _client_conn = state->client_conn();
+    txn_id = state->txn_id;
+    seq_id = state->seq_id;
+    _log_id = state->log_id();
+    _mem_tracker = state->mem_tracker();
+    _autocommit = state->autocommit();
+}
+
 int RuntimeState::init(const pb::CachePlan& commit_plan) {
     txn_id = _client_conn->txn_id;
     seq_id = _client_conn->seq_id;
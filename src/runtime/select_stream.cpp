@@ -0,0 +1,206 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "select_stream.h"
+
+namespace baikaldb {
+DEFINE_int32(select_stream_max_buf_size, 2 * 1024 * 1024,
+        "max unconsumed bytes of a select stream on store side");
+DEFINE_int32(select_stream_max_chunks, 2, "max received chunks buffered per select stream");
+DEFINE_int32(select_stream_idle_timeout_ms, 60 * 1000,
+        "max wait(ms) for the other side of a select stream to read or write a chunk");
+
+int SelectStreamWriter::accept(brpc::Controller* cntl) {
+    brpc::StreamOptions options;
+    options.max_buf_size = FLAGS_select_stream_max_buf_size;
+    if (brpc::StreamAccept(&_stream_id, *cntl, &options) != 0) {
+        DB_WARNING("accept select stream fail");
+        _stream_id = brpc::INVALID_STREAM_ID;
+        return -1;
+    }
+    return 0;
+}
+
+int SelectStreamWriter::write(const pb::StoreRes& res, const butil::IOBuf& attachment) {
+    std::string res_str;
+    if (!res.SerializeToString(&res_str)) {
+        DB_WARNING("serialize chunk fail");
+        return -1;
+    }
+    uint32_t res_len = res_str.size();
+    butil::IOBuf chunk;
+    chunk.append(&res_len, sizeof(res_len));
+    chunk.append(res_str);
+    chunk.append(attachment);
+    while (true) {
+        int ret = brpc::StreamWrite(_stream_id, chunk);
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret != EAGAIN) {
+            DB_WARNING("write select stream fail, stream_id:%lu, ret:%d", _stream_id, ret);
+            return -1;
+        }
+        // 对端还没读完, 等缓冲空出来, frontend长时间不读时关闭stream
+        timespec due_time = butil::milliseconds_from_now(FLAGS_select_stream_idle_timeout_ms);
+        ret = brpc::StreamWait(_stream_id, &due_time);
+        if (ret != 0) {
+            DB_WARNING("select stream closed or wait timeout, stream_id:%lu, ret:%d",
+                    _stream_id, ret);
+            close();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void SelectStreamWriter::close() {
+    if (_stream_id != brpc::INVALID_STREAM_ID) {
+        brpc::StreamClose(_stream_id);
+        _stream_id = brpc::INVALID_STREAM_ID;
+    }
+}
+
+SelectStreamReader::Handler::Handler() {
+    bthread_mutex_init(&mutex, nullptr);
+    bthread_cond_init(&cond, nullptr);
+}
+
+SelectStreamReader::Handler::~Handler() {
+    bthread_cond_destroy(&cond);
+    bthread_mutex_destroy(&mutex);
+}
+
+int SelectStreamReader::Handler::on_received_messages(brpc::StreamId id,
+        butil::IOBuf* const messages[], size_t size) {
+    bthread_mutex_lock(&mutex);
+    if (stopped || timeout) {
+        bthread_mutex_unlock(&mutex);
+        return 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+        chunks.push_back(butil::IOBuf());
+        chunks.back().swap(*messages[i]);
+    }
+    bthread_cond_broadcast(&cond);
+    // 缓存的chunk够多时不返回, store端的写会因为缓冲满而等待
+    timespec due_time = butil::milliseconds_from_now(FLAGS_select_stream_idle_timeout_ms);
+    while (!stopped && (int)chunks.size() >= FLAGS_select_stream_max_chunks) {
+        if (bthread_cond_timedwait(&cond, &mutex, &due_time) == ETIMEDOUT) {
+            DB_WARNING("select stream not read for long, stream_id:%lu", id);
+            timeout = true;
+            chunks.clear();
+            bthread_cond_broadcast(&cond);
+            break;
+        }
+    }
+    bthread_mutex_unlock(&mutex);
+    return 0;
+}
+
+void SelectStreamReader::Handler::on_closed(brpc::StreamId id) {
+    std::shared_ptr<Handler> last_ref;
+    bthread_mutex_lock(&mutex);
+    closed = true;
+    bthread_cond_broadcast(&cond);
+    last_ref.swap(self);
+    bthread_mutex_unlock(&mutex);
+}
+
+int SelectStreamReader::create(brpc::Controller* cntl) {
+    _handler = std::make_shared<Handler>();
+    brpc::StreamOptions options;
+    options.handler = _handler.get();
+    // 每次回调一个chunk, 回调返回前对端不会收到消费确认
+    options.messages_in_batch = 1;
+    if (brpc::StreamCreate(&_stream_id, *cntl, &options) != 0) {
+        DB_WARNING("create select stream fail");
+        _stream_id = brpc::INVALID_STREAM_ID;
+        _handler.reset();
+        return -1;
+    }
+    // 回调可能在reader析构后才结束, on_closed前handler不能释放
+    _handler->self = _handler;
+    return 0;
+}
+
+int SelectStreamReader::next_chunk(pb::StoreRes* res, butil::IOBuf* attachment, bool* eos) {
+    *eos = false;
+    if (_eos) {
+        *eos = true;
+        return 0;
+    }
+    if (_handler == nullptr) {
+        return -1;
+    }
+    butil::IOBuf chunk;
+    bthread_mutex_lock(&_handler->mutex);
+    timespec due_time = butil::milliseconds_from_now(FLAGS_select_stream_idle_timeout_ms);
+    while (_handler->chunks.empty() && !_handler->closed && !_handler->timeout) {
+        if (bthread_cond_timedwait(&_handler->cond, &_handler->mutex, &due_time) == ETIMEDOUT) {
+            _handler->timeout = true;
+        }
+    }
+    if (_handler->chunks.empty() || _handler->timeout) {
+        bool timeout = _handler->timeout;
+        bthread_mutex_unlock(&_handler->mutex);
+        DB_WARNING("select stream %s before eos, stream_id:%lu",
+                timeout ? "timeout" : "closed", _stream_id);
+        close();
+        return -1;
+    }
+    chunk.swap(_handler->chunks.front());
+    _handler->chunks.pop_front();
+    bthread_cond_broadcast(&_handler->cond);
+    bthread_mutex_unlock(&_handler->mutex);
+    _received = true;
+
+    uint32_t res_len = 0;
+    if (chunk.cutn(&res_len, sizeof(res_len)) != sizeof(res_len) || chunk.size() < res_len) {
+        DB_WARNING("select stream chunk broken, stream_id:%lu", _stream_id);
+        return -1;
+    }
+    std::string res_str;
+    chunk.cutn(&res_str, res_len);
+    if (!res->ParseFromString(res_str)) {
+        DB_WARNING("parse select stream chunk fail, stream_id:%lu", _stream_id);
+        return -1;
+    }
+    attachment->clear();
+    attachment->swap(chunk);
+    if (res->errcode() != pb::SUCCESS) {
+        DB_WARNING("select stream chunk errcode:%d, msg:%s", res->errcode(),
+                res->errmsg().c_str());
+        return -1;
+    }
+    _eos = res->stream_eos();
+    *eos = _eos;
+    return 0;
+}
+
+void SelectStreamReader::close() {
+    if (_stream_id == brpc::INVALID_STREAM_ID) {
+        return;
+    }
+    bthread_mutex_lock(&_handler->mutex);
+    _handler->stopped = true;
+    _handler->chunks.clear();
+    bthread_cond_broadcast(&_handler->cond);
+    bthread_mutex_unlock(&_handler->mutex);
+    brpc::StreamClose(_stream_id);
+    _stream_id = brpc::INVALID_STREAM_ID;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -15,6 +15,11 @@
 #include "sorter.h"
 
 namespace baikaldb {
+DEFINE_string(sort_spill_dir, "", "directory of sort spill files, "
+        "empty means baikaldb_spill under $TMPDIR(/tmp if unset)");
+DEFINE_int64(sort_spill_min_run_bytes, 16 * 1024 * 1024LL,
+        "min bytes buffered by one sorter before it spills a run");
+
 int Sorter::get_next(RowBatch* batch, bool* eos) {
     if (_min_heap.size() == 0) {
         *eos = true;
@@ -38,8 +43,22 @@ int Sorter::get_next(RowBatch* batch, bool* eos) {
         }
         batch->move_row(std::move(_min_heap[0]->get_row()));
         _min_heap[0]->next();
-        //堆顶batch遍历完后，pop出去
+        //堆顶batch遍历完后，如果来自run或stream则继续读，否则pop出去
         if (_min_heap[0]->is_traverse_over()) {
+            auto iter = _refill_batches.find(_min_heap[0].get());
+            if (iter != _refill_batches.end()) {
+                _min_heap[0]->clear();
+                int ret = iter->second(_min_heap[0].get());
+                if (ret < 0) {
+                    return ret;
+                }
+                _min_heap[0]->reset();
+                if (_min_heap[0]->size() > 0) {
+                    shiftdown(0);
+                    continue;
+                }
+                _refill_batches.erase(iter);
+            }
             iter_swap(_min_heap.begin(), _min_heap.end() - 1);
             _min_heap.pop_back();
             if (!_min_heap.empty()) {
@@ -51,16 +70,125 @@ int Sorter::get_next(RowBatch* batch, bool* eos) {
     }
     return 0;
 }
-void Sorter::sort() {
+void Sorter::add_topn(RowBatch* batch) {
+    auto less = _comp->get_less_func();
+    for (batch->reset(); !batch->is_traverse_over(); batch->next()) {
+        std::unique_ptr<MemRow>& row = batch->get_row();
+        if (_topn_rows.size() < (size_t)_limit) {
+            _topn_rows.push_back(std::move(row));
+            std::push_heap(_topn_rows.begin(), _topn_rows.end(), less);
+        } else if (_comp->less(row.get(), _topn_rows[0].get())) {
+            //替换掉堆顶最大的一行
+            std::pop_heap(_topn_rows.begin(), _topn_rows.end(), less);
+            _topn_rows.back() = std::move(row);
+            std::push_heap(_topn_rows.begin(), _topn_rows.end(), less);
+        }
+    }
+}
+
+void Sorter::sort_topn() {
+    std::sort_heap(_topn_rows.begin(), _topn_rows.end(), _comp->get_less_func());
+    // 按batch容量切成多个有序batch, limit很大时也不会有超大的batch
+    std::shared_ptr<RowBatch> batch;
+    for (auto& row : _topn_rows) {
+        if (batch == nullptr || batch->is_full()) {
+            batch = std::make_shared<RowBatch>();
+            _min_heap.push_back(batch);
+        }
+        batch->move_row(std::move(row));
+    }
+    _topn_rows.clear();
+    if (_min_heap.size() > 1) {
+        make_heap();
+    }
+}
+
+int Sorter::sort() {
     if (_comp->need_not_compare()) {
-        return;
+        return 0;
+    }
+    if (is_topn()) {
+        sort_topn();
+        return 0;
     }
     if (_min_heap.size() == 1) {
         _min_heap[0]->sort(_comp);
     } else if (_min_heap.size() > 1) {
         multi_sort();
+    }
+    // 每个run读出第一个batch，和内存中的batch一起归并
+    for (auto& run : _runs) {
+        std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+        int ret = read_run(batch.get(), run.get());
+        if (ret < 0) {
+            return ret;
+        }
+        if (batch->size() > 0) {
+            _min_heap.push_back(batch);
+            SpillFile* run_ptr = run.get();
+            _refill_batches[batch.get()] = [this, run_ptr](RowBatch* batch) {
+                return read_run(batch, run_ptr);
+            };
+        }
+    }
+    if (_min_heap.size() > 1) {
         make_heap();
     }
+    return 0;
+}
+
+int Sorter::spill() {
+    TimeCost cost;
+    std::shared_ptr<SpillFile> run = std::make_shared<SpillFile>();
+    int ret = run->open_write(FLAGS_sort_spill_dir);
+    if (ret < 0) {
+        return ret;
+    }
+    if (_min_heap.size() == 1) {
+        _min_heap[0]->sort(_comp);
+    } else if (_min_heap.size() > 1) {
+        multi_sort();
+        make_heap();
+    }
+    // 复用堆归并把内存中的数据有序写出
+    int tuple_size = _mem_row_desc->tuple_size();
+    bool eos = false;
+    while (!eos) {
+        RowBatch batch;
+        ret = get_next(&batch, &eos);
+        if (ret < 0) {
+            return ret;
+        }
+        for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+            ret = run->write_row(batch.get_row().get(), tuple_size);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+    ret = run->finish_write();
+    if (ret < 0) {
+        return ret;
+    }
+    _min_heap.clear();
+    _runs.push_back(run);
+    DB_WARNING("sort spill rows:%ld, file_size:%ld, mem_used:%ld, query_mem_used:%ld, "
+            "run_num:%lu, time:%ld", run->rows(), run->file_size(), _mem_used,
+            _mem_tracker->used(), _runs.size(), cost.get_time());
+    _mem_tracker->release(_mem_used);
+    _mem_used = 0;
+    return 0;
+}
+
+int Sorter::read_run(RowBatch* batch, SpillFile* run) {
+    batch->clear();
+    bool eof = false;
+    int ret = run->read_batch(_mem_row_desc, batch, batch->capacity(), &eof);
+    if (ret < 0) {
+        DB_WARNING("read sort run fail, path:%s", run->path().c_str());
+        return ret;
+    }
+    return 0;
 }
 void Sorter::merge_sort() {
     if (_comp->need_not_compare()) {
@@ -0,0 +1,139 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "spill_file.h"
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <atomic>
+
+namespace baikaldb {
+DEFINE_int32(spill_file_buffer_size, 1024 * 1024, "io buffer size of spill file");
+
+static std::atomic<uint64_t> spill_file_seq(0);
+
+SpillFile::~SpillFile() {
+    if (_file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+    }
+    if (!_path.empty()) {
+        unlink(_path.c_str());
+    }
+}
+
+int SpillFile::open_write(const std::string& dir) {
+    std::string spill_dir = dir;
+    if (spill_dir.empty()) {
+        const char* tmp_dir = getenv("TMPDIR");
+        spill_dir = std::string(tmp_dir != nullptr && tmp_dir[0] != '\0' ? tmp_dir : "/tmp")
+            + "/baikaldb_spill";
+    }
+    if (mkdir(spill_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        DB_WARNING("create spill dir fail, dir:%s, errno:%d", spill_dir.c_str(), errno);
+        return -1;
+    }
+    _path = spill_dir + "/spill_" + std::to_string(butil::gettimeofday_us()) + "_" +
+        std::to_string(spill_file_seq.fetch_add(1));
+    _file = fopen(_path.c_str(), "w+");
+    if (_file == nullptr) {
+        DB_WARNING("open spill file fail, path:%s, errno:%d", _path.c_str(), errno);
+        _path.clear();
+        return -1;
+    }
+    setvbuf(_file, nullptr, _IOFBF, FLAGS_spill_file_buffer_size);
+    return 0;
+}
+
+int SpillFile::write_uint32(uint32_t value) {
+    if (fwrite(&value, sizeof(value), 1, _file) != 1) {
+        DB_WARNING("write spill file fail, path:%s, errno:%d", _path.c_str(), errno);
+        return -1;
+    }
+    _file_size += sizeof(value);
+    return 0;
+}
+
+int SpillFile::write_row(MemRow* row, int tuple_size) {
+    if (write_uint32(tuple_size) < 0) {
+        return -1;
+    }
+    for (int32_t tuple_id = 0; tuple_id < tuple_size; tuple_id++) {
+        _buf.clear();
+        row->to_string(tuple_id, &_buf);
+        if (write_uint32(_buf.size()) < 0) {
+            return -1;
+        }
+        if (_buf.size() > 0 && fwrite(_buf.data(), _buf.size(), 1, _file) != 1) {
+            DB_WARNING("write spill file fail, path:%s, errno:%d", _path.c_str(), errno);
+            return -1;
+        }
+        _file_size += _buf.size();
+    }
+    ++_rows;
+    return 0;
+}
+
+int SpillFile::finish_write() {
+    if (fflush(_file) != 0) {
+        DB_WARNING("flush spill file fail, path:%s, errno:%d", _path.c_str(), errno);
+        return -1;
+    }
+    rewind(_file);
+    return 0;
+}
+
+int SpillFile::read_uint32(uint32_t* value, bool* eof) {
+    size_t n = fread(value, sizeof(*value), 1, _file);
+    if (n != 1) {
+        if (feof(_file) && eof != nullptr) {
+            *eof = true;
+            return 0;
+        }
+        DB_WARNING("read spill file fail, path:%s, errno:%d", _path.c_str(), errno);
+        return -1;
+    }
+    return 0;
+}
+
+int SpillFile::read_batch(MemRowDescriptor* desc, RowBatch* batch, size_t max_rows, bool* eof) {
+    *eof = false;
+    for (size_t i = 0; i < max_rows; i++) {
+        uint32_t tuple_size = 0;
+        if (read_uint32(&tuple_size, eof) < 0) {
+            return -1;
+        }
+        if (*eof) {
+            return 0;
+        }
+        std::unique_ptr<MemRow> row = desc->fetch_mem_row();
+        for (uint32_t tuple_id = 0; tuple_id < tuple_size; tuple_id++) {
+            uint32_t len = 0;
+            // tuple中间截断说明文件损坏
+            if (read_uint32(&len, nullptr) < 0) {
+                return -1;
+            }
+            _buf.resize(len);
+            if (len > 0 && fread(&_buf[0], len, 1, _file) != 1) {
+                DB_WARNING("read spill file fail, path:%s, errno:%d", _path.c_str(), errno);
+                return -1;
+            }
+            row->from_string(tuple_id, _buf);
+        }
+        batch->move_row(std::move(row));
+    }
+    return 0;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -112,6 +112,8 @@ bool NetworkSocket::reset() {
     need_rollback_seq.clear();
     region_infos.clear();
     cache_plans.clear();
+    last_stmt_id = 0;
+    prepared_stmts.clear();
     return true;
 }
 
@@ -22,6 +22,7 @@
 #include "runtime_state.h"
 #include "mem_row_descriptor.h"
 #include "exec_node.h"
+#include "column_codec.h"
 #include "table_record.h"
 #include "my_raft_log_storage.h"
 #include "raft_log_compaction_filter.h"
@@ -57,6 +58,8 @@ DEFINE_int64(snapshot_diff_logs, 2000, "save_snapshot when log entries diff");
 DEFINE_int64(snapshot_log_exec_time_s, 60, "save_snapshot when log entries apply time");
 //分裂判断标准，如果3600S没有收到请求，则认为分裂失败
 DEFINE_int64(split_duration_us, 3600 * 1000 * 1000LL, "split duration time : 3600s");
+DEFINE_bool(snapshot_reuse_data_sst, true, "hard link last snapshot data sst if region data unchanged");
+DECLARE_int64(scan_readahead_size);
 class ScopeProcStatus {
 public:
     ScopeProcStatus(Region* region) : _region(region) {}
@@ -158,6 +161,7 @@ struct AddPeerClosure : public braft::Closure {
         }
         DB_WARNING("region status was reset, region_id: %ld", region->get_region_id());
         region->reset_region_status();
+        TransferScheduler::get_instance()->release();
         if (done) {
             done->Run();
         }
@@ -342,6 +346,8 @@ int Region::init(bool write_db, int32_t snapshot_times) {
 #endif
     options.snapshot_uri = FLAGS_snapshot_uri + "/region_" + 
                                 boost::lexical_cast<std::string>(_region_id);
+    //snapshot拷贝全store共享限速
+    options.snapshot_throttle = TransferScheduler::get_instance()->snapshot_throttle();
 
     _txn_pool.init(_region_id);
     if (_node.init(options) != 0) {
@@ -662,7 +668,7 @@ void Region::exec_in_txn_query(google::protobuf::RpcController* controller,
     switch (op_type) {
         case pb::OP_SELECT: {
             TimeCost cost;
-            select(*request, *response);
+            select(*request, *response, &cntl->response_attachment());
             DB_NOTICE("select type: %s, region_id: %ld, txn_id: %lu, seq_id: %d, "
                     "time_cost: %ld, log_id: %lu, remote_side: %s", 
                     pb::OpType_Name(request->op_type()).c_str(), _region_id, txn_id, seq_id, 
@@ -788,7 +794,16 @@ void Region::exec_out_txn_query(google::protobuf::RpcController* controller,
     switch (op_type) {
         case pb::OP_SELECT: {
             TimeCost cost;
-            select(*request, *response);
+            if (request->stream_chunk_rows() > 0 && cntl->has_remote_stream()) {
+                // 回包后request和cntl被释放, 先打日志
+                DB_NOTICE("select stream, region_id: %ld, log_id: %lu, remote_side: %s",
+                        _region_id, log_id, remote_side);
+                select_stream(*request, *response, cntl, done_guard.release());
+                DB_NOTICE("select stream finish, region_id: %ld, time_cost:%ld, log_id: %lu",
+                        _region_id, cost.get_time(), log_id);
+                return;
+            }
+            select(*request, *response, &cntl->response_attachment());
             DB_NOTICE("select type:%s, seq_id: %d, region_id: %ld, time_cost:%ld, log_id: %lu, remote_side: %s", 
                     pb::OpType_Name(request->op_type()).c_str(), 0, _region_id, cost.get_time(), log_id, remote_side);
             break;
@@ -1008,6 +1023,8 @@ void Region::dml_2pc(const pb::StoreReq& request,
         need_rollback_seq.insert(rollback_seq);
     }
     int64_t txn_num_increase_rows = 0;
+    // 提交前事务里有写入, 提交后数据sst会变化
+    bool txn_has_write = false;
 
     uint64_t txn_id = txn_info.txn_id();
     auto txn = _txn_pool.get_txn(txn_id);
@@ -1047,6 +1064,7 @@ void Region::dml_2pc(const pb::StoreReq& request,
         // 提前保存txn->num_increase_rows，以便事务提交/回滚时更新num_table_lines
         if (op_type == pb::OP_COMMIT) {
             txn_num_increase_rows = txn->num_increase_rows;
+            txn_has_write = txn->get_txn()->GetNumPuts() > 0 || txn->get_txn()->GetNumDeletes() > 0;
         }
     }
 
@@ -1130,11 +1148,15 @@ void Region::dml_2pc(const pb::StoreReq& request,
 
     if (op_type == pb::OP_TRUNCATE_TABLE) {
         _num_table_lines = 0;
+        ++_data_version;
     } else if (op_type != pb::OP_COMMIT && op_type != pb::OP_ROLLBACK) {
         txn->num_increase_rows += state.num_increase_rows();
     } else if (op_type == pb::OP_COMMIT) {
         // 事务提交/回滚时更新num_table_line
         _num_table_lines += txn_num_increase_rows;
+        if (txn_has_write) {
+            ++_data_version;
+        }
     }
     DB_NOTICE("dml type:%d, time_cost:%ld, region_id: %ld, txn_id: %lu, num_table_lines:%ld, "
               "affected_rows:%d, applied_index:%ld, term:%d, txn_num_rows:%ld, log_id:%lu", 
@@ -1229,6 +1251,8 @@ void Region::dml_1pc(const pb::StoreReq& request, pb::OpType op_type,
         _num_table_lines = 0;
     }
     int64_t txn_num_increase_rows = txn->num_increase_rows;
+    bool txn_has_write = op_type == pb::OP_TRUNCATE_TABLE
+            || txn->get_txn()->GetNumPuts() > 0 || txn->get_txn()->GetNumDeletes() > 0;
 
     auto res = txn->commit();
     if (res.ok()) {
@@ -1244,6 +1268,9 @@ void Region::dml_1pc(const pb::StoreReq& request, pb::OpType op_type,
     }
     if (commit_succ) {
         _num_table_lines += txn_num_increase_rows;
+        if (txn_has_write) {
+            ++_data_version;
+        }
         response.set_affected_rows(ret);
         response.set_errcode(pb::SUCCESS);
         DB_NOTICE("dml type:%d, time_cost:%ld, region_id: %ld, txn_id: %lu, "
@@ -1260,14 +1287,32 @@ void Region::dml_1pc(const pb::StoreReq& request, pb::OpType op_type,
     return;
 }
 
-void Region::select(const pb::StoreReq& request, pb::StoreRes& response) {
-    select(request, request.plan(), request.tuples(), response);
+void Region::select(const pb::StoreReq& request, pb::StoreRes& response,
+        butil::IOBuf* attachment) {
+    select(request, request.plan(), request.tuples(), response, attachment);
+}
+
+void Region::select_stream(const pb::StoreReq& req, pb::StoreRes& response,
+        brpc::Controller* cntl, google::protobuf::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+    // 回包后rpc的request会被释放
+    pb::StoreReq request(req);
+    SelectStreamWriter stream;
+    if (stream.accept(cntl) != 0) {
+        response.set_errcode(pb::EXEC_FAIL);
+        response.set_errmsg("accept stream fail");
+        return;
+    }
+    select(request, request.plan(), request.tuples(), response, nullptr, &stream, &done_guard);
 }
 
 void Region::select(const pb::StoreReq& request, 
         const pb::Plan& plan,
         const RepeatedPtrField<pb::TupleDescriptor>& tuples,
-        pb::StoreRes& response) {
+        pb::StoreRes& response,
+        butil::IOBuf* attachment,
+        SelectStreamWriter* stream,
+        brpc::ClosureGuard* done_guard) {
     //DB_WARNING("req:%s", request.DebugString().c_str());
     int ret = 0;
     RuntimeState state;
@@ -1355,6 +1400,36 @@ void Region::select(const pb::StoreReq& request,
     for (auto& tuple : state.tuple_descs()) {
         response.add_tuple_ids(tuple.tuple_id());
     }
+    bool column_result = (attachment != nullptr || stream != nullptr) && request.column_result();
+    ColumnEncoder encoder;
+    if (column_result) {
+        encoder.init(state.tuple_descs());
+    }
+    // 流式返回时open成功就回包, 结果每chunk_rows行写一个chunk
+    pb::StoreRes* res = &response;
+    pb::StoreRes chunk;
+    int chunk_rows = 0;
+    if (stream != nullptr) {
+        chunk.set_errcode(pb::SUCCESS);
+        chunk.mutable_tuple_ids()->CopyFrom(response.tuple_ids());
+        chunk.set_column_result(column_result);
+        response.set_errcode(pb::SUCCESS);
+        response.set_stream_result(true);
+        done_guard->reset(nullptr);
+        res = &chunk;
+    }
+    auto write_chunk = [&](bool chunk_eos) -> int {
+        butil::IOBuf chunk_attachment;
+        if (column_result) {
+            encoder.serialize(&chunk_attachment);
+            encoder.init(state.tuple_descs());
+        }
+        chunk.set_stream_eos(chunk_eos);
+        int ret = stream->write(chunk, chunk_attachment);
+        chunk.clear_row_values();
+        chunk_rows = 0;
+        return ret;
+    };
     while (!eos) {
         RowBatch batch;
         batch.set_capacity(state.row_batch_capacity());
@@ -1362,9 +1437,14 @@ void Region::select(const pb::StoreReq& request,
         if (ret < 0) {
             root->close(&state);
             ExecNode::destory_tree(root);
-            response.set_errcode(pb::EXEC_FAIL);
-            response.set_errmsg("plan get_next fail");
+            res->set_errcode(pb::EXEC_FAIL);
+            res->set_errmsg("plan get_next fail");
             DB_FATAL("plan get_next fail, region_id: %ld", _region_id);
+            if (stream != nullptr) {
+                chunk.clear_row_values();
+                encoder.init(state.tuple_descs());
+                write_chunk(true);
+            }
             return;
         }
         count++;
@@ -1375,16 +1455,36 @@ void Region::select(const pb::StoreReq& request,
                 DB_FATAL("row is null; region_id: %ld, rows:%d", _region_id, rows);
                 continue;
             }
-            pb::RowValue* row_value = response.add_row_values();
-            for (int i = 0; i < mem_row_desc->tuple_size(); i++) {
-                std::string* tuple_value = row_value->add_tuple_values();
-                row->to_string(i, tuple_value);
+            if (column_result) {
+                encoder.add_row(row);
+            } else {
+                pb::RowValue* row_value = res->add_row_values();
+                for (int i = 0; i < mem_row_desc->tuple_size(); i++) {
+                    std::string* tuple_value = row_value->add_tuple_values();
+                    row->to_string(i, tuple_value);
+                }
+            }
+            if (stream != nullptr && ++chunk_rows >= request.stream_chunk_rows()) {
+                if (write_chunk(false) != 0) {
+                    // frontend已经不需要后续结果(如limit), 或者连接断开
+                    root->close(&state);
+                    ExecNode::destory_tree(root);
+                    return;
+                }
             }
         }
     }
     root->close(&state);
     ExecNode::destory_tree(root);
-    response.set_errcode(pb::SUCCESS);
+    if (stream != nullptr) {
+        write_chunk(true);
+    } else {
+        if (column_result) {
+            encoder.serialize(attachment);
+            response.set_column_result(true);
+        }
+        response.set_errcode(pb::SUCCESS);
+    }
     if (is_new_txn) {
         txn->commit(); // no write & lock, no failure
         auto_rollback.release();
@@ -1412,11 +1512,19 @@ void Region::add_peer(const pb::AddPeer& add_peer, ExecutionQueue& queue) {
         if (_shutdown) {
             return;
         }
+        //名额满时不在队列里等待, 心跳会再次下发补副本
+        if (!TransferScheduler::get_instance()->try_acquire(TransferScheduler::PRIORITY_REPAIR)) {
+            DB_WARNING("too many add peer tasks, retry later, region_id: %ld", _region_id);
+            reset_region_status();
+            return;
+        }
         if (_leader_send_init_region(new_instance, NULL) != 0) {
+            TransferScheduler::get_instance()->release();
             reset_region_status(); 
             return;
         }
         if (_whether_legal_for_add_peer(add_peer, NULL) != 0) {
+            TransferScheduler::get_instance()->release();
             reset_region_status(); 
             return;
         }
@@ -1458,11 +1566,21 @@ void Region::add_peer(const pb::AddPeer* request,
         reset_region_status(); 
         return;
     }
+    //名额满时直接返回, 不阻塞rpc线程, 由meta重试
+    if (!TransferScheduler::get_instance()->try_acquire(TransferScheduler::PRIORITY_BALANCE)) {
+        DB_WARNING("too many add peer tasks, retry later, region_id: %ld", _region_id);
+        response->set_errcode(pb::RETRY_LATER);
+        response->set_errmsg("too many add peer tasks, retry later");
+        reset_region_status();
+        return;
+    }
     if (_leader_send_init_region(new_instance, response) != 0) {
+        TransferScheduler::get_instance()->release();
         reset_region_status(); 
         return;
     }
     if (_whether_legal_for_add_peer(*request, response) != 0) {
+        TransferScheduler::get_instance()->release();
         reset_region_status(); 
         return;
     }
@@ -1472,6 +1590,7 @@ void Region::_leader_add_peer(const pb::AddPeer& add_peer,
                               const std::string& new_instance,
                               pb::StoreRes* response,
                               google::protobuf::Closure* done) {
+    //add_peer会触发全量snapshot拷贝, 调用方已占用TransferScheduler的名额, 在AddPeerClosure中释放
     braft::PeerId peer;
     AddPeerClosure* add_peer_done = new AddPeerClosure;
     add_peer_done->region = this;
@@ -2030,10 +2149,14 @@ void Region::on_configuration_committed(const::braft::Configuration& conf, int64
 }
 void Region::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* done) {
     DB_WARNING("start on shnapshot save, region_id: %ld", _region_id);
+    //在创建iterator之前取版本, 保证版本不会比iterator看到的数据新
+    int64_t data_version = _data_version.load();
     //创建snapshot
     rocksdb::ReadOptions read_options;
     //read_options.prefix_same_as_start = false;
     read_options.total_order_seek = true;
+    read_options.readahead_size = FLAGS_scan_readahead_size;
+    read_options.fill_cache = false;
     auto data_iter = _rocksdb->new_iterator(read_options, _data_cf);
     MutTableKey region_prefix;
     region_prefix.append_i64(_region_id); 
@@ -2068,9 +2191,12 @@ void Region::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* don
                  _num_table_lines.load(), _applied_index, pb2json(snapshot_region_info).c_str());
     
     Bthread bth(&BTHREAD_ATTR_SMALL);
+    int64_t snapshot_index = _snapshot_index;
     std::function<void()> save_snapshot_function = 
-        [this, done, data_iter, writer, region_prefix, extra, snapshot_region_info]() {
-            save_snapshot(done, data_iter, writer, region_prefix, extra, snapshot_region_info);
+        [this, done, data_iter, writer, region_prefix, extra, snapshot_region_info,
+            data_version, snapshot_index]() {
+            save_snapshot(done, data_iter, writer, region_prefix, extra, snapshot_region_info,
+                data_version, snapshot_index);
         };
     bth.run(save_snapshot_function);
 }
@@ -2233,6 +2359,7 @@ int Region::on_snapshot_load(braft::SnapshotReader* reader) {
                     data_sst_file.c_str(), res.ToString().c_str(), _region_id);
             return -1;
         }
+        ++_data_version;
     } else {
         DB_WARNING("snapshot load no entries, num_table_lines:%ld, region_id: %ld", 
             _num_table_lines.load(), _region_id);
@@ -2318,6 +2445,7 @@ int Region::clear_data() {
             res.code(), res.ToString().c_str(), _region_id);
         return -1;
     }
+    ++_data_version;
     DB_WARNING("remove_range cost:%ld, region_id: %ld", cost.get_time(), _region_id);
     // cost.reset();
     // rocksdb::Slice start(start_key.data());
@@ -2370,6 +2498,9 @@ void Region::reverse_merge() {
     for (auto& pair : _reverse_index_map) {
         pair.second->reverse_merge_func(_resource->region_info);
     }
+    if (!_reverse_index_map.empty()) {
+        ++_data_version;
+    }
     //DB_WARNING("region_id: %ld reverse merge:%lu", _region_id, cost.get_time());
     SELF_TRACE("region_id: %ld reverse merge:%lu", _region_id, cost.get_time());
 }
@@ -2655,6 +2786,12 @@ void Region::write_local_rocksdb_for_split() {
             read_options.prefix_same_as_start = true;
             read_options.total_order_seek = false;
             read_options.snapshot = _split_param.snapshot;
+            read_options.readahead_size = FLAGS_scan_readahead_size;
+            read_options.fill_cache = false;
+            MutTableKey upper_key;
+            upper_key.append_i64(_region_id).append_i64(index_id + 1);
+            rocksdb::Slice upper_slice(upper_key.data());
+            read_options.iterate_upper_bound = &upper_slice;
            
             IndexInfo index_info = _factory->get_index_info(index_id);
             std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
@@ -2732,6 +2869,8 @@ void Region::write_local_rocksdb_for_split() {
                   _region_id, _split_param.new_region_id, _split_param.instance.c_str());
         return;
     }
+    //数据是直接写入新region的, 不经过新region的raft
+    new_region->add_data_version();
     new_region->set_num_table_lines(_split_param.reduce_num_lines);
 
     // replay txn commands on new region by local write
@@ -3454,7 +3593,9 @@ void Region::save_snapshot(braft::Closure* done,
                             braft::SnapshotWriter* writer, 
                             MutTableKey region_prefix,
                             std::string extra,
-                            pb::RegionInfo snapshot_region_info) {
+                            pb::RegionInfo snapshot_region_info,
+                            int64_t data_version,
+                            int64_t snapshot_index) {
     TimeCost time_cost;
     brpc::ClosureGuard done_guard(done);
     std::unique_ptr<rocksdb::Iterator> iter_lock(iter);
@@ -3479,10 +3620,14 @@ void Region::save_snapshot(braft::Closure* done,
     }
 
     int64_t row_count = 0;
-    auto ret = _write_sst_for_data(done, snapshot_path + sst_file_name, iter, region_prefix, row_count); 
+    int ret = _link_last_snapshot_data(snapshot_path + sst_file_name, data_version, row_count);
     if (ret != 0) {
-        DB_WARNING("Error write sst for data, region_id: %ld", _region_id);
-        return;
+        row_count = 0;
+        ret = _write_sst_for_data(done, snapshot_path + sst_file_name, iter, region_prefix, row_count); 
+        if (ret != 0) {
+            DB_WARNING("Error write sst for data, region_id: %ld", _region_id);
+            return;
+        }
     }
     if (row_count != 0 && writer->add_file(sst_file_name) != 0) {
         done->status().set_error(EINVAL, "Fail to add snapshot");
@@ -3501,10 +3646,41 @@ void Region::save_snapshot(braft::Closure* done,
         DB_WARNING("Error while adding sst file to writer, region_id: %ld", _region_id);
         return;
     }
+    //writer的临时目录在snapshot完成后会在同一父目录下rename成snapshot_<index>
+    char snapshot_dir[64];
+    snprintf(snapshot_dir, sizeof(snapshot_dir), "snapshot_%020ld", snapshot_index);
+    boost::filesystem::path writer_path(snapshot_path);
+    _snapshot_data_file = (writer_path.parent_path() / snapshot_dir).string() + sst_file_name;
+    _snapshot_data_version = data_version;
+    _snapshot_data_rows = row_count;
     DB_WARNING("save snapshot success, num_table_lines:%ld, region_id: %ld, time_cost:%ld", 
                 _num_table_lines.load(), _region_id, time_cost.get_time());
     return;
 }
+
+// region数据自上次snapshot后没有变化时, 硬链接上次的数据sst, 避免全量重写
+int Region::_link_last_snapshot_data(const std::string& sst_file,
+                                     int64_t data_version,
+                                     int64_t& row_count) {
+    if (!FLAGS_snapshot_reuse_data_sst || _snapshot_data_version != data_version) {
+        return -1;
+    }
+    if (_snapshot_data_rows == 0) {
+        row_count = 0;
+        return 0;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::create_hard_link(_snapshot_data_file, sst_file, ec);
+    if (ec) {
+        DB_WARNING("link last snapshot data fail, file:%s, err:%s, region_id: %ld",
+                    _snapshot_data_file.c_str(), ec.message().c_str(), _region_id);
+        return -1;
+    }
+    row_count = _snapshot_data_rows;
+    DB_WARNING("reuse last snapshot data, file:%s, data_version:%ld, region_id: %ld",
+                _snapshot_data_file.c_str(), data_version, _region_id);
+    return 0;
+}
 int Region::_write_sst_for_region_info(braft::Closure* done, 
                                const std::string& sst_file, 
                                pb::RegionInfo& snapshot_region_info) {
@@ -3792,6 +3968,12 @@ int Region::get_split_key(std::string& split_key) {
     rocksdb::ReadOptions read_options;
     read_options.total_order_seek = false;
     read_options.prefix_same_as_start = true;
+    read_options.readahead_size = FLAGS_scan_readahead_size;
+    read_options.fill_cache = false;
+    MutTableKey upper_key;
+    upper_key.append_i64(_region_id).append_i64(tableid + 1);
+    rocksdb::Slice upper_slice(upper_key.data());
+    read_options.iterate_upper_bound = &upper_slice;
     std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
     MutTableKey key;
 
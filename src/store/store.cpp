@@ -21,6 +21,7 @@
 #include "rocksdb/utilities/memory_util.h"
 #include "mut_table_key.h"
 #include "my_raft_log_storage.h"
+#include "split_compaction_filter.h"
 #include "rocksdb/cache.h"
 #include "rocksdb/utilities/write_batch_with_index.h"
 
@@ -770,6 +771,11 @@ void Store::print_properties(const std::string& name) {
 }
 
 void Store::monitor_memory() {
+    std::map<std::string, size_t> cache_usage;
+    _rocksdb->get_block_cache_usage(&cache_usage);
+    for (auto& pair : cache_usage) {
+        SELF_TRACE("block cache usage, cf:%s, usage:%lu", pair.first.c_str(), pair.second);
+    }
     /*
     std::vector<rocksdb::DB*> dbs;
     std::unordered_set<const rocksdb::Cache*> cache_set;
@@ -779,11 +785,10 @@ void Store::monitor_memory() {
     dbs.push_back(db);
     // GetCachePointers(db, cache_set);
     // DB_WARNING("cache_set size: %lu", cache_set.size());
-    cache_set.insert(_rocksdb->get_cache());
+    _rocksdb->get_block_caches(&cache_set);
     rocksdb::MemoryUtil::GetApproximateMemoryUsageByType(dbs, cache_set, &usage_by_type);
     for (auto kv : usage_by_type) {
-        SELF_TRACE("momery type: %d, size: %lu, %lu", 
-            kv.first, kv.second, _rocksdb->get_cache()->GetPinnedUsage());
+        SELF_TRACE("momery type: %d, size: %lu", kv.first, kv.second);
     }
     */
 }
@@ -949,6 +954,7 @@ int Store::get_used_size_per_region(const std::vector<int64_t>& region_ids,
 void Store::update_schema_info(const pb::SchemaInfo& request) {
     //锁住的是update_table和table_info_mapping, table_info锁的位置不能改
     _factory->update_table(request);
+    SplitCompactionFilter::get_instance()->remove_table(request);
 }
 
 void Store::_check_split_complete(int64_t region_id) {
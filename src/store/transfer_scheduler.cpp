@@ -0,0 +1,54 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "transfer_scheduler.h"
+#include <gflags/gflags.h>
+
+namespace baikaldb {
+DEFINE_int64(snapshot_throttle_throughput_bytes, 50 * 1024 * 1024LL,
+        "snapshot copy throughput of the whole store, bytes/s, default 50MB");
+DEFINE_int64(snapshot_throttle_check_cycle, 10, "snapshot throttle check cycles per second");
+DEFINE_int32(add_peer_concurrency, 4, "max concurrent add_peer of the whole store, default 4");
+
+TransferScheduler::TransferScheduler() :
+        _snapshot_throttle(new braft::ThroughputSnapshotThrottle(
+                FLAGS_snapshot_throttle_throughput_bytes,
+                FLAGS_snapshot_throttle_check_cycle)),
+        _running_count("transfer_running_count"),
+        _busy_count("transfer_busy_count") {}
+
+bool TransferScheduler::try_acquire(Priority priority) {
+    std::unique_lock<bthread::Mutex> lock(_mutex);
+    int limit = FLAGS_add_peer_concurrency;
+    // 迁移/均衡任务不占满名额, 留一个给补副本
+    if (priority == PRIORITY_BALANCE && limit > 1) {
+        limit -= 1;
+    }
+    if (_running >= limit) {
+        _busy_count << 1;
+        return false;
+    }
+    ++_running;
+    _running_count << 1;
+    return true;
+}
+
+void TransferScheduler::release() {
+    std::unique_lock<bthread::Mutex> lock(_mutex);
+    --_running;
+    _running_count << -1;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,145 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "column_codec.h"
+#include "mem_row_descriptor.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+
+class ColumnCodecTest : public testing::Test {
+protected:
+    // tuple 0: int64, double, string三列
+    virtual void SetUp() {
+        pb::TupleDescriptor tuple;
+        tuple.set_tuple_id(0);
+        tuple.set_table_id(1);
+        pb::PrimitiveType types[] = {pb::INT64, pb::DOUBLE, pb::STRING};
+        for (int i = 0; i < 3; i++) {
+            pb::SlotDescriptor* slot = tuple.add_slots();
+            slot->set_slot_id(i + 1);
+            slot->set_tuple_id(0);
+            slot->set_slot_type(types[i]);
+        }
+        _tuples.push_back(tuple);
+        ASSERT_EQ(0, _desc.init(_tuples));
+    }
+    // 第i行: i, i * 0.5, "str_i", 每3行string列为null
+    void encode(int rows, butil::IOBuf* buf) {
+        ColumnEncoder encoder;
+        encoder.init(_tuples);
+        for (int i = 0; i < rows; i++) {
+            std::unique_ptr<MemRow> row = _desc.fetch_mem_row();
+            ExprValue v1(pb::INT64);
+            v1._u.int64_val = i;
+            ExprValue v2(pb::DOUBLE);
+            v2._u.double_val = i * 0.5;
+            row->set_value(0, 1, v1);
+            row->set_value(0, 2, v2);
+            if (i % 3 != 0) {
+                ExprValue v3(pb::STRING);
+                v3.str_val = "str_" + std::to_string(i);
+                row->set_value(0, 3, v3);
+            }
+            encoder.add_row(row.get());
+        }
+        EXPECT_EQ((size_t)rows, encoder.rows());
+        encoder.serialize(buf);
+    }
+    void check_row(MemRow* row, int i) {
+        EXPECT_EQ(i, row->get_value(0, 1).get_numberic<int64_t>());
+        EXPECT_DOUBLE_EQ(i * 0.5, row->get_value(0, 2).get_numberic<double>());
+        if (i % 3 == 0) {
+            EXPECT_TRUE(row->get_value(0, 3).is_null());
+        } else {
+            EXPECT_EQ("str_" + std::to_string(i), row->get_value(0, 3).get_string());
+        }
+    }
+
+    std::vector<pb::TupleDescriptor> _tuples;
+    MemRowDescriptor _desc;
+};
+
+TEST_F(ColumnCodecTest, test_decode_rows) {
+    butil::IOBuf buf;
+    encode(100, &buf);
+    ColumnDecoder decoder;
+    ASSERT_EQ(0, decoder.init(buf));
+    EXPECT_EQ(100u, decoder.rows());
+    EXPECT_EQ(0, decoder.single_tuple_id());
+    // 分两段解析
+    RowBatch batch;
+    ASSERT_EQ(0, decoder.decode_rows(&_desc, 0, 60, &batch));
+    ASSERT_EQ(0, decoder.decode_rows(&_desc, 60, 60, &batch));
+    ASSERT_EQ(100u, batch.size());
+    int i = 0;
+    for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+        check_row(batch.get_row().get(), i++);
+    }
+}
+
+TEST_F(ColumnCodecTest, test_decode_columns) {
+    butil::IOBuf buf;
+    encode(10, &buf);
+    ColumnDecoder decoder;
+    ASSERT_EQ(0, decoder.init(buf));
+    RowBatch batch;
+    ASSERT_EQ(0, batch.init_columns(_tuples[0]));
+    ASSERT_EQ(0, decoder.decode_columns(4, 6, &batch));
+    ASSERT_EQ(6u, batch.size());
+    ASSERT_EQ(0, batch.materialize(&_desc));
+    int i = 4;
+    for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+        check_row(batch.get_row().get(), i++);
+    }
+}
+
+TEST_F(ColumnCodecTest, test_decode_fragmented) {
+    butil::IOBuf buf;
+    encode(50, &buf);
+    // 每7字节一段拼成新的IOBuf, 各列的数据都跨多个block片段
+    butil::IOBuf fragmented;
+    while (!buf.empty()) {
+        butil::IOBuf piece;
+        buf.cutn(&piece, 7);
+        fragmented.append(piece);
+    }
+    ColumnDecoder decoder;
+    ASSERT_EQ(0, decoder.init(fragmented));
+    RowBatch batch;
+    ASSERT_EQ(0, decoder.decode_rows(&_desc, 0, 50, &batch));
+    ASSERT_EQ(50u, batch.size());
+    int i = 0;
+    for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+        check_row(batch.get_row().get(), i++);
+    }
+}
+
+TEST_F(ColumnCodecTest, test_truncated) {
+    butil::IOBuf buf;
+    encode(10, &buf);
+    std::string data = buf.to_string();
+    butil::IOBuf truncated;
+    truncated.append(data.data(), data.size() - 1);
+    ColumnDecoder decoder;
+    EXPECT_EQ(-1, decoder.init(truncated));
+}
+}  // namespace baikaldb
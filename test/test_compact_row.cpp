@@ -0,0 +1,132 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <google/protobuf/descriptor.pb.h>
+#include "tuple_record.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+using google::protobuf::DescriptorPool;
+using google::protobuf::DynamicMessageFactory;
+using google::protobuf::FieldDescriptorProto;
+using google::protobuf::FileDescriptorProto;
+
+class CompactRowTest : public testing::Test {
+protected:
+    // v1: 1 int32, 2 int64, 4 string, 5 double, 6 uint64, 9 bool, 10 string
+    // v2: 删掉tag 2, 增加 11 float
+    virtual void SetUp() {
+        FileDescriptorProto v1;
+        v1.set_name("v1.proto");
+        auto msg = v1.add_message_type();
+        msg->set_name("Row");
+        add_field(msg, 1, FieldDescriptorProto::TYPE_SINT32);
+        add_field(msg, 2, FieldDescriptorProto::TYPE_SINT64);
+        add_field(msg, 4, FieldDescriptorProto::TYPE_BYTES);
+        add_field(msg, 5, FieldDescriptorProto::TYPE_DOUBLE);
+        add_field(msg, 6, FieldDescriptorProto::TYPE_UINT64);
+        add_field(msg, 9, FieldDescriptorProto::TYPE_BOOL);
+        add_field(msg, 10, FieldDescriptorProto::TYPE_BYTES);
+        FileDescriptorProto v2 = v1;
+        v2.set_name("v2.proto");
+        v2.mutable_message_type(0)->set_name("RowV2");
+        auto fields = v2.mutable_message_type(0)->mutable_field();
+        fields->erase(fields->begin() + 1);
+        add_field(v2.mutable_message_type(0), 11, FieldDescriptorProto::TYPE_FLOAT);
+        _v1 = _pool.BuildFile(v1)->message_type(0);
+        _v2 = _pool.BuildFile(v2)->message_type(0);
+        ASSERT_TRUE(_v1 != nullptr && _v2 != nullptr);
+    }
+    void add_field(google::protobuf::DescriptorProto* msg, int tag,
+            FieldDescriptorProto::Type type) {
+        auto field = msg->add_field();
+        field->set_name("col" + std::to_string(tag));
+        field->set_number(tag);
+        field->set_label(FieldDescriptorProto::LABEL_OPTIONAL);
+        field->set_type(type);
+    }
+    SmartRecord new_record(const Descriptor* desc) {
+        return SmartRecord(new TableRecord(_factory.GetPrototype(desc)->New()));
+    }
+    SmartRecord v1_row() {
+        SmartRecord record = new_record(_v1);
+        record->set_int32(record->get_field_by_tag(1), -7);
+        record->set_int64(record->get_field_by_tag(2), -1LL << 40);
+        record->set_double(record->get_field_by_tag(5), 3.25);
+        record->set_uint64(record->get_field_by_tag(6), UINT64_MAX);
+        record->set_boolean(record->get_field_by_tag(9), true);
+        record->set_string(record->get_field_by_tag(10), "hello");
+        return record;
+    }
+
+    DescriptorPool _pool;
+    DynamicMessageFactory _factory;
+    const Descriptor* _v1 = nullptr;
+    const Descriptor* _v2 = nullptr;
+};
+
+TEST_F(CompactRowTest, test_same_as_proto) {
+    SmartRecord record = v1_row();
+    std::string compact;
+    std::string proto;
+    ASSERT_EQ(0, record->encode_compact(compact));
+    ASSERT_EQ(0, record->encode(proto));
+    EXPECT_TRUE(TupleRecord(compact).is_compact());
+    EXPECT_FALSE(TupleRecord(proto).is_compact());
+    std::vector<int32_t> fields = {1, 2, 4, 5, 6, 9, 10};
+    SmartRecord from_compact = new_record(_v1);
+    SmartRecord from_proto = new_record(_v1);
+    ASSERT_EQ(0, TupleRecord(compact).decode_fields(fields, from_compact));
+    ASSERT_EQ(0, TupleRecord(proto).decode_fields(fields, from_proto));
+    EXPECT_EQ(from_proto->debug_string(), from_compact->debug_string());
+    EXPECT_EQ(record->debug_string(), from_compact->debug_string());
+    EXPECT_TRUE(from_compact->is_null(from_compact->get_field_by_tag(4)));
+
+    // 只解析部分字段
+    SmartRecord part = new_record(_v1);
+    ASSERT_EQ(0, TupleRecord(compact).decode_fields({6, 10}, part));
+    EXPECT_TRUE(part->is_null(part->get_field_by_tag(1)));
+    uint64_t u64 = 0;
+    std::string str;
+    ASSERT_EQ(0, part->get_uint64(part->get_field_by_tag(6), u64));
+    ASSERT_EQ(0, part->get_string(part->get_field_by_tag(10), str));
+    EXPECT_EQ(UINT64_MAX, u64);
+    EXPECT_EQ("hello", str);
+}
+
+TEST_F(CompactRowTest, test_schema_change) {
+    std::string compact;
+    ASSERT_EQ(0, v1_row()->encode_compact(compact));
+    SmartRecord record = new_record(_v2);
+    ASSERT_EQ(0, TupleRecord(compact).decode_fields({1, 5, 10, 11}, record));
+    int32_t i32 = 0;
+    double d = 0;
+    ASSERT_EQ(0, record->get_int32(record->get_field_by_tag(1), i32));
+    ASSERT_EQ(0, record->get_double(record->get_field_by_tag(5), d));
+    EXPECT_EQ(-7, i32);
+    EXPECT_DOUBLE_EQ(3.25, d);
+    EXPECT_TRUE(record->is_null(record->get_field_by_tag(11)));
+
+    // 截断的数据解析失败
+    SmartRecord truncated = new_record(_v1);
+    EXPECT_EQ(-1, TupleRecord(rocksdb::Slice(compact.data(), compact.size() - 1))
+            .decode_fields({10}, truncated));
+}
+}  // namespace baikaldb
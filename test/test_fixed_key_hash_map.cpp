@@ -0,0 +1,57 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include "fixed_key_hash_map.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+
+TEST(test_fixed_key_hash_map, case_all) {
+    FixedKeyHashMap<int64_t> hash_map;
+    // 初始容量很小, 覆盖多次扩容
+    hash_map.init(2, 4);
+    std::map<std::pair<uint64_t, uint64_t>, int64_t> expect;
+    for (int i = 0; i < 100000; i++) {
+        uint64_t key[2] = {(uint64_t)(rand() % 2), (uint64_t)(rand() % 5000)};
+        bool inserted = false;
+        int64_t* value = hash_map.seek_or_insert(key, &inserted);
+        auto pair = std::make_pair(key[0], key[1]);
+        ASSERT_EQ(expect.count(pair) == 0, inserted);
+        *value += i;
+        expect[pair] += i;
+    }
+    EXPECT_EQ(expect.size(), hash_map.size());
+
+    size_t count = 0;
+    for (size_t pos = hash_map.next_used(0); pos < hash_map.capacity();
+            pos = hash_map.next_used(pos + 1)) {
+        const uint64_t* key = hash_map.key_at(pos);
+        EXPECT_EQ(expect[std::make_pair(key[0], key[1])], hash_map.value_at(pos));
+        ++count;
+    }
+    EXPECT_EQ(expect.size(), count);
+
+    uint64_t not_exist[2] = {3, 1};
+    EXPECT_EQ(nullptr, hash_map.seek(not_exist));
+}
+}  // namespace baikaldb
@@ -0,0 +1,154 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "join_hash_table.h"
+#include "mem_row_descriptor.h"
+#include "slot_ref.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+
+class JoinHashTableTest : public testing::Test {
+protected:
+    // tuple 0为build侧, tuple 1为probe侧, 各有一个slot
+    void init(pb::PrimitiveType build_type, pb::PrimitiveType probe_type) {
+        std::vector<pb::TupleDescriptor> tuples;
+        pb::PrimitiveType types[] = {build_type, probe_type};
+        for (int i = 0; i < 2; i++) {
+            pb::TupleDescriptor tuple;
+            tuple.set_tuple_id(i);
+            tuple.set_table_id(i + 1);
+            pb::SlotDescriptor* slot = tuple.add_slots();
+            slot->set_slot_id(1);
+            slot->set_tuple_id(i);
+            slot->set_slot_type(types[i]);
+            tuples.push_back(tuple);
+
+            pb::ExprNode node;
+            node.set_node_type(pb::SLOT_REF);
+            node.set_col_type(types[i]);
+            node.set_num_children(0);
+            node.mutable_derive_node()->set_tuple_id(i);
+            node.mutable_derive_node()->set_slot_id(1);
+            SlotRef* slot_ref = new SlotRef;
+            slot_ref->init(node);
+            _slots.push_back(slot_ref);
+        }
+        ASSERT_EQ(0, _desc.init(tuples));
+        _hash_table.init({_slots[0]}, {_slots[1]});
+    }
+    virtual void TearDown() {
+        for (auto row : _rows) {
+            delete row;
+        }
+        for (auto slot : _slots) {
+            ExprNode::destory_tree(slot);
+        }
+    }
+    MemRow* make_row(int32_t tuple_id, const ExprValue& value) {
+        std::unique_ptr<MemRow> row = _desc.fetch_mem_row();
+        if (!value.is_null()) {
+            row->set_value(tuple_id, 1, value);
+        }
+        _rows.push_back(row.release());
+        return _rows.back();
+    }
+    void build(const ExprValue& value) {
+        MemRow* row = make_row(0, value);
+        if (_hash_table.encode_key(row, true)) {
+            _hash_table.insert(row);
+        }
+    }
+    size_t probe(const ExprValue& value) {
+        MemRow* row = make_row(1, value);
+        if (!_hash_table.encode_key(row, false)) {
+            return 0;
+        }
+        std::vector<MemRow*>* rows = _hash_table.seek();
+        return rows == nullptr ? 0 : rows->size();
+    }
+    ExprValue value(pb::PrimitiveType type, int64_t v) {
+        ExprValue value(pb::INT64);
+        value._u.int64_val = v;
+        if (type == pb::DOUBLE) {
+            value.type = pb::DOUBLE;
+            value._u.double_val = v;
+        } else if (type == pb::STRING) {
+            value.type = pb::STRING;
+            value.str_val = std::to_string(v);
+        } else {
+            value.cast_to(type);
+        }
+        return value;
+    }
+
+    MemRowDescriptor _desc;
+    std::vector<ExprNode*> _slots;
+    std::vector<MemRow*> _rows;
+    JoinHashTable _hash_table;
+};
+
+TEST_F(JoinHashTableTest, test_int_key) {
+    init(pb::INT64, pb::INT32);
+    EXPECT_TRUE(_hash_table.use_fixed_key());
+    for (int i = 0; i < 1000; i++) {
+        build(value(pb::INT64, i % 100 - 50));
+    }
+    EXPECT_EQ(100, _hash_table.size());
+    EXPECT_EQ(10, probe(value(pb::INT32, -50)));
+    EXPECT_EQ(10, probe(value(pb::INT32, 49)));
+    EXPECT_EQ(0, probe(value(pb::INT32, 50)));
+    // null不匹配
+    build(ExprValue::Null());
+    EXPECT_EQ(0, probe(ExprValue::Null()));
+}
+
+TEST_F(JoinHashTableTest, test_double_key) {
+    init(pb::INT64, pb::DOUBLE);
+    EXPECT_TRUE(_hash_table.use_fixed_key());
+    build(value(pb::INT64, 3));
+    build(value(pb::INT64, 0));
+    EXPECT_EQ(1, probe(value(pb::DOUBLE, 3)));
+    ExprValue neg_zero(pb::DOUBLE);
+    neg_zero._u.double_val = -0.0;
+    EXPECT_EQ(1, probe(neg_zero));
+    ExprValue half(pb::DOUBLE);
+    half._u.double_val = 3.5;
+    EXPECT_EQ(0, probe(half));
+    // 超过2^53的整数不能精确转成double, 不会和相邻的整数混在一起
+    int64_t big = 1LL << 53;
+    build(value(pb::INT64, big));
+    build(value(pb::INT64, big + 1));
+    EXPECT_EQ(1, probe(value(pb::DOUBLE, big)));
+    EXPECT_EQ(0, probe(value(pb::DOUBLE, big + 2)));
+}
+
+TEST_F(JoinHashTableTest, test_string_key) {
+    init(pb::STRING, pb::INT64);
+    EXPECT_FALSE(_hash_table.use_fixed_key());
+    build(value(pb::STRING, 7));
+    build(value(pb::STRING, 7));
+    EXPECT_EQ(2, probe(value(pb::INT64, 7)));
+    EXPECT_EQ(0, probe(value(pb::INT64, 8)));
+    _hash_table.clear();
+    EXPECT_EQ(0, probe(value(pb::INT64, 7)));
+}
+}  // namespace baikaldb
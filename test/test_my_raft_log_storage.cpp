@@ -16,6 +16,36 @@
 #include <my_raft_log_storage.h>
 #include <raft_log_compaction_filter.h>
 #include <proto/meta.interface.pb.h>
+#include <gflags/gflags.h>
+#include <bvar/bvar.h>
+
+namespace baikaldb {
+DECLARE_int64(raft_log_cache_total_bytes);
+}
+
+static int64_t get_cache_miss() {
+    return atoll(bvar::Variable::describe_exposed("raft_log_cache_miss").c_str());
+}
+
+static int append_data_entry(raft::LogStorage* raft_log, int64_t index) {
+    raft::LogEntry* entry = new raft::LogEntry();
+    entry->type = raft::ENTRY_TYPE_DATA;
+    entry->id = raft::LogId(index, 1);
+    entry->data.append(std::string(400, 'x'));
+    int ret = raft_log->append_entry(entry);
+    entry->Release();
+    return ret;
+}
+
+// 读一条log, 返回是否命中缓存
+static bool read_hit_cache(raft::LogStorage* raft_log, int64_t index) {
+    int64_t miss = get_cache_miss();
+    raft::LogEntry* entry = raft_log->get_entry(index);
+    if (entry != NULL) {
+        entry->Release();
+    }
+    return get_cache_miss() == miss;
+}
 
 int main(int argc, char** argv) {
     const std::string rocks_path = "rocks_raft_log";
@@ -485,6 +515,36 @@ int main(int argc, char** argv) {
         std::cout << "last log index: " << raft_log->last_log_index() << std::endl;
     }
     baikaldb::RaftLogCompactionFilter::get_instance()->print_map();
+    // 全局缓存超过上限时, 从最久没访问的region淘汰, 不只淘汰当前region
+    {
+        baikaldb::FLAGS_raft_log_cache_total_bytes = 1024;
+        raft::LogStorage* log_a = my_raft_log_storage.new_instance("raft_log?id=2");
+        raft::LogStorage* log_b = my_raft_log_storage.new_instance("raft_log?id=3");
+        if (log_a->init(configuration_manager) < 0 || log_b->init(configuration_manager) < 0) {
+            std::cout << "raft log storage init fail" << std::endl;
+            return -1;
+        }
+        int64_t a_index = log_a->last_log_index() + 1;
+        int64_t b_index = log_b->last_log_index() + 1;
+        // a: 2条800字节, b: 1条400字节, 超过1024时淘汰a最老的一条
+        append_data_entry(log_a, a_index);
+        append_data_entry(log_a, a_index + 1);
+        append_data_entry(log_b, b_index);
+        if (read_hit_cache(log_a, a_index) || !read_hit_cache(log_a, a_index + 1)) {
+            std::cout << "raft log cache evict oldest fail" << std::endl;
+            return -1;
+        }
+        // a刚被访问过, b再append时淘汰的是b自己的旧log, a的log还在缓存里
+        append_data_entry(log_b, b_index + 1);
+        if (!read_hit_cache(log_a, a_index + 1) || read_hit_cache(log_b, b_index)
+                || !read_hit_cache(log_b, b_index + 1)) {
+            std::cout << "raft log cache evict lru region fail" << std::endl;
+            return -1;
+        }
+        std::cout << "raft log cache lru evict success" << std::endl;
+        delete log_a;
+        delete log_b;
+    }
     return 0;
 }
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,75 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "plan_cache.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+TEST(test_plan_cache, case_normalize) {
+    std::string normalized;
+    std::vector<pb::ExprNode> params;
+    ASSERT_TRUE(PlanCache::normalize(
+            "select id, 'a' from t1 where  id = 10 and name = 'x\\'y' and score > 1.5e2",
+            &normalized, &params));
+    EXPECT_EQ("select id, 'a' from t1 where id = ? and name = ? and score > ?", normalized);
+    ASSERT_EQ(3u, params.size());
+    EXPECT_EQ(pb::INT_LITERAL, params[0].node_type());
+    EXPECT_EQ(10, params[0].derive_node().int_val());
+    EXPECT_EQ(pb::STRING_LITERAL, params[1].node_type());
+    EXPECT_EQ("x'y", params[1].derive_node().string_val());
+    EXPECT_EQ(pb::DOUBLE_LITERAL, params[2].node_type());
+    EXPECT_DOUBLE_EQ(150, params[2].derive_node().double_val());
+
+    // 同一模板, 不同常量
+    std::string normalized2;
+    ASSERT_TRUE(PlanCache::normalize(
+            "select id, 'a' from t1 where id = 11 and name = \"z\" and score > 2",
+            &normalized2, &params));
+    EXPECT_EQ(normalized, normalized2);
+
+    // limit和order by中的数字, 标识符中的数字保留
+    ASSERT_TRUE(PlanCache::normalize(
+            "update t2 set c1 = 1 where `c2` = 2 and 3c = 0x1F order by 1 limit 10",
+            &normalized, &params));
+    EXPECT_EQ("update t2 set c1 = ? where `c2` = ? and 3c = 0x1F order by 1 limit 10",
+            normalized);
+    EXPECT_EQ(2u, params.size());
+
+    // like中的转义保留'\'
+    ASSERT_TRUE(PlanCache::normalize("delete from t where a like 'a\\_%'",
+            &normalized, &params));
+    ASSERT_EQ(1u, params.size());
+    EXPECT_EQ("a\\_%", params[0].derive_node().string_val());
+
+    // 超出int64的整数不参数化
+    ASSERT_TRUE(PlanCache::normalize("select * from t where id = 18446744073709551615",
+            &normalized, &params));
+    EXPECT_EQ("select * from t where id = 18446744073709551615", normalized);
+    EXPECT_EQ(0u, params.size());
+
+    EXPECT_FALSE(PlanCache::normalize("insert into t values (1)", &normalized, &params));
+    EXPECT_FALSE(PlanCache::normalize("select * from t where id = ?", &normalized, &params));
+    EXPECT_FALSE(PlanCache::normalize("select * from t /* c */ where id = 1",
+            &normalized, &params));
+    EXPECT_FALSE(PlanCache::normalize("select * from t where s = 'a", &normalized, &params));
+}
+}  // namespace baikaldb
@@ -0,0 +1,146 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "row_batch.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+
+static pb::TupleDescriptor make_tuple() {
+    pb::TupleDescriptor tuple;
+    tuple.set_tuple_id(0);
+    tuple.set_table_id(1);
+    pb::SlotDescriptor* slot = tuple.add_slots();
+    slot->set_slot_id(1);
+    slot->set_tuple_id(0);
+    slot->set_slot_type(pb::INT64);
+    slot = tuple.add_slots();
+    slot->set_slot_id(2);
+    slot->set_tuple_id(0);
+    slot->set_slot_type(pb::DOUBLE);
+    slot = tuple.add_slots();
+    slot->set_slot_id(3);
+    slot->set_tuple_id(0);
+    slot->set_slot_type(pb::STRING);
+    return tuple;
+}
+
+static void fill_batch(RowBatch* batch, int rows) {
+    ColumnBatch* columns = batch->mutable_columns();
+    for (int i = 0; i < rows; i++) {
+        columns->column(0).append_int(i);
+        if (i % 2 == 0) {
+            columns->column(1).append_null();
+        } else {
+            columns->column(1).append_double(i * 1.5);
+        }
+        std::string str = "s" + std::to_string(i);
+        columns->column(2).append_string(str.data(), str.size());
+        batch->add_column_row();
+    }
+}
+
+TEST(test_column_batch, case_all) {
+    RowBatch batch;
+    ASSERT_FALSE(batch.is_columnar());
+    ASSERT_EQ(0, batch.init_columns(make_tuple()));
+    ASSERT_TRUE(batch.is_columnar());
+    fill_batch(&batch, 10);
+    EXPECT_EQ(10, batch.size());
+
+    ColumnBatch* columns = batch.mutable_columns();
+    EXPECT_EQ(7, columns->get_value(0, 1, 7).get_numberic<int64_t>());
+    EXPECT_TRUE(columns->get_value(0, 2, 4).is_null());
+    EXPECT_DOUBLE_EQ(4.5, columns->get_value(0, 2, 3).get_numberic<double>());
+    EXPECT_EQ("s9", columns->get_value(0, 3, 9).get_string());
+    EXPECT_TRUE(columns->get_value(0, 4, 0).is_null());
+    EXPECT_TRUE(columns->get_value(1, 1, 0).is_null());
+
+    // 列存类型不一致时追加需要cast
+    ColumnVector column;
+    column.init(0, 1, pb::INT32, 4);
+    ExprValue value(pb::STRING);
+    value.str_val = "123";
+    column.append_value(value);
+    EXPECT_EQ(123, column.get_value(0).get_numberic<int32_t>());
+    EXPECT_EQ(pb::INT32, column.get_value(0).type);
+}
+
+TEST(test_column_batch, selection) {
+    RowBatch batch;
+    ASSERT_EQ(0, batch.init_columns(make_tuple()));
+    fill_batch(&batch, 10);
+
+    // 只保留奇数行
+    std::vector<uint32_t>* selection = batch.mutable_selection();
+    size_t keep = 0;
+    for (size_t i = 0; i < selection->size(); i++) {
+        if ((*selection)[i] % 2 == 1) {
+            (*selection)[keep++] = (*selection)[i];
+        }
+    }
+    selection->resize(keep);
+    EXPECT_EQ(5, batch.size());
+
+    batch.skip_rows(1);
+    EXPECT_EQ(4, batch.size());
+    batch.keep_first_rows(3);
+    EXPECT_EQ(3, batch.size());
+
+    std::vector<int64_t> expected = {3, 5, 7};
+    size_t idx = 0;
+    for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+        EXPECT_EQ(expected[idx++], batch.mutable_columns()->get_value(
+                    0, 1, batch.column_row()).get_numberic<int64_t>());
+    }
+    EXPECT_EQ(3, idx);
+}
+
+TEST(test_column_batch, materialize) {
+    MemRowDescriptor desc;
+    std::vector<pb::TupleDescriptor> tuples = {make_tuple()};
+    ASSERT_EQ(0, desc.init(tuples));
+
+    RowBatch batch;
+    ASSERT_EQ(0, batch.init_columns(make_tuple()));
+    fill_batch(&batch, 4);
+
+    // MemRow绑定列存行后只读
+    std::unique_ptr<MemRow> view = desc.fetch_mem_row();
+    view->bind_column_row(batch.mutable_columns(), 3);
+    EXPECT_EQ(3, view->get_value(0, 1).get_numberic<int64_t>());
+    EXPECT_EQ("s3", view->get_value(0, 3).get_string());
+    EXPECT_GT(0, view->set_value(0, 1, ExprValue::Null()));
+
+    batch.mutable_selection()->erase(batch.mutable_selection()->begin());
+    ASSERT_EQ(0, batch.materialize(&desc));
+    EXPECT_FALSE(batch.is_columnar());
+    EXPECT_EQ(3, batch.size());
+    int64_t expected = 1;
+    for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+        MemRow* row = batch.get_row().get();
+        EXPECT_EQ(expected, row->get_value(0, 1).get_numberic<int64_t>());
+        EXPECT_EQ(expected % 2 == 0, row->get_value(0, 2).is_null());
+        EXPECT_EQ("s" + std::to_string(expected), row->get_value(0, 3).get_string());
+        expected++;
+    }
+}
+}  // namespace baikaldb
@@ -0,0 +1,221 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include "sorter.h"
+#include "slot_ref.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+
+class SorterTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        pb::TupleDescriptor tuple;
+        tuple.set_tuple_id(0);
+        tuple.set_table_id(1);
+        pb::SlotDescriptor* slot = tuple.add_slots();
+        slot->set_slot_id(1);
+        slot->set_tuple_id(0);
+        slot->set_slot_type(pb::INT64);
+        std::vector<pb::TupleDescriptor> tuples = {tuple};
+        ASSERT_EQ(0, _desc.init(tuples));
+
+        pb::ExprNode node;
+        node.set_node_type(pb::SLOT_REF);
+        node.set_col_type(pb::INT64);
+        node.set_num_children(0);
+        node.mutable_derive_node()->set_tuple_id(0);
+        node.mutable_derive_node()->set_slot_id(1);
+        SlotRef* slot_ref = new SlotRef;
+        slot_ref->init(node);
+        _order_exprs.push_back(slot_ref);
+        _is_asc.push_back(true);
+        _is_null_first.push_back(true);
+        _comp.reset(new MemRowCompare(_order_exprs, _is_asc, _is_null_first));
+    }
+    virtual void TearDown() {
+        for (auto expr : _order_exprs) {
+            ExprNode::destory_tree(expr);
+        }
+    }
+    std::shared_ptr<RowBatch> make_batch(const std::vector<int64_t>& values) {
+        std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+        for (auto value : values) {
+            std::unique_ptr<MemRow> row = _desc.fetch_mem_row();
+            ExprValue v(pb::INT64);
+            v._u.int64_val = value;
+            row->set_value(0, 1, v);
+            batch->move_row(std::move(row));
+        }
+        return batch;
+    }
+    std::vector<int64_t> fetch_all(Sorter* sorter) {
+        std::vector<int64_t> values;
+        bool eos = false;
+        while (!eos) {
+            RowBatch batch;
+            sorter->get_next(&batch, &eos);
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                values.push_back(batch.get_row()->get_value(0, 1).get_numberic<int64_t>());
+            }
+        }
+        return values;
+    }
+
+    MemRowDescriptor _desc;
+    std::vector<ExprNode*> _order_exprs;
+    std::vector<bool> _is_asc;
+    std::vector<bool> _is_null_first;
+    std::unique_ptr<MemRowCompare> _comp;
+};
+
+TEST_F(SorterTest, test_topn) {
+    std::vector<int64_t> all;
+    Sorter sorter(_comp.get());
+    sorter.set_limit(20);
+    for (int i = 0; i < 10; i++) {
+        std::vector<int64_t> values;
+        for (int j = 0; j < 100; j++) {
+            values.push_back(rand() % 500);
+        }
+        all.insert(all.end(), values.begin(), values.end());
+        auto batch = make_batch(values);
+        sorter.add_batch(batch);
+    }
+    sorter.sort();
+    EXPECT_EQ(1, sorter.batch_size());
+    std::sort(all.begin(), all.end());
+    all.resize(20);
+    EXPECT_EQ(all, fetch_all(&sorter));
+}
+
+TEST_F(SorterTest, test_topn_large_limit) {
+    std::vector<int64_t> all;
+    Sorter sorter(_comp.get());
+    sorter.set_limit(3000);
+    for (int i = 0; i < 5; i++) {
+        std::vector<int64_t> values;
+        for (int j = 0; j < 1000; j++) {
+            values.push_back(rand() % 10000);
+        }
+        all.insert(all.end(), values.begin(), values.end());
+        auto batch = make_batch(values);
+        sorter.add_batch(batch);
+    }
+    sorter.sort();
+    // 结果按batch容量切开
+    EXPECT_EQ((3000 + ROW_BATCH_CAPACITY - 1) / ROW_BATCH_CAPACITY, sorter.batch_size());
+    std::sort(all.begin(), all.end());
+    all.resize(3000);
+    EXPECT_EQ(all, fetch_all(&sorter));
+}
+
+TEST_F(SorterTest, test_topn_less_rows) {
+    Sorter sorter(_comp.get());
+    sorter.set_limit(20);
+    auto batch = make_batch({5, 3, 9});
+    sorter.add_batch(batch);
+    sorter.sort();
+    EXPECT_EQ(std::vector<int64_t>({3, 5, 9}), fetch_all(&sorter));
+
+    Sorter empty_sorter(_comp.get());
+    empty_sorter.set_limit(20);
+    empty_sorter.sort();
+    EXPECT_EQ(0, empty_sorter.batch_size());
+}
+
+TEST_F(SorterTest, test_spill) {
+    std::vector<int64_t> all;
+    Sorter sorter(_comp.get());
+    // 内存上限很小且不限制run大小, 每个batch都会落盘
+    FLAGS_sort_spill_min_run_bytes = 0;
+    SmartMemTracker tracker = std::make_shared<MemTracker>(1);
+    sorter.set_mem_tracker(tracker, &_desc);
+    for (int i = 0; i < 5; i++) {
+        std::vector<int64_t> values;
+        for (int j = 0; j < 3000; j++) {
+            values.push_back(rand() % 10000);
+        }
+        all.insert(all.end(), values.begin(), values.end());
+        auto batch = make_batch(values);
+        ASSERT_EQ(0, sorter.add_batch(batch));
+    }
+    EXPECT_EQ(5, sorter.spill_run_size());
+    // 落盘后内存归还给query
+    EXPECT_EQ(0, tracker->used());
+    ASSERT_EQ(0, sorter.sort());
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(all, fetch_all(&sorter));
+}
+
+TEST_F(SorterTest, test_shared_mem_budget) {
+    auto batch1 = make_batch({3, 1, 2});
+    auto batch2 = make_batch({6, 5, 4});
+    int64_t batch_size = 0;
+    for (batch1->reset(); !batch1->is_traverse_over(); batch1->next()) {
+        batch_size += batch1->get_row()->used_size();
+    }
+    // 单个sorter不超限, 两个sorter加起来超限
+    FLAGS_sort_spill_min_run_bytes = 0;
+    SmartMemTracker tracker = std::make_shared<MemTracker>(batch_size * 3 / 2);
+    {
+        Sorter sorter1(_comp.get());
+        Sorter sorter2(_comp.get());
+        sorter1.set_mem_tracker(tracker, &_desc);
+        sorter2.set_mem_tracker(tracker, &_desc);
+        ASSERT_EQ(0, sorter1.add_batch(batch1));
+        EXPECT_EQ(0, sorter1.spill_run_size());
+        EXPECT_EQ(batch_size, tracker->used());
+        ASSERT_EQ(0, sorter2.add_batch(batch2));
+        EXPECT_EQ(1, sorter2.spill_run_size());
+        EXPECT_EQ(batch_size, tracker->used());
+        ASSERT_EQ(0, sorter2.sort());
+        EXPECT_EQ(std::vector<int64_t>({4, 5, 6}), fetch_all(&sorter2));
+    }
+    // 析构时归还
+    EXPECT_EQ(0, tracker->used());
+}
+
+TEST_F(SorterTest, test_spill_min_run) {
+    auto batch1 = make_batch({3, 1, 2});
+    int64_t batch_size = 0;
+    for (batch1->reset(); !batch1->is_traverse_over(); batch1->next()) {
+        batch_size += batch1->get_row()->used_size();
+    }
+    // 预算被其他算子占满, sorter缓存够两个batch才落盘
+    FLAGS_sort_spill_min_run_bytes = batch_size * 2;
+    SmartMemTracker tracker = std::make_shared<MemTracker>(1);
+    tracker->consume(100);
+    Sorter sorter(_comp.get());
+    sorter.set_mem_tracker(tracker, &_desc);
+    ASSERT_EQ(0, sorter.add_batch(batch1));
+    EXPECT_EQ(0, sorter.spill_run_size());
+    auto batch2 = make_batch({6, 5, 4});
+    ASSERT_EQ(0, sorter.add_batch(batch2));
+    EXPECT_EQ(1, sorter.spill_run_size());
+    EXPECT_EQ(100, tracker->used());
+    ASSERT_EQ(0, sorter.sort());
+    EXPECT_EQ(std::vector<int64_t>({1, 2, 3, 4, 5, 6}), fetch_all(&sorter));
+    tracker->release(100);
+}
+}  // namespace baikaldb
@@ -863,6 +863,30 @@ TEST(test_parser, case_where) {
         ASSERT_TRUE(select_stmt->where != nullptr);
     }
 }
+TEST(test_parser, case_place_holder) {
+    {
+        parser::SqlParser parser;
+        std::string sql_where = "select field_a from table_a where field_b = ? and "
+                                "field_c = '?' and field_d in (?, ?)";
+        parser.parse(sql_where);
+        ASSERT_EQ(0, parser.error);
+        ASSERT_EQ(1, parser.result.size());
+        ASSERT_EQ(3, parser.place_holder_id);
+        parser::SelectStmt* select_stmt = (parser::SelectStmt*)parser.result[0];
+        std::cout << select_stmt->to_string() << std::endl;
+        ASSERT_TRUE(select_stmt->where != nullptr);
+        // where: (field_b = ? and field_c = '?') and field_d in (?, ?)
+        parser::FuncExpr* and_expr = (parser::FuncExpr*)select_stmt->where->children[0];
+        parser::FuncExpr* eq_b = (parser::FuncExpr*)and_expr->children[0];
+        parser::LiteralExpr* lit_b = (parser::LiteralExpr*)eq_b->children[1];
+        ASSERT_EQ(parser::LT_PLACE_HOLDER, lit_b->literal_type);
+        ASSERT_EQ(0, lit_b->place_holder_id);
+        parser::FuncExpr* eq_c = (parser::FuncExpr*)and_expr->children[1];
+        parser::LiteralExpr* lit_c = (parser::LiteralExpr*)eq_c->children[1];
+        ASSERT_EQ(parser::LT_STRING, lit_c->literal_type);
+        ASSERT_EQ(std::string("?"), lit_c->_u.str_val.value);
+    }
+}
 TEST(test_parser, case_group) {
     {
         parser::SqlParser parser;
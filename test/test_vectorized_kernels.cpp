@@ -0,0 +1,136 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include "vectorized_kernels.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+
+template <typename T>
+static bool compare(T a, CompareOp op, T b) {
+    switch (op) {
+        case CMP_EQ:
+            return a == b;
+        case CMP_NE:
+            return a != b;
+        case CMP_GT:
+            return a > b;
+        case CMP_GE:
+            return a >= b;
+        case CMP_LT:
+            return a < b;
+        default:
+            return a <= b;
+    }
+}
+
+static const CompareOp ALL_OPS[] = {CMP_EQ, CMP_NE, CMP_GT, CMP_GE, CMP_LT, CMP_LE};
+
+TEST(test_compare, case_int) {
+    // 行数不是4的倍数, 覆盖simd尾部
+    const size_t rows = 1023;
+    std::vector<int64_t> data(rows);
+    for (size_t i = 0; i < rows; i++) {
+        data[i] = (int64_t)(rand() % 64) - 32;
+    }
+    data[0] = INT64_MIN;
+    data[1] = INT64_MAX;
+    data[2] = -1;
+    std::vector<uint8_t> mask(rows);
+    for (auto op : ALL_OPS) {
+        for (int64_t value : {(int64_t)-1, (int64_t)0, (int64_t)5, INT64_MIN}) {
+            compare_int64(data.data(), rows, op, value, mask.data());
+            for (size_t i = 0; i < rows; i++) {
+                ASSERT_EQ(compare(data[i], op, value), mask[i] == 1) << i << " op:" << op;
+            }
+            compare_uint64(data.data(), rows, op, value, mask.data());
+            for (size_t i = 0; i < rows; i++) {
+                ASSERT_EQ(compare((uint64_t)data[i], op, (uint64_t)value), mask[i] == 1)
+                    << i << " op:" << op;
+            }
+        }
+    }
+}
+
+TEST(test_compare, case_double) {
+    const size_t rows = 1022;
+    std::vector<double> data(rows);
+    for (size_t i = 0; i < rows; i++) {
+        data[i] = (rand() % 100) / 4.0 - 10;
+    }
+    std::vector<uint8_t> mask(rows);
+    for (auto op : ALL_OPS) {
+        for (double value : {-10.0, 0.25, 3.0}) {
+            compare_double(data.data(), rows, op, value, mask.data());
+            for (size_t i = 0; i < rows; i++) {
+                ASSERT_EQ(compare(data[i], op, value), mask[i] == 1) << i << " op:" << op;
+            }
+        }
+    }
+    EXPECT_EQ(CMP_LT, reverse_compare_op(CMP_GT));
+    EXPECT_EQ(CMP_GE, reverse_compare_op(CMP_LE));
+    EXPECT_EQ(CMP_NE, reverse_compare_op(CMP_NE));
+}
+
+TEST(test_in, case_all) {
+    const size_t rows = 1021;
+    std::vector<int64_t> data(rows);
+    std::vector<double> ddata(rows);
+    for (size_t i = 0; i < rows; i++) {
+        data[i] = rand() % 100;
+        ddata[i] = data[i] / 2.0;
+    }
+    std::vector<uint8_t> mask(rows);
+    // 短列表走simd, 长列表走二分
+    for (size_t list_size : {1, 3, 8, 9, 30}) {
+        std::vector<int64_t> values;
+        std::vector<double> dvalues;
+        for (size_t i = 0; i < list_size; i++) {
+            values.push_back(i * 3);
+            dvalues.push_back(i * 1.5);
+        }
+        in_int64(data.data(), rows, values, mask.data());
+        for (size_t i = 0; i < rows; i++) {
+            bool hit = std::find(values.begin(), values.end(), data[i]) != values.end();
+            ASSERT_EQ(hit, mask[i] == 1);
+        }
+        in_double(ddata.data(), rows, dvalues, mask.data());
+        for (size_t i = 0; i < rows; i++) {
+            bool hit = std::find(dvalues.begin(), dvalues.end(), ddata[i]) != dvalues.end();
+            ASSERT_EQ(hit, mask[i] == 1);
+        }
+    }
+}
+
+TEST(test_select_by_mask, case_all) {
+    std::vector<uint8_t> mask = {1, 0, 1, 1, 0, 1};
+    std::vector<uint8_t> null_flags = {0, 0, 1, 0, 0, 0};
+    std::vector<uint32_t> selection = {0, 1, 2, 3, 5};
+    select_by_mask(mask.data(), null_flags.data(), &selection);
+    EXPECT_EQ(std::vector<uint32_t>({0, 3, 5}), selection);
+
+    selection = {1, 2, 4, 5};
+    select_by_mask(mask.data(), nullptr, &selection);
+    EXPECT_EQ(std::vector<uint32_t>({2, 5}), selection);
+}
+}  // namespace baikaldb